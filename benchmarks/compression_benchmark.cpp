@@ -0,0 +1,243 @@
+// Throughput and ratio of every registered codec on corpora shaped like the
+// dumps this tool produces. Each benchmark reports MB/s of uncompressed data
+// (bytes_per_second) and the compression ratio as a counter, swept over
+// level, the size of the writes fed to the encoder, and thread count.
+//
+//   ./compression_benchmark --benchmark_filter='Compress/zstd/pg_dump'
+
+#include <benchmark/benchmark.h>
+#include "compression.hpp"
+#include "codec_registry.hpp"
+#include "stream.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace dbbackup;
+
+namespace {
+    constexpr size_t CORPUS_SIZE = 8 * 1048576;
+
+    const char* const WORDS[] = {
+        "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+        "india", "juliet", "kilo", "lima", "mike", "november", "oscar", "papa",
+    };
+
+    std::string randomWord(std::mt19937_64& rng) {
+        return WORDS[rng() % (sizeof(WORDS) / sizeof(WORDS[0]))];
+    }
+
+    std::string timestamp(std::mt19937_64& rng) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "2024-%02d-%02d %02d:%02d:%02d",
+                      static_cast<int>(rng() % 12 + 1), static_cast<int>(rng() % 28 + 1),
+                      static_cast<int>(rng() % 24), static_cast<int>(rng() % 60),
+                      static_cast<int>(rng() % 60));
+        return buffer;
+    }
+
+    /// pg_dump plain format: DDL followed by tab-separated COPY blocks
+    std::string pgDumpCorpus() {
+        std::mt19937_64 rng(1);
+        std::string out;
+        for (int table = 0; out.size() < CORPUS_SIZE; table++) {
+            std::string name = "public.table_" + std::to_string(table);
+            out += "CREATE TABLE " + name + " (\n    id bigint NOT NULL,\n"
+                   "    name character varying(64),\n    amount numeric(12,2),\n"
+                   "    created_at timestamp without time zone\n);\n\n";
+            out += "COPY " + name + " (id, name, amount, created_at) FROM stdin;\n";
+            for (int row = 0; row < 5000 && out.size() < CORPUS_SIZE; row++) {
+                out += std::to_string(row + 1) + "\t" + randomWord(rng) + " " + randomWord(rng) + "\t" +
+                       std::to_string(rng() % 100000) + "." + std::to_string(rng() % 90 + 10) + "\t" +
+                       timestamp(rng) + "\n";
+            }
+            out += "\\.\n\n";
+        }
+        out.resize(CORPUS_SIZE);
+        return out;
+    }
+
+    /// mysqldump with extended INSERTs: long lines of quoted tuples
+    std::string mysqlDumpCorpus() {
+        std::mt19937_64 rng(2);
+        std::string out;
+        for (int table = 0; out.size() < CORPUS_SIZE; table++) {
+            std::string name = "`orders_" + std::to_string(table) + "`";
+            out += "DROP TABLE IF EXISTS " + name + ";\nCREATE TABLE " + name +
+                   " (\n  `id` int NOT NULL AUTO_INCREMENT,\n  `customer` varchar(64) DEFAULT NULL,\n"
+                   "  `total` decimal(10,2) DEFAULT NULL,\n  `placed` datetime DEFAULT NULL,\n"
+                   "  PRIMARY KEY (`id`)\n) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4;\n";
+            for (int statement = 0; statement < 20 && out.size() < CORPUS_SIZE; statement++) {
+                out += "INSERT INTO " + name + " VALUES ";
+                for (int row = 0; row < 500; row++) {
+                    out += (row ? ",(" : "(") + std::to_string(statement * 500 + row + 1) + ",'" +
+                           randomWord(rng) + "_" + randomWord(rng) + "'," + std::to_string(rng() % 10000) +
+                           "." + std::to_string(rng() % 90 + 10) + ",'" + timestamp(rng) + "')";
+                }
+                out += ";\n";
+            }
+        }
+        out.resize(CORPUS_SIZE);
+        return out;
+    }
+
+    /// SQLite database image: 4KB b-tree pages holding records at the end
+    /// of the page, a cell pointer array at the start and zeroed free space
+    std::string sqlitePageCorpus() {
+        constexpr size_t PAGE_SIZE = 4096;
+        std::mt19937_64 rng(3);
+        std::string out;
+        out.reserve(CORPUS_SIZE);
+        while (out.size() < CORPUS_SIZE) {
+            std::string page(PAGE_SIZE, '\0');
+            page[0] = 0x0d;  // Table leaf page
+            size_t contentStart = PAGE_SIZE;
+            size_t cells = 0;
+            size_t fill = PAGE_SIZE * (rng() % 60 + 30) / 100;
+            while (PAGE_SIZE - contentStart < fill) {
+                std::string record = std::to_string(rng() % 1000000) + randomWord(rng) + timestamp(rng);
+                record.insert(record.begin(), static_cast<char>(record.size()));
+                if (contentStart < 8 + 2 * (cells + 1) + record.size()) {
+                    break;
+                }
+                contentStart -= record.size();
+                std::memcpy(&page[contentStart], record.data(), record.size());
+                page[8 + 2 * cells] = static_cast<char>(contentStart >> 8);
+                page[9 + 2 * cells] = static_cast<char>(contentStart & 0xff);
+                cells++;
+            }
+            page[3] = static_cast<char>(cells >> 8);
+            page[4] = static_cast<char>(cells & 0xff);
+            page[5] = static_cast<char>(contentStart >> 8);
+            page[6] = static_cast<char>(contentStart & 0xff);
+            out += page;
+        }
+        out.resize(CORPUS_SIZE);
+        return out;
+    }
+
+    /// Incompressible input, e.g. dumps of already compressed blobs
+    std::string randomCorpus() {
+        std::mt19937_64 rng(4);
+        std::string out(CORPUS_SIZE, '\0');
+        for (size_t i = 0; i + 8 <= out.size(); i += 8) {
+            uint64_t value = rng();
+            std::memcpy(&out[i], &value, 8);
+        }
+        return out;
+    }
+
+    const std::string& corpus(const std::string& name) {
+        static const std::map<std::string, std::function<std::string()>> generators = {
+            {"pg_dump", pgDumpCorpus},
+            {"mysqldump", mysqlDumpCorpus},
+            {"sqlite_pages", sqlitePageCorpus},
+            {"random", randomCorpus},
+        };
+        static std::map<std::string, std::string> cache;
+        auto found = cache.find(name);
+        if (found == cache.end()) {
+            found = cache.emplace(name, generators.at(name)()).first;
+        }
+        return found->second;
+    }
+
+    CodecOptions optionsFor(const benchmark::State& state) {
+        CodecOptions options;
+        options.level = static_cast<CompressionLevel>(state.range(0));
+        options.threads = static_cast<size_t>(state.range(2));
+        return options;
+    }
+
+    std::string encode(const Codec& codec, const std::string& input, const CodecOptions& options,
+                       size_t writeSize) {
+        StringSink sink;
+        auto encoder = codec.createEncoder(sink, options);
+        for (size_t offset = 0; offset < input.size(); offset += writeSize) {
+            encoder->write(input.data() + offset, std::min(writeSize, input.size() - offset));
+        }
+        encoder->finish();
+        return sink.release();
+    }
+
+    // Args: level, write size, threads
+    void compress(benchmark::State& state, const std::string& codecName, const std::string& corpusName) {
+        auto codec = CodecRegistry::getInstance().findByName(codecName);
+        const std::string& input = corpus(corpusName);
+        CodecOptions options = optionsFor(state);
+        size_t writeSize = static_cast<size_t>(state.range(1));
+
+        size_t compressedSize = 0;
+        for (auto _ : state) {
+            compressedSize = encode(*codec, input, options, writeSize).size();
+            benchmark::DoNotOptimize(compressedSize);
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * input.size()));
+        state.counters["ratio"] = static_cast<double>(input.size()) / static_cast<double>(compressedSize);
+    }
+
+    // Args: level, write size, threads. Throughput is of decompressed bytes.
+    void decompress(benchmark::State& state, const std::string& codecName, const std::string& corpusName) {
+        auto codec = CodecRegistry::getInstance().findByName(codecName);
+        const std::string& input = corpus(corpusName);
+        CodecOptions options = optionsFor(state);
+        size_t writeSize = static_cast<size_t>(state.range(1));
+        std::string compressed = encode(*codec, input, options, writeSize);
+
+        for (auto _ : state) {
+            CountingSink sink;
+            auto decoder = codec->createThreadedDecoder(sink, options.threads);
+            for (size_t offset = 0; offset < compressed.size(); offset += writeSize) {
+                decoder->write(compressed.data() + offset, std::min(writeSize, compressed.size() - offset));
+            }
+            decoder->finish();
+            if (sink.bytesWritten() != input.size()) {
+                state.SkipWithError("decoded size differs from the input");
+                break;
+            }
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * input.size()));
+        state.counters["ratio"] = static_cast<double>(input.size()) / static_cast<double>(compressed.size());
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* const corpora[] = {"pg_dump", "mysqldump", "sqlite_pages", "random"};
+    const std::vector<int64_t> levels = {
+        static_cast<int64_t>(CompressionLevel::Low),
+        static_cast<int64_t>(CompressionLevel::Medium),
+        static_cast<int64_t>(CompressionLevel::High),
+    };
+    const std::vector<int64_t> writeSizes = {16384, 1048576};  // gzip CHUNK_SIZE, FileIOOptions default
+    const std::vector<int64_t> threads = {1, 4};
+
+    for (const auto& codecName : CodecRegistry::getInstance().names()) {
+        for (const char* corpusName : corpora) {
+            std::string suffix = "/" + codecName + "/" + corpusName;
+            benchmark::RegisterBenchmark(("Compress" + suffix).c_str(), compress, codecName, corpusName)
+                ->ArgsProduct({levels, writeSizes, threads})
+                ->ArgNames({"level", "write", "threads"})
+                ->Unit(benchmark::kMillisecond)
+                ->UseRealTime();
+            // Decoding speed hardly depends on the level it was encoded at
+            benchmark::RegisterBenchmark(("Decompress" + suffix).c_str(), decompress, codecName, corpusName)
+                ->ArgsProduct({{static_cast<int64_t>(CompressionLevel::Medium)}, writeSizes, threads})
+                ->ArgNames({"level", "write", "threads"})
+                ->Unit(benchmark::kMillisecond)
+                ->UseRealTime();
+        }
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,43 @@
+# FindZSTD.cmake
+
+# Find libzstd
+#
+# This module defines
+# ZSTD_LIBRARY, the name of the library to link against
+# ZSTD_FOUND, if false, do not try to link against libzstd
+# ZSTD_INCLUDE_DIR, where to find zstd.h
+#
+
+find_path(ZSTD_INCLUDE_DIR
+  NAMES zstd.h
+  PATHS
+    /usr/local/include
+    /usr/include
+    /usr/local/opt/zstd/include
+)
+
+find_library(ZSTD_LIBRARY
+  NAMES zstd libzstd
+  PATHS
+    /usr/local/lib
+    /usr/lib
+    /usr/local/opt/zstd/lib
+)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(ZSTD
+    REQUIRED_VARS ZSTD_LIBRARY ZSTD_INCLUDE_DIR
+)
+
+if(ZSTD_FOUND AND NOT TARGET ZSTD::ZSTD)
+    add_library(ZSTD::ZSTD UNKNOWN IMPORTED)
+    set_target_properties(ZSTD::ZSTD PROPERTIES
+        IMPORTED_LOCATION "${ZSTD_LIBRARY}"
+        INTERFACE_INCLUDE_DIRECTORIES "${ZSTD_INCLUDE_DIR}"
+    )
+endif()
+
+mark_as_advanced(
+  ZSTD_INCLUDE_DIR
+  ZSTD_LIBRARY
+)
@@ -9,6 +9,8 @@ class DatabaseBackup < Formula
   depends_on "spdlog"
   depends_on "nlohmann-json"
   depends_on "cli11"
+  depends_on "xz"
+  depends_on "zstd"
   depends_on "mysql-connector-c++" => :optional
   depends_on "libpq" => :optional
   depends_on "mongo-cxx-driver" => :optional
@@ -3,6 +3,7 @@
 #include "config.hpp"
 #include "db_connection.hpp"
 #include "compression.hpp"
+#include "size_estimator.hpp"
 #include <memory>
 #include <string>
 
@@ -14,9 +15,16 @@ public:
     bool backup(const std::string& backupType);
     bool restore(const std::string& backupPath);
 
+    /// Predicted size and duration of the next backup with the configured
+    /// compression, learned from the catalog. Never throws; the estimate is
+    /// empty if it cannot be made.
+    dbbackup::SizeEstimate estimateBackup() const;
+
 protected:
     virtual std::unique_ptr<IDBConnection> createConnection();
 
 private:
+    dbbackup::SizeEstimate estimateBackup(const dbbackup::Compressor* compressor) const;
+
     dbbackup::Config m_config;
 }; 
\ No newline at end of file
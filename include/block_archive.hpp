@@ -0,0 +1,61 @@
+#pragma once
+
+#include "stream.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dbbackup {
+
+class Codec;
+
+/// Location of one block of a block container
+struct BlockArchiveEntry {
+    uint64_t fileOffset = 0;   // Offset of the block header in the archive
+    uint64_t rawOffset = 0;    // Offset of the block's first byte in the original stream
+    uint32_t rawSize = 0;
+    uint32_t storedSize = 0;
+};
+
+/// Random access to a block container (blockFramed archives) through its
+/// trailing index: any byte range of the original stream is decoded by
+/// reading only the blocks that overlap it.
+class BlockArchiveReader {
+public:
+    /// Opens the archive and loads its index. Throws CompressionError if the
+    /// file is not a block container or its index is damaged. dictionary is
+    /// the preset dictionary the blocks were compressed with, if any.
+    explicit BlockArchiveReader(const std::string& path,
+                                std::shared_ptr<const std::string> dictionary = nullptr);
+
+    /// Size of the original, uncompressed stream
+    uint64_t size() const { return rawSize; }
+
+    const std::vector<BlockArchiveEntry>& blocks() const { return entries; }
+
+    /// Name of the codec the blocks are compressed with
+    std::string codecName() const;
+
+    /// Decodes and verifies one block
+    std::string readBlock(size_t index) const;
+
+    /// Decodes length bytes of the original stream starting at offset into
+    /// sink, without finishing it. The range is clamped to size().
+    /// Returns the number of bytes written.
+    uint64_t readRange(uint64_t offset, uint64_t length, OutputSink& sink) const;
+
+private:
+    std::string decodeBlockAt(std::ifstream& file, size_t index) const;
+
+    std::string path;
+    std::shared_ptr<const Codec> inner;
+    std::shared_ptr<const std::string> dictionary;
+    uint32_t blockSize = 0;
+    uint64_t rawSize = 0;
+    std::vector<BlockArchiveEntry> entries;
+};
+
+} // namespace dbbackup
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "stream.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct evp_md_ctx_st;
+
+namespace dbbackup {
+namespace checksum {
+
+/// CRC-32 as used by gzip and zlib, same results as zlib's crc32(): pass the
+/// previous result as crc to continue a running checksum. Uses PCLMULQDQ
+/// folding on x86-64 CPUs that have it and the ARMv8 CRC instructions where
+/// the compiler targets them, zlib otherwise.
+uint32_t crc32(const void* data, size_t size, uint32_t crc = 0);
+
+/// True if crc32 runs on a hardware-accelerated path on this CPU
+bool hardwareCrc32();
+
+/// XXH64, a fast non-cryptographic hash for integrity checks where
+/// SHA-256 would dominate the cost. Matches the reference implementation.
+uint64_t xxh64(const void* data, size_t size, uint64_t seed = 0);
+
+/// Streaming XXH64: update() any number of times, then digest()
+class Xxh64 {
+public:
+    explicit Xxh64(uint64_t seed = 0);
+
+    void update(const void* data, size_t size);
+    uint64_t digest() const;
+
+private:
+    uint64_t acc[4];
+    uint64_t seed;
+    uint64_t totalSize = 0;
+    unsigned char pending[32];
+    size_t pendingSize = 0;
+};
+
+/// Lowercase hex rendering of a 64-bit digest (16 characters)
+std::string toHex(uint64_t value);
+
+/// SHA-256 of a buffer, lowercase hex
+std::string sha256(const void* data, size_t size);
+
+/// Size and checksums of an archive as recorded in backup metadata
+struct Digest {
+    uint64_t size = 0;
+    std::string sha256;  // Hex
+    std::string xxh64;   // Hex
+};
+
+/// Passes a stream through unchanged while computing its Digest, so an
+/// archive is checksummed as it is written instead of read back afterwards
+class DigestSink : public OutputSink {
+public:
+    explicit DigestSink(OutputSink& downstream);
+    ~DigestSink() override;
+
+    DigestSink(const DigestSink&) = delete;
+    DigestSink& operator=(const DigestSink&) = delete;
+
+    void write(const char* data, size_t size) override;
+
+    /// Finalizes the digest, then finishes downstream
+    void finish() override;
+
+    /// Valid after finish()
+    const Digest& digest() const { return result; }
+
+private:
+    OutputSink& downstream;
+    evp_md_ctx_st* sha256 = nullptr;
+    Xxh64 fast;
+    Digest result;
+    bool finished = false;
+};
+
+/// Digest of a file in one mapped pass. Throws StorageError if it cannot
+/// be read.
+Digest digestFile(const std::string& path);
+
+} // namespace checksum
+} // namespace dbbackup
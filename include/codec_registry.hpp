@@ -0,0 +1,53 @@
+#pragma once
+
+#include "compression.hpp"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace dbbackup {
+
+/// Process-wide table of the available compression codecs. The built-in
+/// codecs are registered on first use; additional ones can be added with
+/// registerCodec. Lookups are by config name, file extension or magic bytes.
+class CodecRegistry {
+public:
+    /// Number of leading bytes read from a file when detecting its format
+    static constexpr size_t HEADER_PROBE_SIZE = 16;
+
+    static CodecRegistry& getInstance();
+
+    /// Add a codec, replacing any registered codec with the same name
+    void registerCodec(std::shared_ptr<const Codec> codec);
+
+    /// Codec for a config format name, nullptr if unknown
+    std::shared_ptr<const Codec> findByName(const std::string& name) const;
+
+    /// Codec whose extension ends the given path, nullptr if none
+    std::shared_ptr<const Codec> findByExtension(const std::string& path) const;
+
+    /// Codec whose magic number starts the given bytes, nullptr if none
+    std::shared_ptr<const Codec> detect(const unsigned char* header, size_t size) const;
+
+    /// Codec for the file's contents, nullptr if the file is not compressed
+    /// with a known format. A codec name recorded in backup metadata takes
+    /// precedence when it is registered. Throws CompressionError if the file
+    /// can't be read.
+    std::shared_ptr<const Codec> detectFile(const std::string& path,
+                                            const std::string& recordedName = "") const;
+
+    /// Names of all registered codecs in registration order
+    std::vector<std::string> names() const;
+
+private:
+    CodecRegistry();
+
+    CodecRegistry(const CodecRegistry&) = delete;
+    CodecRegistry& operator=(const CodecRegistry&) = delete;
+
+    mutable std::mutex mutex;
+    std::vector<std::shared_ptr<const Codec>> codecs;
+};
+
+} // namespace dbbackup
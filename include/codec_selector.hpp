@@ -0,0 +1,73 @@
+#pragma once
+
+#include "compression.hpp"
+#include "config.hpp"
+#include "stream.hpp"
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace dbbackup {
+
+/// Outcome of trying one codec and level on a sample
+struct CodecTrial {
+    std::shared_ptr<const Codec> codec;
+    CompressionLevel level = CompressionLevel::Medium;
+    double ratio = 1.0;            // Compressed size / input size
+    double throughputMBps = 0.0;   // Input bytes compressed per second
+};
+
+/// Picks a codec and level for format "auto" by compressing a sample of the
+/// data with every candidate. Among the candidates at least as fast as the
+/// configured target throughput the best ratio wins; if none is fast enough
+/// the fastest one is used.
+class CodecSelector {
+public:
+    explicit CodecSelector(const CompressionConfig& config);
+
+    /// Evaluate the candidates on data (typically the start of a dump)
+    CodecTrial select(const char* data, size_t size) const;
+
+    /// Every candidate's result on data, in candidate order
+    std::vector<CodecTrial> evaluate(const char* data, size_t size) const;
+
+    /// The fastest candidate, for data that cannot be sampled before it
+    /// is compressed
+    std::shared_ptr<const Codec> fastest() const { return candidates.front(); }
+
+private:
+    CodecTrial runTrial(std::shared_ptr<const Codec> codec, CompressionLevel level,
+                        const std::string& sample) const;
+
+    CompressionConfig config;
+    std::vector<std::shared_ptr<const Codec>> candidates;
+};
+
+/// Encoder for format "auto": buffers the first sampleSizeMB of the stream,
+/// selects a codec from it, then replays the buffer into that codec's encoder
+/// and streams the rest straight through. The choice is available once the
+/// buffer fills or the stream is finished; with blockFramed set its codec is
+/// the chosen one wrapped in a block container.
+class AutoSelectingEncoder : public OutputSink {
+public:
+    AutoSelectingEncoder(OutputSink& downstream, const CompressionConfig& config);
+
+    void write(const char* data, size_t size) override;
+    void finish() override;
+
+    /// The selected codec and level, empty until selection has run
+    const std::optional<CodecTrial>& choice() const { return selected; }
+
+private:
+    void selectAndReplay();
+
+    OutputSink& downstream;
+    CompressionConfig config;
+    size_t sampleSize;
+    std::string buffer;
+    std::optional<CodecTrial> selected;
+    std::unique_ptr<OutputSink> encoder;
+};
+
+} // namespace dbbackup
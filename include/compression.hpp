@@ -2,8 +2,11 @@
 
 #include "config.hpp"
 #include "error/DatabaseBackupError.hpp"
+#include "stream.hpp"
 #include <string>
 #include <cstddef>
+#include <memory>
+#include <vector>
 
 namespace dbbackup {
 
@@ -13,16 +16,103 @@ enum class CompressionLevel {
     High
 };
 
-enum class CompressionFormat {
-    Gzip,
-    Bzip2,
-    Xz
+/// Config spelling of a compression level ("low", "medium", "high")
+std::string levelToString(CompressionLevel level);
+
+/// Encoder settings shared by all codecs, derived from CompressionConfig
+struct CodecOptions {
+    CompressionLevel level = CompressionLevel::Medium;
+    size_t threads = 1;         // Worker threads, codecs without MT support ignore it
+    bool longDistance = false;  // Long-range matching where the codec supports it
+    std::shared_ptr<const std::string> dictionary;  // Preset dictionary, null for none
+};
+
+/// A compression format. Encoders and decoders are streaming sinks: bytes
+/// written to them are transformed and forwarded to the downstream sink, and
+/// finishing them flushes the format trailer and finishes downstream.
+class Codec {
+public:
+    virtual ~Codec() = default;
+
+    /// Format name as used in the config file (e.g. "gzip")
+    virtual std::string name() const = 0;
+
+    /// File extension including the leading dot (e.g. ".gz")
+    virtual std::string extension() const = 0;
+
+    /// True if the first bytes of a file carry this format's magic number
+    virtual bool matchesHeader(const unsigned char* header, size_t size) const = 0;
+
+    virtual std::unique_ptr<OutputSink> createEncoder(OutputSink& downstream,
+                                                      const CodecOptions& options) const = 0;
+    virtual std::unique_ptr<OutputSink> createDecoder(OutputSink& downstream) const = 0;
+
+    /// Decoder allowed to use up to threads workers. Formats that can only be
+    /// decoded sequentially return the plain decoder.
+    virtual std::unique_ptr<OutputSink> createThreadedDecoder(OutputSink& downstream,
+                                                              size_t threads) const {
+        (void)threads;
+        return createDecoder(downstream);
+    }
+
+    /// True if encoders honour CodecOptions::dictionary
+    virtual bool supportsDictionary() const { return false; }
+
+    /// True if the blocks of a block container (see BlockFramedCodec) may be
+    /// primed with a dictionary. The container has its own magic number, so
+    /// a stream no other tool can decode is acceptable inside it where it
+    /// would not be as a standalone file.
+    virtual bool supportsBlockDictionary() const { return supportsDictionary(); }
+
+    /// Decoder for data encoded with the given preset dictionary, threads as
+    /// for createThreadedDecoder. Throws CompressionError by default.
+    virtual std::unique_ptr<OutputSink> createDictionaryDecoder(OutputSink& downstream,
+                                                                const std::string& dictionary,
+                                                                size_t threads) const;
+
+    /// Builds a preset dictionary of at most maxSize bytes from samples of
+    /// typical input. The default is a raw content dictionary of the line
+    /// prefixes the samples share (SQL preambles, CREATE TABLE and INSERT
+    /// heads), most common last where matches are cheapest.
+    virtual std::string trainDictionary(const std::vector<std::string>& samples, size_t maxSize) const;
+};
+
+/// Passes a stream through unchanged while keeping fixed-size pieces of it,
+/// evenly spread over the whole stream and at most budget bytes in total, as
+/// dictionary training samples
+class DictionarySampler : public OutputSink {
+public:
+    static constexpr size_t DEFAULT_PIECE_SIZE = 4096;
+
+    DictionarySampler(OutputSink& downstream, size_t budget, size_t pieceSize = DEFAULT_PIECE_SIZE);
+
+    void write(const char* data, size_t size) override;
+    void finish() override;
+
+    const std::vector<std::string>& samples() const { return kept; }
+
+private:
+    void closePiece();
+
+    OutputSink& downstream;
+    size_t budget;
+    size_t pieceSize;
+    std::string piece;
+    std::vector<std::string> kept;
+    size_t keptBytes = 0;
+    size_t pieceIndex = 0;
+    size_t stride = 1;  // Every stride-th piece is kept, doubled when over budget
+    bool finished = false;
 };
 
 class Compressor {
 public:
     explicit Compressor(const CompressionConfig& config);
 
+    /// Use an explicit codec (e.g. one detected from a file) with the
+    /// level and thread settings from config
+    Compressor(std::shared_ptr<const Codec> codec, const CompressionConfig& config);
+
     /// Compresses the file at inputPath, writes to outputPath.
     /// Returns true on success.
     bool compressFile(const std::string& inputPath, const std::string& outputPath) const;
@@ -31,26 +121,45 @@ public:
     /// Returns true on success.
     bool decompressFile(const std::string& inputPath, const std::string& outputPath) const;
 
-    /// Get the estimated compressed size for a given input size
+    /// Creates a streaming encoder: bytes written to it are compressed and
+    /// forwarded to downstream. Finishing the encoder also finishes downstream.
+    std::unique_ptr<OutputSink> createEncoder(OutputSink& downstream) const;
+
+    /// Creates a streaming decoder: compressed bytes written to it are
+    /// decompressed and forwarded to downstream. Block containers are decoded
+    /// with the configured number of decode threads.
+    std::unique_ptr<OutputSink> createDecoder(OutputSink& downstream) const;
+
+    /// Get the estimated compressed size for a given input size. A
+    /// conservative default; SizeEstimator learns the real ratio from the
+    /// catalog and uses this only without history.
     size_t estimateCompressedSize(size_t inputSize) const;
 
+    /// Buffering used by compressFile and decompressFile
+    const FileIOOptions& getIOOptions() const { return io; }
+
     /// Get the file extension for the current compression format
     std::string getFileExtension() const;
 
+    const Codec& getCodec() const { return *codec; }
+
+    /// Prime encoders and decoders with a preset dictionary (null clears it).
+    /// Throws ConfigurationError if the codec does not support dictionaries.
+    void setDictionary(std::shared_ptr<const std::string> dictionary);
+
+    /// Trains a dictionary of up to dictionarySizeKB for this codec
+    std::string trainDictionary(const std::vector<std::string>& samples) const;
+
 private:
-    CompressionFormat format;
     CompressionLevel level;
+    CodecOptions options;
+    size_t decodeThreads;
+    FileIOOptions io;
+    size_t dictionarySize;
+    std::shared_ptr<const Codec> codec;
     
-    // Helper functions for different compression formats
-    bool compressGzip(const std::string& inputPath, const std::string& outputPath) const;
-    bool decompressGzip(const std::string& inputPath, const std::string& outputPath) const;
-    
-    // Convert string format to enum
-    static CompressionFormat stringToFormat(const std::string& format);
+    static std::shared_ptr<const Codec> lookupCodec(const std::string& format);
     static CompressionLevel stringToLevel(const std::string& level);
-    
-    // Get compression level for zlib based on CompressionLevel
-    int getZlibLevel() const;
 };
 
 } // namespace dbbackup 
\ No newline at end of file
@@ -26,10 +26,33 @@ struct DatabaseConfig {
 // Forward declare BackupConfig
 struct BackupConfig;
 
+struct UploadConfig {
+    int partSizeMB = 64;            // Bytes per multipart upload part, at least 5 as in S3
+    int concurrency = 4;            // Parts uploaded at once
+    double bandwidthLimitMBps = 0;  // Total upload rate cap, 0 = unlimited
+};
+
+struct TieringConfig {
+    int hotBackups = 0;             // Newest backups kept in localPath, 0 = no tiering
+    std::string archivePath;        // Cheaper storage older backups are moved to
+};
+
+struct ScrubConfig {
+    bool enabled = false;           // Re-verify stored backups in the background while the scheduler runs
+    int intervalDays = 30;          // Verify each backup again after this long
+    double bandwidthLimitMBps = 20; // Read rate cap, 0 = unlimited
+    int cpuPercent = 25;            // Share of one core hashing and decoding may use
+    bool decompress = false;        // Also decode archives, not only compare checksums
+};
+
 struct StorageConfig {
     std::string localPath;
-    std::string cloudProvider;
+    std::string cloudProvider;      // Off-site copy target: "filesystem", "local" or empty = none
     std::string cloudPath;
+    UploadConfig upload;
+    TieringConfig tiering;
+    ScrubConfig scrub;
+    bool deduplicate = false;  // Store dumps as content-defined chunks shared between backups
     BackupConfig* backup = nullptr;  // Pointer to backup config for retention settings
 };
 
@@ -42,13 +65,28 @@ struct LoggingConfig {
 
 struct CompressionConfig {
     bool enabled = false;
-    std::string format = "gzip";  // gzip, bzip2, xz
+    std::string format = "gzip";  // gzip, bzip2, xz, zstd, auto
     std::string level = "medium"; // low, medium, high
+    int threads = 1;              // Compression worker threads, 0 = all cores
+    int decodeThreads = 0;        // Decoding worker threads (restore, verify), 0 = all cores
+    bool longDistance = false;    // zstd long distance matching (128MB window)
+    int sampleSizeMB = 16;        // auto: leading dump bytes sampled before choosing
+    double targetThroughputMBps = 50.0;  // auto: minimum acceptable compression speed
+    bool blockFramed = false;     // Independently compressed blocks, incompressible ones stored raw
+    int blockSizeKB = 1024;       // blockFramed: uncompressed bytes per block
+    double minBlockSavings = 0.05; // blockFramed: store a block raw unless compression saves this fraction
+    bool useDictionary = false;   // gzip/zstd: prime with a dictionary trained on the previous backup
+    int dictionarySizeKB = 112;   // useDictionary: maximum trained dictionary size
+    int bufferSizeKB = 1024;      // File read/write buffer, rounded up to whole pages
+    bool directIO = false;        // Write archives with O_DIRECT, bypassing the page cache
 };
 
 struct RetentionConfig {
-    int days = 30;           // Number of days to keep backups
-    int maxBackups = 10;     // Maximum number of backups to keep
+    int days = 30;           // Number of days to keep backups, 0 = no age limit
+    int maxBackups = 10;     // Maximum number of backups to keep, 0 = no limit
+    int keepDaily = 0;       // Always keep the newest backup of each of the last N days
+    int keepWeekly = 0;      // ... of each of the last N weeks
+    int keepMonthly = 0;     // ... of each of the last N months
 };
 
 struct ScheduleConfig {
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+namespace dbbackup {
+
+/// Destination for a stream of bytes (file, compressor, ...).
+/// Implementations throw on failure.
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+
+    /// Append size bytes to the stream
+    virtual void write(const char* data, size_t size) = 0;
+
+    /// Flush buffered data and finalize the stream. Sinks that wrap another
+    /// sink finish it as well, so finishing the head of a chain finishes all of it.
+    virtual void finish() {}
+};
+
+/// Source of a stream of bytes
+class InputSource {
+public:
+    virtual ~InputSource() = default;
+
+    /// Read up to size bytes into data
+    /// Returns the number of bytes read, 0 at end of stream
+    virtual size_t read(char* data, size_t size) = 0;
+
+    /// True if readView can lend the source's own memory
+    virtual bool supportsViews() const { return false; }
+
+    /// Zero-copy read: points data at up to size bytes held by the source,
+    /// valid until the next call, and advances past them. Returns the number
+    /// of bytes, 0 at end of stream. Only valid if supportsViews().
+    virtual size_t readView(const char*& data, size_t size) {
+        (void)data;
+        (void)size;
+        return 0;
+    }
+};
+
+/// Counts the bytes written to it, discarding them or passing them on
+class CountingSink : public OutputSink {
+public:
+    CountingSink() = default;
+    explicit CountingSink(OutputSink& downstream) : downstream(&downstream) {}
+
+    void write(const char* data, size_t size) override {
+        if (downstream) {
+            downstream->write(data, size);
+        }
+        count += size;
+    }
+
+    void finish() override {
+        if (downstream) {
+            downstream->finish();
+        }
+    }
+
+    uint64_t bytesWritten() const { return count; }
+
+private:
+    OutputSink* downstream = nullptr;
+    uint64_t count = 0;
+};
+
+/// Collects the stream in memory
+class StringSink : public OutputSink {
+public:
+    void write(const char* data, size_t size) override { buffer.append(data, size); }
+
+    const std::string& str() const { return buffer; }
+
+    /// Take the collected bytes, leaving the sink empty
+    std::string release() { return std::move(buffer); }
+
+private:
+    std::string buffer;
+};
+
+/// Reads a stream from memory
+class StringSource : public InputSource {
+public:
+    explicit StringSource(std::string data) : buffer(std::move(data)) {}
+
+    size_t read(char* data, size_t size) override {
+        const char* view;
+        size_t n = readView(view, size);
+        std::copy(view, view + n, data);
+        return n;
+    }
+
+    bool supportsViews() const override { return true; }
+
+    size_t readView(const char*& data, size_t size) override {
+        size_t n = std::min(size, buffer.size() - offset);
+        data = buffer.data() + offset;
+        offset += n;
+        return n;
+    }
+
+private:
+    std::string buffer;
+    size_t offset = 0;
+};
+
+/// Writes the stream to a primary sink and a secondary one, e.g. an archive
+/// file and its upload. A failing secondary is dropped and its error kept
+/// rather than failing the primary.
+class TeeSink : public OutputSink {
+public:
+    TeeSink(OutputSink& primary, OutputSink& secondary) : primary(primary), secondary(&secondary) {}
+
+    void write(const char* data, size_t size) override;
+    void finish() override;
+
+    /// Why the secondary was dropped, empty if it completed
+    const std::string& secondaryError() const { return error; }
+
+private:
+    OutputSink& primary;
+    OutputSink* secondary;
+    std::string error;
+};
+
+/// Tuning for FileSink and FileSource
+struct FileIOOptions {
+    static constexpr size_t DEFAULT_BUFFER_SIZE = 1048576;  // 1MB
+
+    size_t bufferSize = DEFAULT_BUFFER_SIZE;  // Rounded up to whole pages
+    bool directIO = false;   // FileSink: bypass the page cache (O_DIRECT) where supported
+    bool mapInput = true;    // FileSource: mmap regular files instead of reading them
+    bool sync = false;       // FileSink: fdatasync once in finish(), so the data is durable
+    bool overwrite = false;  // FileSink: keep the file's (preallocated) blocks, writing over them,
+                             // and cut it to the bytes written in finish()
+};
+
+/// Writes the stream to a file, truncating it on open. Writes are gathered
+/// in a page-aligned buffer and issued with pwrite, so large writes cost one
+/// system call and no iostream copy. With directIO the page cache is
+/// bypassed; filesystems that refuse it fall back to buffered writes.
+/// With sync the file is flushed to disk once, at finish(). With overwrite
+/// an existing file's blocks are reused, e.g. those a SpaceReservation
+/// preallocated, and the file is cut to the bytes written at finish().
+class FileSink : public OutputSink {
+public:
+    explicit FileSink(const std::string& path, const FileIOOptions& options = FileIOOptions());
+    ~FileSink() override;
+
+    FileSink(const FileSink&) = delete;
+    FileSink& operator=(const FileSink&) = delete;
+
+    /// False if the file could not be opened
+    explicit operator bool() const { return fd >= 0; }
+
+    void write(const char* data, size_t size) override;
+    void finish() override;
+
+private:
+    void flushBuffer(bool final);
+    void writeAt(const char* data, size_t size);
+
+    std::string path;
+    int fd = -1;
+    bool direct = false;
+    bool sync = false;
+    bool overwrite = false;
+    char* buffer = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    uint64_t offset = 0;
+};
+
+/// Reads the stream from a file. Regular files are memory mapped when
+/// possible, which makes readView zero-copy; otherwise reads use pread with
+/// a sequential access hint.
+class FileSource : public InputSource {
+public:
+    explicit FileSource(const std::string& path, const FileIOOptions& options = FileIOOptions());
+    ~FileSource() override;
+
+    FileSource(const FileSource&) = delete;
+    FileSource& operator=(const FileSource&) = delete;
+
+    /// False if the file could not be opened
+    explicit operator bool() const { return fd >= 0; }
+
+    size_t read(char* data, size_t size) override;
+
+    bool supportsViews() const override { return mapped != nullptr; }
+    size_t readView(const char*& data, size_t size) override;
+
+private:
+    std::string path;
+    int fd = -1;
+    const char* mapped = nullptr;
+    uint64_t mappedSize = 0;
+    uint64_t offset = 0;
+};
+
+/// Copies everything from source into sink without finishing the sink, in
+/// chunks of bufferSize. Sources that support views are passed through
+/// without an intermediate copy. Returns the number of bytes copied
+uint64_t copyStream(InputSource& source, OutputSink& sink,
+                    size_t bufferSize = FileIOOptions::DEFAULT_BUFFER_SIZE);
+
+} // namespace dbbackup
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace dbbackup {
+
+/// Fixed-size pool of worker threads running queued tasks in FIFO order.
+/// Exceptions thrown by a task are delivered through its future.
+class ThreadPool {
+public:
+    /// Start the given number of workers (at least one)
+    explicit ThreadPool(size_t threadCount);
+
+    /// Runs every task still queued, then joins the workers
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /// Queue a task, returns a future for its result
+    template <typename Task>
+    auto submit(Task&& task) -> std::future<decltype(task())> {
+        using Result = decltype(task());
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<Task>(task));
+        std::future<Result> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.emplace([packaged]() { (*packaged)(); });
+        }
+        available.notify_one();
+        return result;
+    }
+
+    size_t size() const { return workers.size(); }
+
+    /// Resolve a configured thread count: 0 means one per hardware thread
+    static size_t resolveThreadCount(int configured);
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable available;
+    bool stopping = false;
+};
+
+} // namespace dbbackup
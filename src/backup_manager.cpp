@@ -1,11 +1,22 @@
 #include "backup_manager.hpp"
 #include "db_connection.hpp"
 #include "compression.hpp"
+#include "codec_registry.hpp"
+#include "codec_selector.hpp"
+#include "codecs/block_framed_codec.hpp"
+#include "checksum.hpp"
+#include "chunk_store.hpp"
+#include "file_utils.hpp"
+#include "multipart_upload.hpp"
+#include "space_reservation.hpp"
 #include "storage.hpp"
+#include "storage_backend.hpp"
+#include "tiered_storage.hpp"
 #include "logging.hpp"
 #include "notifications.hpp"
 #include "error/ErrorUtils.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <chrono>
 #include <ctime>
@@ -33,11 +44,53 @@ BackupManager::BackupManager(const dbbackup::Config& cfg)
 
 BackupManager::~BackupManager() = default;
 
+dbbackup::SizeEstimate BackupManager::estimateBackup() const {
+    const dbbackup::CompressionConfig& compression = m_config.backup.compression;
+    try {
+        std::unique_ptr<dbbackup::Compressor> compressor;
+        if (compression.enabled && compression.format != "auto") {
+            compressor = std::make_unique<dbbackup::Compressor>(compression);
+        }
+        return estimateBackup(compressor.get());
+    } catch (const std::exception& e) {
+        getLogger()->warn("Failed to estimate backup size: {}", e.what());
+        return dbbackup::SizeEstimate();
+    }
+}
+
+dbbackup::SizeEstimate BackupManager::estimateBackup(const dbbackup::Compressor* compressor) const {
+    const dbbackup::CompressionConfig& compression = m_config.backup.compression;
+    std::string codec = compressor ? compressor->getCodec().name()
+                      : compression.enabled && compression.format == "auto" ? "auto" : "";
+    try {
+        // History from every tier the backups may have moved to
+        dbbackup::SizeEstimator estimator(createStorageBackend(m_config.storage)->list(),
+            dbbackup::SizeEstimator::databaseKey(m_config.database.type, m_config.database.database),
+            codec, compression.level);
+        // Without history an automatically chosen codec gives no hint at all
+        return estimator.estimate(0, [compressor](uint64_t dump) -> uint64_t {
+            return compressor ? compressor->estimateCompressedSize(dump) : 0;
+        });
+    } catch (const std::exception& e) {
+        getLogger()->warn("Failed to estimate backup size: {}", e.what());
+        return dbbackup::SizeEstimate();
+    }
+}
+
 bool BackupManager::backup(const std::string& backupType) {
-    // Create compressor outside the macro if compression is enabled
+    // Create compressor outside the macro if compression is enabled. With
+    // format "auto" the codec is chosen from the dump itself while streaming;
+    // chunks are compressed one by one as they are cut, before any sample
+    // could be taken, so deduplicated storage uses the fastest candidate.
+    const dbbackup::CompressionConfig& compression = m_config.backup.compression;
+    bool autoCompression = compression.enabled && compression.format == "auto";
     std::unique_ptr<dbbackup::Compressor> compressor;
-    if (m_config.backup.compression.enabled) {
-        compressor = std::make_unique<dbbackup::Compressor>(m_config.backup.compression);
+    if (compression.enabled && !autoCompression) {
+        compressor = std::make_unique<dbbackup::Compressor>(compression);
+    } else if (autoCompression && m_config.storage.deduplicate) {
+        compressor = std::make_unique<dbbackup::Compressor>(
+            dbbackup::BlockFramedCodec::wrap(dbbackup::CodecSelector(compression).fastest(), compression),
+            compression);
     }
 
     DB_TRY_CATCH_LOG("BackupManager", {
@@ -74,59 +127,262 @@ bool BackupManager::backup(const std::string& backupType) {
         strftime(timeBuf, sizeof(timeBuf), "%Y%m%d_%H%M%S", &tm);
         std::string backupFileName = "backup_" + std::string(timeBuf) + "_" + backupType;
         
-        // Create temporary file path with unique name
+        // Scratch path for backends that cannot stream their dump
         std::string tempPath = m_config.storage.localPath + "/.tmp_" + backupFileName + ".dump";
         
-        // Final backup path
-        std::string finalPath = m_config.storage.localPath + "/" + backupFileName + 
-                               (m_config.backup.compression.enabled ? ".dump.gz" : ".dump");
-
-        // Remove any existing temporary files
+        // Final backup path. The archive is written under a partial name,
+        // synced and renamed at the end, so a crash never leaves a truncated
+        // archive under a backup's name; with auto compression the extension
+        // is only known by then anyway.
+        // A deduplicated backup is a chunk manifest; its chunks carry the
+        // compression, so the catalog records it as uncompressed.
+        bool deduplicate = m_config.storage.deduplicate;
+        std::string finalPath = m_config.storage.localPath + "/" + backupFileName + ".dump" +
+                               (deduplicate ? dbbackup::ChunkStore::MANIFEST_EXTENSION
+                                : compressor ? compressor->getFileExtension() : "");
+        std::string archivePath = deduplicate ? finalPath
+            : m_config.storage.localPath + "/.tmp_" + backupFileName + ".partial";
+        std::string codecName = compressor && !deduplicate ? compressor->getCodec().name() : "";
+        std::string codecLevel = compression.level;
+
+        // Prime the compressor with the dictionary trained on the previous
+        // backup; samples of this dump train the one the next backup uses
+        LocalStorage storage(m_config.storage);
+        bool useDictionary = compressor && !deduplicate && compression.useDictionary &&
+                             compressor->getCodec().supportsDictionary();
+        if (compressor && compression.useDictionary && !compressor->getCodec().supportsDictionary()) {
+            std::string format = compressor->getCodec().name();
+            logger->warn("Compression format {} does not use dictionaries{}", format,
+                         format == "gzip" ? " outside blockFramed archives" : "");
+        }
+        std::string dictionaryId = useDictionary ? storage.currentDictionary(codecName) : "";
+        if (!dictionaryId.empty()) {
+            compressor->setDictionary(std::make_shared<const std::string>(storage.loadDictionary(dictionaryId)));
+        }
+        std::unique_ptr<dbbackup::DictionarySampler> sampler;
+        BackupMetadata written;
+
+        // Off-site copy. A plain archive is uploaded in parts as it is
+        // written; one whose name is only known at the end is uploaded
+        // once complete.
+        auto remote = dbbackup::createObjectStore(m_config.storage);
+        auto uploadOptions = dbbackup::UploadOptions::fromConfig(m_config.storage.upload);
+        std::string uploadError;
+        // Config validation rejects this; a run must not pass without its
+        // off-site copy
+        DB_CHECK(!remote || !deduplicate, ConfigurationError,
+                "Deduplicated backups cannot be uploaded to " + m_config.storage.cloudProvider);
+
+        // Remove any existing temporary files, and partial archives a
+        // crashed run left behind
         if (std::filesystem::exists(tempPath)) {
             std::filesystem::remove(tempPath);
         }
+        try {
+            size_t stale = storage.removeStaleTemporaries();
+            if (stale > 0) {
+                logger->info("Removed {} partial files left by interrupted backups", stale);
+            }
+        } catch (const std::exception& e) {
+            logger->warn("Failed to remove stale temporary files: {}", e.what());
+        }
 
-        // Perform backup to temporary file
-        if (!conn->createBackup(tempPath)) {
-            DB_THROW(BackupError, "Failed to create backup at: " + tempPath);
+        // What history says this backup will take, sizing the space
+        // reservation below
+        dbbackup::SizeEstimate estimate = estimateBackup(compressor.get());
+        if (estimate.samples > 0) {
+            logger->info("Expecting a {} byte archive (at most {}) from a {} byte dump in {:.0f}s (at most {:.0f}s)",
+                         estimate.outputBytes, estimate.outputUpperBound, estimate.inputBytes,
+                         estimate.seconds, estimate.secondsUpperBound);
         }
+        written.database = dbbackup::SizeEstimator::databaseKey(m_config.database.type,
+                                                                 m_config.database.database);
+        auto started = std::chrono::steady_clock::now();
 
-        bool success = false;
+        // Stream the dump straight through the compressor into the archive,
+        // or into the chunk store
         try {
-            if (compressor) {
-                // Try to compress directly to final location
-                success = compressor->compressFile(tempPath, finalPath);
-                if (!success) {
-                    DB_THROW(CompressionError, "Failed to compress backup file");
+            if (deduplicate) {
+                // Only chunks not already in the store are compressed and written
+                dbbackup::ChunkStore chunks(m_config.storage.localPath);
+                auto writer = chunks.createWriter(archivePath, compressor.get());
+                dbbackup::CountingSink sink(*writer);
+                if (!conn->streamBackup(sink, tempPath)) {
+                    DB_THROW(BackupError, "Failed to create backup at: " + archivePath);
                 }
+                sink.finish();
+                const auto& stats = writer->stats();
+                logger->info("Stored {} new of {} chunks, {} bytes for a {} byte dump",
+                             stats.newChunks, stats.chunks, stats.storedBytes, stats.bytes);
+
+                auto manifest = dbbackup::checksum::digestFile(archivePath);
+                written.size = manifest.size;
+                written.checksum = manifest.sha256;
+                written.fastChecksum = manifest.xxh64;
+                written.originalSize = sink.bytesWritten();
+
+                // One flush for every chunk and the manifest, before the
+                // catalog lists the backup
+                dbbackup::syncFilesystem(m_config.storage.localPath);
             } else {
-                // Move uncompressed file to final location
-                std::filesystem::rename(tempPath, finalPath);
-                success = true;
+                dbbackup::FileIOOptions io;
+                io.bufferSize = static_cast<size_t>(compression.bufferSizeKB) * 1024;
+                io.directIO = compression.directIO;
+                io.sync = true;
+
+                // Take the space the archive should need up front, so a full
+                // volume fails the backup now rather than halfway through
+                // the dump, and the archive is allocated in one piece
+                dbbackup::SpaceReservation reservation(archivePath, estimate.outputUpperBound);
+                if (reservation.size() > 0) {
+                    logger->debug("Reserved {} bytes for {}{}", reservation.size(), archivePath,
+                                  reservation.preallocated() ? " (preallocated)" : "");
+                }
+                io.overwrite = true;
+                dbbackup::FileSink file(archivePath, io);
+                if (!file) {
+                    DB_THROW(StorageError, "Failed to create backup file: " + archivePath);
+                }
+                std::unique_ptr<dbbackup::MultipartUploader> uploader;
+                std::unique_ptr<dbbackup::TeeSink> tee;
+                if (remote && !autoCompression) {
+                    std::string key = std::filesystem::path(finalPath).filename().string();
+                    uploader = std::make_unique<dbbackup::MultipartUploader>(*remote, key, uploadOptions);
+                    tee = std::make_unique<dbbackup::TeeSink>(file, *uploader);
+                }
+
+                // Archive bytes are checksummed and dump bytes counted as they
+                // stream past, so the archive is never read back for its metadata
+                dbbackup::checksum::DigestSink digest(tee ? static_cast<dbbackup::OutputSink&>(*tee) : file);
+                std::unique_ptr<dbbackup::OutputSink> encoder;
+                dbbackup::AutoSelectingEncoder* autoEncoder = nullptr;
+                if (compressor) {
+                    encoder = compressor->createEncoder(digest);
+                } else if (autoCompression) {
+                    auto selecting = std::make_unique<dbbackup::AutoSelectingEncoder>(digest, compression);
+                    autoEncoder = selecting.get();
+                    encoder = std::move(selecting);
+                }
+                if (useDictionary) {
+                    // ZDICT wants about 100x the dictionary size in samples
+                    size_t budget = static_cast<size_t>(compression.dictionarySizeKB) * 1024 * 100;
+                    sampler = std::make_unique<dbbackup::DictionarySampler>(*encoder, budget);
+                }
+                dbbackup::CountingSink sink(sampler ? static_cast<dbbackup::OutputSink&>(*sampler)
+                                            : encoder ? *encoder : digest);
+
+                if (!conn->streamBackup(sink, tempPath)) {
+                    DB_THROW(BackupError, "Failed to create backup at: " + archivePath);
+                }
+                sink.finish();
+                written.size = digest.digest().size;
+                written.checksum = digest.digest().sha256;
+                written.fastChecksum = digest.digest().xxh64;
+                written.originalSize = sink.bytesWritten();
+                if (tee) {
+                    uploadError = tee->secondaryError();
+                }
+
+                if (autoEncoder) {
+                    const auto& choice = *autoEncoder->choice();
+                    codecName = choice.codec->name();
+                    codecLevel = dbbackup::levelToString(choice.level);
+                    finalPath += choice.codec->extension();
+                }
+                dbbackup::commitFile(archivePath, finalPath);
             }
         } catch (const std::exception& e) {
-            // Clean up temporary file
+            // Never leave a partial archive behind
+            if (std::filesystem::exists(archivePath)) {
+                std::filesystem::remove(archivePath);
+            }
             if (std::filesystem::exists(tempPath)) {
                 std::filesystem::remove(tempPath);
             }
             DB_THROW(BackupError, std::string("Backup failed: ") + e.what());
         }
 
-        // Clean up temporary file
-        if (std::filesystem::exists(tempPath)) {
-            std::filesystem::remove(tempPath);
-        }
+        written.durationSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
 
         // Verify backup exists
         if (!std::filesystem::exists(finalPath)) {
             DB_THROW(StorageError, "Backup file not found after creation: " + finalPath);
         }
 
+        // Record the backup, including the codec and dictionary restores should use
+        written.compression = codecName;
+        written.compressionLevel = codecLevel;
+        written.dictionary = dictionaryId;
+        storage.registerBackup(finalPath, written);
+
+        if (remote && autoCompression) {
+            try {
+                dbbackup::uploadFile(*remote, finalPath,
+                                     std::filesystem::path(finalPath).filename().string(), uploadOptions);
+            } catch (const std::exception& e) {
+                uploadError = e.what();
+            }
+        }
+
+        // The off-site copy only decodes with the dictionary it was primed with
+        if (remote && !dictionaryId.empty() && uploadError.empty()) {
+            try {
+                dbbackup::uploadDictionary(*remote, dictionaryId, storage.loadDictionary(dictionaryId),
+                                           uploadOptions);
+            } catch (const std::exception& e) {
+                uploadError = std::string("dictionary ") + dictionaryId + ": " + e.what();
+            }
+        }
+
+        // Prune what the retention policy no longer keeps, across both tiers
+        // when tiered; a failure leaves extra backups behind but does not
+        // fail this one
+        auto tiers = createTieredStorage(m_config.storage);
+        try {
+            StorageBackend& retained = tiers ? static_cast<StorageBackend&>(*tiers) : storage;
+            size_t pruned = retained.applyRetention(m_config.backup.retention);
+            if (pruned > 0) {
+                logger->info("Pruned {} backups past the retention policy", pruned);
+            }
+        } catch (const std::exception& e) {
+            logger->warn("Failed to apply retention policy: {}", e.what());
+        }
+
+        // Older backups move to the archive tier while the rest finishes up
+        std::future<size_t> migration;
+        if (tiers) {
+            migration = tiers->migrateAsync();
+        }
+
+        // A failed retrain only costs the next backup some ratio
+        if (sampler) {
+            try {
+                storage.saveDictionary(codecName, compressor->trainDictionary(sampler->samples()));
+            } catch (const std::exception& e) {
+                logger->warn("Failed to train compression dictionary: {}", e.what());
+            }
+        }
+
         // Disconnect database
         if (!conn->disconnect()) {
             logger->warn("Failed to disconnect from database");
         }
 
+        // A failed migration is retried after the next backup
+        if (migration.valid()) {
+            try {
+                migration.get();
+            } catch (const std::exception& e) {
+                logger->warn("Failed to migrate backups to the archive tier: {}", e.what());
+            }
+        }
+
+        // The local backup stands, but without its off-site copy the run failed
+        if (!uploadError.empty()) {
+            DB_THROW(BackupError, "Backup stored at " + finalPath + " but its upload to " +
+                     m_config.storage.cloudProvider + " failed: " + uploadError);
+        }
+
         // Log success and send notification if enabled
         logger->info("Backup completed successfully: {}", finalPath);
         if (m_config.logging.enableNotifications) {
@@ -140,12 +396,6 @@ bool BackupManager::backup(const std::string& backupType) {
 }
 
 bool BackupManager::restore(const std::string& backupPath) {
-    // Create compressor outside the macro if compression is enabled
-    std::unique_ptr<dbbackup::Compressor> compressor;
-    if (m_config.backup.compression.enabled) {
-        compressor = std::make_unique<dbbackup::Compressor>(m_config.backup.compression);
-    }
-
     DB_TRY_CATCH_LOG("BackupManager", {
         // Validate input
         DB_CHECK(!backupPath.empty(), ValidationError, "Backup path cannot be empty");
@@ -164,17 +414,24 @@ bool BackupManager::restore(const std::string& backupPath) {
             DB_THROW(ConnectionError, "Failed to connect to database");
         }
 
-        // Decompress if needed
+        // Decompress if needed, detecting the format from the file contents.
+        // Deduplicated backups are reassembled from the chunk store.
         std::string restorePath = backupPath;
-        if (compressor) {
-            std::string uncompressedPath = backupPath;
-            size_t extPos = backupPath.find(compressor->getFileExtension());
-            if (extPos != std::string::npos) {
-                uncompressedPath = backupPath.substr(0, extPos);
-                if (!compressor->decompressFile(backupPath, uncompressedPath)) {
-                    DB_THROW(CompressionError, "Failed to decompress backup file");
-                }
-                restorePath = uncompressedPath;
+        auto codec = dbbackup::ChunkStore::isManifest(backupPath) ? nullptr
+            : dbbackup::CodecRegistry::getInstance().detectFile(
+                  backupPath, recordedCompression(m_config.storage, backupPath));
+        if (dbbackup::ChunkStore::isManifest(backupPath)) {
+            restorePath = std::filesystem::path(backupPath).replace_extension().string();
+            dbbackup::ChunkStore chunks(std::filesystem::path(backupPath).parent_path().string());
+            if (!chunks.restoreFile(backupPath, restorePath, m_config.backup.compression)) {
+                DB_THROW(RestoreError, "Failed to reassemble deduplicated backup: " + backupPath);
+            }
+        } else if (codec) {
+            restorePath = dbbackup::stripCompressionExtension(backupPath, *codec);
+            dbbackup::Compressor decompressor(codec, m_config.backup.compression);
+            decompressor.setDictionary(recordedDictionary(m_config.storage, backupPath));
+            if (!decompressor.decompressFile(backupPath, restorePath)) {
+                DB_THROW(CompressionError, "Failed to decompress backup file");
             }
         }
 
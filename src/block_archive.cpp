@@ -0,0 +1,140 @@
+#include "block_archive.hpp"
+#include "codec_registry.hpp"
+#include "codecs/block_format.hpp"
+#include "error/ErrorUtils.hpp"
+#include <algorithm>
+#include <fstream>
+
+using namespace dbbackup::error;
+
+namespace dbbackup {
+
+namespace {
+    void readAt(std::ifstream& file, uint64_t offset, char* data, size_t size) {
+        file.seekg(static_cast<std::streamoff>(offset));
+        file.read(data, static_cast<std::streamsize>(size));
+        if (static_cast<size_t>(file.gcount()) != size) {
+            DB_THROW(CompressionError, "Block container is truncated");
+        }
+    }
+}
+
+BlockArchiveReader::BlockArchiveReader(const std::string& path,
+                                       std::shared_ptr<const std::string> dictionary)
+    : path(path)
+    , dictionary(std::move(dictionary)) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        DB_THROW(CompressionError, "Failed to open block container: " + path);
+    }
+    uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+
+    // Header: which codec the blocks use
+    std::string header(std::min<uint64_t>(fileSize, blockformat::MAX_HEADER_SIZE), '\0');
+    readAt(file, 0, &header[0], header.size());
+    std::string name;
+    uint64_t headerSize = blockformat::decodeHeader(header.data(), header.size(), name, blockSize);
+    if (headerSize == 0) {
+        DB_THROW(CompressionError, "Block container is truncated");
+    }
+    inner = CodecRegistry::getInstance().findByName(name);
+    if (!inner) {
+        DB_THROW(CompressionError, "Unknown codec in block container: " + name);
+    }
+    if (this->dictionary && !inner->supportsBlockDictionary()) {
+        DB_THROW(CompressionError, "Codec does not support dictionaries: " + name);
+    }
+
+    // Footer and index
+    if (fileSize < headerSize + blockformat::BLOCK_HEADER_SIZE + blockformat::FOOTER_SIZE) {
+        DB_THROW(CompressionError, "Block container is truncated");
+    }
+    char footerBytes[blockformat::FOOTER_SIZE];
+    readAt(file, fileSize - blockformat::FOOTER_SIZE, footerBytes, sizeof(footerBytes));
+    blockformat::Footer footer = blockformat::decodeFooter(footerBytes);
+
+    uint64_t indexSize = static_cast<uint64_t>(footer.blockCount) * blockformat::INDEX_ENTRY_SIZE;
+    if (footer.indexOffset + indexSize + blockformat::FOOTER_SIZE != fileSize) {
+        DB_THROW(CompressionError, "Block container index is truncated or corrupted");
+    }
+    std::string index(indexSize, '\0');
+    readAt(file, footer.indexOffset, &index[0], index.size());
+    if (blockformat::crc(index.data(), index.size()) != footer.indexCrc) {
+        DB_THROW(CompressionError, "Block container index checksum mismatch");
+    }
+
+    uint64_t expectedRawOffset = 0;
+    for (const auto& indexEntry : blockformat::decodeIndex(index.data(), footer.blockCount)) {
+        if (indexEntry.rawOffset != expectedRawOffset ||
+            indexEntry.fileOffset + blockformat::BLOCK_HEADER_SIZE + indexEntry.storedSize > footer.indexOffset) {
+            DB_THROW(CompressionError, "Block container index does not match its blocks");
+        }
+        BlockArchiveEntry entry;
+        entry.fileOffset = indexEntry.fileOffset;
+        entry.rawOffset = indexEntry.rawOffset;
+        entry.rawSize = indexEntry.rawSize;
+        entry.storedSize = indexEntry.storedSize;
+        entries.push_back(entry);
+        expectedRawOffset += indexEntry.rawSize;
+    }
+    if (expectedRawOffset != footer.rawSize) {
+        DB_THROW(CompressionError, "Block container index does not match its blocks");
+    }
+    rawSize = footer.rawSize;
+}
+
+std::string BlockArchiveReader::codecName() const {
+    return inner->name();
+}
+
+std::string BlockArchiveReader::decodeBlockAt(std::ifstream& file, size_t index) const {
+    const BlockArchiveEntry& entry = entries.at(index);
+    std::string stored(blockformat::BLOCK_HEADER_SIZE + entry.storedSize, '\0');
+    readAt(file, entry.fileOffset, &stored[0], stored.size());
+
+    blockformat::BlockHeader header = blockformat::decodeBlockHeader(stored.data());
+    if (header.rawSize != entry.rawSize || header.storedSize != entry.storedSize) {
+        DB_THROW(CompressionError, "Block header does not match the container index");
+    }
+    blockformat::validateBlockHeader(header, blockSize);
+    return blockformat::decodeBlock(*inner, header, stored.data() + blockformat::BLOCK_HEADER_SIZE,
+                                    dictionary.get());
+}
+
+std::string BlockArchiveReader::readBlock(size_t index) const {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        DB_THROW(CompressionError, "Failed to open block container: " + path);
+    }
+    return decodeBlockAt(file, index);
+}
+
+uint64_t BlockArchiveReader::readRange(uint64_t offset, uint64_t length, OutputSink& sink) const {
+    if (offset >= rawSize || length == 0) {
+        return 0;
+    }
+    uint64_t end = offset + std::min(length, rawSize - offset);
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        DB_THROW(CompressionError, "Failed to open block container: " + path);
+    }
+
+    // First block whose range contains offset
+    auto it = std::upper_bound(entries.begin(), entries.end(), offset,
+        [](uint64_t value, const BlockArchiveEntry& entry) { return value < entry.rawOffset; });
+    size_t index = static_cast<size_t>(std::distance(entries.begin(), it)) - 1;
+
+    uint64_t written = 0;
+    for (; index < entries.size() && entries[index].rawOffset < end; index++) {
+        const BlockArchiveEntry& entry = entries[index];
+        std::string raw = decodeBlockAt(file, index);
+        uint64_t from = std::max(offset, entry.rawOffset) - entry.rawOffset;
+        uint64_t to = std::min(end, entry.rawOffset + entry.rawSize) - entry.rawOffset;
+        sink.write(raw.data() + from, static_cast<size_t>(to - from));
+        written += to - from;
+    }
+    return written;
+}
+
+} // namespace dbbackup
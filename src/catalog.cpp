@@ -0,0 +1,515 @@
+#include "catalog.hpp"
+#include "file_utils.hpp"
+#include "error/ErrorUtils.hpp"
+#include <nlohmann/json.hpp>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+using namespace dbbackup::error;
+
+namespace {
+    // Compact once superseded records outnumber live ones by this much
+    constexpr size_t COMPACTION_SLACK = 64;
+
+    std::string errorText() {
+        return std::strerror(errno);
+    }
+
+    // flock held for the lifetime of the object
+    class FileLock {
+    public:
+        FileLock(const std::string& path, int operation) {
+            fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                DB_THROW(StorageError, "Failed to open catalog lock: " + path + ": " + errorText());
+            }
+            while (::flock(fd, operation) != 0) {
+                if (errno != EINTR) {
+                    ::close(fd);
+                    DB_THROW(StorageError, "Failed to lock catalog: " + path + ": " + errorText());
+                }
+            }
+        }
+
+        ~FileLock() {
+            ::flock(fd, LOCK_UN);
+            ::close(fd);
+        }
+
+        FileLock(const FileLock&) = delete;
+        FileLock& operator=(const FileLock&) = delete;
+
+    private:
+        int fd = -1;
+    };
+
+    void writeAll(int fd, const std::string& data, const std::string& path) {
+        const char* p = data.data();
+        size_t left = data.size();
+        while (left > 0) {
+            ssize_t n = ::write(fd, p, left);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                DB_THROW(StorageError, "Failed to write catalog: " + path + ": " + errorText());
+            }
+            p += n;
+            left -= static_cast<size_t>(n);
+        }
+    }
+
+    json toJson(const BackupMetadata& m) {
+        return json{
+            {"op", "add"},
+            {"filename", m.filename},
+            {"timestamp", m.timestamp},
+            {"size", m.size},
+            {"originalSize", m.originalSize},
+            {"compression", m.compression},
+            {"compressionLevel", m.compressionLevel},
+            {"dictionary", m.dictionary},
+            {"database", m.database},
+            {"durationSeconds", m.durationSeconds},
+            {"verifiedAt", m.verifiedAt},
+            {"damaged", m.damaged},
+            {"fastChecksum", m.fastChecksum},
+            {"checksum", m.checksum},
+        };
+    }
+
+    BackupMetadata fromJson(const json& record) {
+        BackupMetadata m;
+        m.filename = record.at("filename").get<std::string>();
+        m.timestamp = record.value("timestamp", "");
+        m.size = record.value("size", static_cast<size_t>(0));
+        m.originalSize = record.value("originalSize", static_cast<size_t>(0));
+        m.compression = record.value("compression", "");
+        m.compressionLevel = record.value("compressionLevel", "");
+        m.dictionary = record.value("dictionary", "");
+        m.database = record.value("database", "");
+        m.durationSeconds = record.value("durationSeconds", 0.0);
+        m.verifiedAt = record.value("verifiedAt", "");
+        m.damaged = record.value("damaged", false);
+        m.fastChecksum = record.value("fastChecksum", "");
+        m.checksum = record.value("checksum", "");
+        return m;
+    }
+
+    // Value of a `"key": "value"` line of the legacy backups.json, with or
+    // without a trailing comma
+    std::string legacyStringValue(const std::string& line) {
+        size_t open = line.find('"', line.find(':') + 1);
+        size_t close = line.rfind('"');
+        if (open == std::string::npos || close <= open) {
+            return "";
+        }
+        return line.substr(open + 1, close - open - 1);
+    }
+
+    // The one-object-per-field layout the old LocalStorage wrote
+    std::vector<BackupMetadata> loadLegacy(const fs::path& path) {
+        std::vector<BackupMetadata> metadata;
+        std::ifstream file(path);
+        if (!file) {
+            DB_THROW(StorageError, "Failed to read backup metadata: " + path.string());
+        }
+        std::string line;
+        BackupMetadata current;
+        while (std::getline(file, line)) {
+            if (line.find("\"filename\"") != std::string::npos) {
+                current.filename = legacyStringValue(line);
+            } else if (line.find("\"timestamp\"") != std::string::npos) {
+                current.timestamp = legacyStringValue(line);
+            } else if (line.find("\"size\"") != std::string::npos) {
+                current.size = std::stoull(line.substr(line.find(':') + 1));
+            } else if (line.find("\"originalSize\"") != std::string::npos) {
+                current.originalSize = std::stoull(line.substr(line.find(':') + 1));
+            } else if (line.find("\"compression\"") != std::string::npos) {
+                current.compression = legacyStringValue(line);
+            } else if (line.find("\"compressionLevel\"") != std::string::npos) {
+                current.compressionLevel = legacyStringValue(line);
+            } else if (line.find("\"dictionary\"") != std::string::npos) {
+                current.dictionary = legacyStringValue(line);
+            } else if (line.find("\"fastChecksum\"") != std::string::npos) {
+                current.fastChecksum = legacyStringValue(line);
+            } else if (line.find("\"checksum\"") != std::string::npos) {
+                current.checksum = legacyStringValue(line);
+                metadata.push_back(current);
+                current = BackupMetadata();
+            }
+        }
+        return metadata;
+    }
+}
+
+BackupCatalog::BackupCatalog(std::string directory) : directory(std::move(directory)) {
+}
+
+std::string BackupCatalog::logPath() const {
+    return (fs::path(directory) / "catalog.jsonl").string();
+}
+
+std::string BackupCatalog::lockPath() const {
+    return (fs::path(directory) / "catalog.lock").string();
+}
+
+std::string BackupCatalog::backupType(const std::string& filename) {
+    // backup_YYYYMMDD_HHMMSS_<type>.dump...
+    const std::string prefix = "backup_";
+    const size_t typeStart = prefix.size() + 16;
+    if (filename.compare(0, prefix.size(), prefix) != 0 || filename.size() <= typeStart) {
+        return "";
+    }
+    size_t typeEnd = filename.find('.', typeStart);
+    return filename.substr(typeStart, typeEnd == std::string::npos ? std::string::npos : typeEnd - typeStart);
+}
+
+void BackupCatalog::insert(const BackupMetadata& metadata) const {
+    erase(metadata.filename);
+    entries[metadata.filename] = metadata;
+    byTime.emplace(metadata.timestamp, metadata.filename);
+    byType[backupType(metadata.filename)].emplace(metadata.timestamp, metadata.filename);
+    if (!metadata.checksum.empty()) {
+        byChecksum[metadata.checksum].emplace(metadata.timestamp, metadata.filename);
+    }
+}
+
+void BackupCatalog::erase(const std::string& filename) const {
+    auto found = entries.find(filename);
+    if (found == entries.end()) {
+        return;
+    }
+    auto key = std::make_pair(found->second.timestamp, filename);
+    byTime.erase(key);
+    auto type = byType.find(backupType(filename));
+    if (type != byType.end()) {
+        type->second.erase(key);
+        if (type->second.empty()) {
+            byType.erase(type);
+        }
+    }
+    auto sum = byChecksum.find(found->second.checksum);
+    if (sum != byChecksum.end()) {
+        sum->second.erase(key);
+        if (sum->second.empty()) {
+            byChecksum.erase(sum);
+        }
+    }
+    entries.erase(found);
+}
+
+void BackupCatalog::applyLine(const std::string& line) const {
+    if (line.empty()) {
+        return;
+    }
+    logRecords++;
+    // A record damaged by a crash mid-append is skipped; the lines after it
+    // start on a fresh line and are intact
+    json record = json::parse(line, nullptr, false);
+    if (record.is_discarded() || !record.is_object() || !record.contains("filename")) {
+        return;
+    }
+    std::string op = record.value("op", "");
+    if (op == "add") {
+        insert(fromJson(record));
+    } else if (op == "remove") {
+        erase(record["filename"].get<std::string>());
+    }
+}
+
+void BackupCatalog::reload() const {
+    entries.clear();
+    byTime.clear();
+    byType.clear();
+    byChecksum.clear();
+    logOffset = 0;
+    logInode = 0;
+    logRecords = 0;
+}
+
+void BackupCatalog::refresh() const {
+    struct stat info;
+    if (::stat(logPath().c_str(), &info) != 0) {
+        reload();
+        return;
+    }
+    if (static_cast<uint64_t>(info.st_ino) != logInode ||
+        static_cast<uint64_t>(info.st_size) < logOffset) {
+        // Compacted (or replaced) since we last read it
+        reload();
+        logInode = static_cast<uint64_t>(info.st_ino);
+    }
+    if (static_cast<uint64_t>(info.st_size) == logOffset) {
+        return;
+    }
+
+    std::ifstream file(logPath(), std::ios::binary);
+    if (!file) {
+        DB_THROW(StorageError, "Failed to read catalog: " + logPath());
+    }
+    file.seekg(static_cast<std::streamoff>(logOffset));
+    std::string line;
+    while (std::getline(file, line)) {
+        if (file.eof()) {
+            // No newline yet: an append in progress or torn by a crash
+            break;
+        }
+        applyLine(line);
+        logOffset += line.size() + 1;
+    }
+}
+
+void BackupCatalog::append(const std::string& records) {
+    int fd = ::open(logPath().c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        DB_THROW(StorageError, "Failed to open catalog: " + logPath() + ": " + errorText());
+    }
+    try {
+        // Start on a fresh line if a crash left a torn record at the end
+        std::string data;
+        struct stat info;
+        bool statted = ::fstat(fd, &info) == 0;
+        bool created = statted && info.st_size == 0;
+        if (statted && info.st_size > 0) {
+            char last = '\n';
+            if (::pread(fd, &last, 1, info.st_size - 1) == 1 && last != '\n') {
+                data += '\n';
+            }
+        }
+        data += records;
+        data += '\n';
+        writeAll(fd, data, logPath());
+        if (::fdatasync(fd) != 0) {
+            DB_THROW(StorageError, "Failed to sync catalog: " + logPath() + ": " + errorText());
+        }
+        // A new log is only durable once its directory entry is
+        if (created) {
+            dbbackup::syncDirectory(directory);
+        }
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+}
+
+void BackupCatalog::rewrite() const {
+    std::string tmp = logPath() + ".tmp";
+    std::string contents;
+    for (const auto& time : byTime) {
+        contents += toJson(entries.at(time.second)).dump();
+        contents += '\n';
+    }
+
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        DB_THROW(StorageError, "Failed to create catalog: " + tmp + ": " + errorText());
+    }
+    try {
+        writeAll(fd, contents, tmp);
+        if (::fsync(fd) != 0) {
+            DB_THROW(StorageError, "Failed to sync catalog: " + tmp + ": " + errorText());
+        }
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+    dbbackup::commitFile(tmp, logPath());
+
+    // Our state already matches the new file; just point at it
+    struct stat info;
+    if (::stat(logPath().c_str(), &info) == 0) {
+        logInode = static_cast<uint64_t>(info.st_ino);
+        logOffset = static_cast<uint64_t>(info.st_size);
+        logRecords = entries.size();
+    }
+}
+
+void BackupCatalog::migrateLegacy() const {
+    fs::path legacy = fs::path(directory) / "backups.json";
+    if (fs::exists(logPath()) || !fs::exists(legacy)) {
+        return;
+    }
+    reload();
+    for (const auto& metadata : loadLegacy(legacy)) {
+        insert(metadata);
+    }
+    rewrite();
+    fs::rename(legacy, fs::path(directory) / "backups.json.migrated");
+}
+
+void BackupCatalog::load() const {
+    if (!fs::exists(logPath()) && fs::exists(fs::path(directory) / "backups.json")) {
+        FileLock lock(lockPath(), LOCK_EX);
+        migrateLegacy();
+    }
+    // Shared: any number of readers, never alongside a writer
+    FileLock lock(lockPath(), LOCK_SH);
+    refresh();
+}
+
+void BackupCatalog::add(const BackupMetadata& metadata) {
+    DB_CHECK(!metadata.filename.empty(), ValidationError, "Catalog entry needs a filename");
+    std::lock_guard<std::mutex> guard(mutex);
+    fs::create_directories(directory);
+    FileLock lock(lockPath(), LOCK_EX);
+    migrateLegacy();
+    refresh();
+    append(toJson(metadata).dump());
+    refresh();
+    if (logRecords > 2 * entries.size() + COMPACTION_SLACK) {
+        rewrite();
+    }
+}
+
+bool BackupCatalog::markVerified(const std::string& filename, const std::string& verifiedAt, bool damaged) {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (!fs::exists(directory)) {
+        return false;
+    }
+    FileLock lock(lockPath(), LOCK_EX);
+    migrateLegacy();
+    refresh();
+    auto found = entries.find(filename);
+    if (found == entries.end()) {
+        return false;
+    }
+    BackupMetadata metadata = found->second;
+    metadata.verifiedAt = verifiedAt;
+    metadata.damaged = damaged;
+    append(toJson(metadata).dump());
+    refresh();
+    if (logRecords > 2 * entries.size() + COMPACTION_SLACK) {
+        rewrite();
+    }
+    return true;
+}
+
+bool BackupCatalog::remove(const std::string& filename) {
+    return remove(std::vector<std::string>{filename}) == 1;
+}
+
+size_t BackupCatalog::remove(const std::vector<std::string>& filenames) {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (!fs::exists(directory)) {
+        return 0;
+    }
+    FileLock lock(lockPath(), LOCK_EX);
+    migrateLegacy();
+    refresh();
+
+    // All records go out in one append and one sync
+    std::string records;
+    std::set<std::string> removed;
+    for (const auto& filename : filenames) {
+        if (entries.count(filename) == 0 || !removed.insert(filename).second) {
+            continue;
+        }
+        if (!records.empty()) {
+            records += '\n';
+        }
+        records += json{{"op", "remove"}, {"filename", filename}}.dump();
+    }
+    if (removed.empty()) {
+        return 0;
+    }
+    append(records);
+    refresh();
+    if (logRecords > 2 * entries.size() + COMPACTION_SLACK) {
+        rewrite();
+    }
+    return removed.size();
+}
+
+void BackupCatalog::compact() {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (!fs::exists(directory)) {
+        return;
+    }
+    FileLock lock(lockPath(), LOCK_EX);
+    migrateLegacy();
+    refresh();
+    rewrite();
+}
+
+std::optional<BackupMetadata> BackupCatalog::find(const std::string& filename) const {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (!fs::exists(directory)) {
+        return std::nullopt;
+    }
+    load();
+    auto found = entries.find(filename);
+    if (found == entries.end()) {
+        return std::nullopt;
+    }
+    return found->second;
+}
+
+std::vector<BackupMetadata> BackupCatalog::list() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    std::vector<BackupMetadata> result;
+    if (!fs::exists(directory)) {
+        return result;
+    }
+    load();
+    for (const auto& time : byTime) {
+        result.push_back(entries.at(time.second));
+    }
+    return result;
+}
+
+std::vector<BackupMetadata> BackupCatalog::listBetween(const std::string& from, const std::string& to) const {
+    std::lock_guard<std::mutex> guard(mutex);
+    std::vector<BackupMetadata> result;
+    if (!fs::exists(directory)) {
+        return result;
+    }
+    load();
+    for (auto it = byTime.lower_bound({from, ""}); it != byTime.end() && it->first <= to; ++it) {
+        result.push_back(entries.at(it->second));
+    }
+    return result;
+}
+
+std::vector<BackupMetadata> BackupCatalog::listByType(const std::string& type) const {
+    std::lock_guard<std::mutex> guard(mutex);
+    std::vector<BackupMetadata> result;
+    if (!fs::exists(directory)) {
+        return result;
+    }
+    load();
+    auto found = byType.find(type);
+    if (found != byType.end()) {
+        for (const auto& time : found->second) {
+            result.push_back(entries.at(time.second));
+        }
+    }
+    return result;
+}
+
+std::vector<BackupMetadata> BackupCatalog::listByChecksum(const std::string& checksum) const {
+    std::lock_guard<std::mutex> guard(mutex);
+    std::vector<BackupMetadata> result;
+    if (!fs::exists(directory)) {
+        return result;
+    }
+    load();
+    auto found = byChecksum.find(checksum);
+    if (found != byChecksum.end()) {
+        for (const auto& time : found->second) {
+            result.push_back(entries.at(time.second));
+        }
+    }
+    return result;
+}
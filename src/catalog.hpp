@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct BackupMetadata {
+    std::string filename;
+    std::string timestamp;
+    size_t size = 0;
+    size_t originalSize = 0;       // Bytes before compression, 0 if unknown
+    std::string checksum;          // SHA-256 of the file, hex
+    std::string fastChecksum;      // XXH64 of the file, hex; empty for older entries
+    std::string compression;       // Codec name, empty if uncompressed
+    std::string compressionLevel;  // low, medium, high
+    std::string dictionary;        // Id of the compression dictionary used, empty if none
+    std::string database;          // <type>:<name> of the database dumped, empty if unknown
+    double durationSeconds = 0;    // Time to dump, compress and commit, 0 if unknown
+    std::string verifiedAt;        // YYYYMMDD_HHMMSS of the last scrub, empty if never scrubbed
+    bool damaged = false;          // The last scrub found it did not match its checksums
+};
+
+/// Catalog of the backups in a storage directory, kept as an append-only
+/// JSON-lines log (catalog.jsonl) of add and remove records. Every update is
+/// one appended line, so a crash can at most lose a torn final line, and
+/// the log is compacted into a fresh file, renamed over the old one, once
+/// most of it is superseded. Processes coordinate with flock on
+/// catalog.lock: shared while reading, exclusive while appending or
+/// compacting. Readers pick up other processes' appends incrementally.
+///
+/// Lookups by filename are O(log n); listings by time, backup type or
+/// checksum walk ordered indexes. A legacy backups.json is imported on first use and
+/// renamed to backups.json.migrated.
+class BackupCatalog {
+public:
+    /// directory is the metadata directory; it is created when first written
+    explicit BackupCatalog(std::string directory);
+
+    /// Add a backup, replacing any entry with the same filename
+    void add(const BackupMetadata& metadata);
+
+    /// Record the outcome of verifying a backup at verifiedAt, keeping the
+    /// rest of its entry. Returns false if it is not catalogued, say because
+    /// it was pruned meanwhile.
+    bool markVerified(const std::string& filename, const std::string& verifiedAt, bool damaged);
+
+    /// Remove a backup's entry. Returns false if it was not catalogued.
+    bool remove(const std::string& filename);
+
+    /// Remove several entries with a single append and sync. Returns the
+    /// number that were catalogued.
+    size_t remove(const std::vector<std::string>& filenames);
+
+    std::optional<BackupMetadata> find(const std::string& filename) const;
+
+    /// All backups, oldest first
+    std::vector<BackupMetadata> list() const;
+
+    /// Backups with from <= timestamp <= to, oldest first. Timestamps use
+    /// the YYYYMMDD_HHMMSS format, so they order as strings.
+    std::vector<BackupMetadata> listBetween(const std::string& from, const std::string& to) const;
+
+    /// Backups of one type (full, incremental, differential), oldest first
+    std::vector<BackupMetadata> listByType(const std::string& type) const;
+
+    /// Backups whose files have this SHA-256, oldest first
+    std::vector<BackupMetadata> listByChecksum(const std::string& checksum) const;
+
+    /// Rewrite the log with only the live entries
+    void compact();
+
+    /// Backup type encoded in a backup_YYYYMMDD_HHMMSS_<type>.dump... name,
+    /// empty if the name does not follow that pattern
+    static std::string backupType(const std::string& filename);
+
+private:
+    /// Brings the in-memory state up to date under a shared lock, importing
+    /// a legacy backups.json first if needed. Callers hold mutex.
+    void load() const;
+    /// Mirrors the log in memory. Callers hold mutex and a file lock.
+    void refresh() const;
+    void reload() const;
+    void applyLine(const std::string& line) const;
+    void insert(const BackupMetadata& metadata) const;
+    void erase(const std::string& filename) const;
+    /// Appends newline-separated records and syncs. Callers hold the
+    /// exclusive lock.
+    void append(const std::string& records);
+    void rewrite() const;
+    void migrateLegacy() const;
+
+    std::string logPath() const;
+    std::string lockPath() const;
+
+    std::string directory;
+    mutable std::mutex mutex;
+
+    // In-memory state, rebuilt from the log
+    mutable std::map<std::string, BackupMetadata> entries;  // By filename
+    mutable std::set<std::pair<std::string, std::string>> byTime;  // (timestamp, filename)
+    mutable std::map<std::string, std::set<std::pair<std::string, std::string>>> byType;
+    mutable std::map<std::string, std::set<std::pair<std::string, std::string>>> byChecksum;
+    mutable uint64_t logOffset = 0;  // Bytes of the log applied
+    mutable uint64_t logInode = 0;   // Changes when the log is compacted
+    mutable size_t logRecords = 0;   // Records in the log, live or not
+};
@@ -0,0 +1,387 @@
+#include "checksum.hpp"
+#include "error/ErrorUtils.hpp"
+#include <zlib.h>
+#include <openssl/evp.h>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define DBBACKUP_CRC32_PCLMUL 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define DBBACKUP_CRC32_ARM 1
+#endif
+
+namespace dbbackup {
+namespace checksum {
+
+namespace {
+    uint32_t zlibCrc32(const unsigned char* data, size_t size, uint32_t crc) {
+        // zlib takes 32-bit lengths
+        while (size > 0) {
+            uInt slice = static_cast<uInt>(std::min<size_t>(size, 1u << 30));
+            crc = static_cast<uint32_t>(::crc32(crc, data, slice));
+            data += slice;
+            size -= slice;
+        }
+        return crc;
+    }
+
+#ifdef DBBACKUP_CRC32_PCLMUL
+    constexpr size_t PCLMUL_MINIMUM = 64;
+
+    /// Folds size bytes (a multiple of 16, at least 64) into the
+    /// non-inverted CRC register, following Intel's "Fast CRC Computation for
+    /// Generic Polynomials Using PCLMULQDQ" with the bit-reflected constants
+    /// for the gzip polynomial
+    __attribute__((target("sse4.1,pclmul")))
+    uint32_t pclmulCrc32(const unsigned char* data, size_t size, uint32_t crc) {
+        alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+        alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+        alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+        alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+
+        __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+        x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00));
+        x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10));
+        x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20));
+        x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30));
+        x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+        x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+        data += 64;
+        size -= 64;
+
+        // Fold four lanes of 64 bytes in parallel
+        while (size >= 64) {
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+            x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+            x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+            x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+            x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+            y5 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00));
+            y6 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10));
+            y7 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20));
+            y8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30));
+
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+            x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+            x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+            x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+            data += 64;
+            size -= 64;
+        }
+
+        // Fold the four lanes into one
+        x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+        for (__m128i next : {x2, x3, x4}) {
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, next), x5);
+        }
+
+        // Remaining 16-byte blocks
+        while (size >= 16) {
+            x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+            data += 16;
+            size -= 16;
+        }
+
+        // 128 bits down to 64
+        x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+        x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+        x1 = _mm_srli_si128(x1, 8);
+        x1 = _mm_xor_si128(x1, x2);
+
+        x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+        x2 = _mm_srli_si128(x1, 4);
+        x1 = _mm_and_si128(x1, x3);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        // Barrett reduction to 32 bits
+        x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+        x2 = _mm_and_si128(x1, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+        x2 = _mm_and_si128(x2, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+    }
+
+    bool cpuHasPclmul() {
+        static const bool supported = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+        return supported;
+    }
+#endif
+
+#ifdef DBBACKUP_CRC32_ARM
+    uint32_t armCrc32(const unsigned char* data, size_t size, uint32_t crc) {
+        crc = ~crc;
+        while (size >= 8) {
+            uint64_t word;
+            std::memcpy(&word, data, sizeof(word));
+            crc = __crc32d(crc, word);
+            data += 8;
+            size -= 8;
+        }
+        while (size > 0) {
+            crc = __crc32b(crc, *data++);
+            size--;
+        }
+        return ~crc;
+    }
+#endif
+
+    constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+    constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+    constexpr uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+    constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+    constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+    inline uint64_t rotl(uint64_t value, int bits) {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    // XXH64 is defined on little-endian reads
+    inline uint64_t read64(const unsigned char* p) {
+        uint64_t value;
+        std::memcpy(&value, p, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        value = __builtin_bswap64(value);
+#endif
+        return value;
+    }
+
+    inline uint32_t read32(const unsigned char* p) {
+        uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        value = __builtin_bswap32(value);
+#endif
+        return value;
+    }
+
+    inline uint64_t round(uint64_t acc, uint64_t input) {
+        acc += input * PRIME2;
+        acc = rotl(acc, 31);
+        return acc * PRIME1;
+    }
+
+    inline uint64_t mergeRound(uint64_t acc, uint64_t value) {
+        acc ^= round(0, value);
+        return acc * PRIME1 + PRIME4;
+    }
+
+    /// Consumes the tail (< 32 bytes) and mixes the final hash
+    uint64_t finalize(uint64_t hash, const unsigned char* p, size_t size) {
+        while (size >= 8) {
+            hash ^= round(0, read64(p));
+            hash = rotl(hash, 27) * PRIME1 + PRIME4;
+            p += 8;
+            size -= 8;
+        }
+        if (size >= 4) {
+            hash ^= static_cast<uint64_t>(read32(p)) * PRIME1;
+            hash = rotl(hash, 23) * PRIME2 + PRIME3;
+            p += 4;
+            size -= 4;
+        }
+        while (size > 0) {
+            hash ^= *p++ * PRIME5;
+            hash = rotl(hash, 11) * PRIME1;
+            size--;
+        }
+        hash ^= hash >> 33;
+        hash *= PRIME2;
+        hash ^= hash >> 29;
+        hash *= PRIME3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+}
+
+uint32_t crc32(const void* data, size_t size, uint32_t crc) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+#ifdef DBBACKUP_CRC32_PCLMUL
+    if (size >= PCLMUL_MINIMUM && cpuHasPclmul()) {
+        size_t chunk = size & ~static_cast<size_t>(15);
+        crc = ~pclmulCrc32(bytes, chunk, ~crc);
+        bytes += chunk;
+        size -= chunk;
+    }
+#elif defined(DBBACKUP_CRC32_ARM)
+    return armCrc32(bytes, size, crc);
+#endif
+    return size > 0 ? zlibCrc32(bytes, size, crc) : crc;
+}
+
+bool hardwareCrc32() {
+#ifdef DBBACKUP_CRC32_PCLMUL
+    return cpuHasPclmul();
+#elif defined(DBBACKUP_CRC32_ARM)
+    return true;
+#else
+    return false;
+#endif
+}
+
+Xxh64::Xxh64(uint64_t seed)
+    : acc{seed + PRIME1 + PRIME2, seed + PRIME2, seed, seed - PRIME1}
+    , seed(seed) {
+}
+
+void Xxh64::update(const void* data, size_t size) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    totalSize += size;
+
+    if (pendingSize > 0) {
+        size_t n = std::min(size, sizeof(pending) - pendingSize);
+        std::memcpy(pending + pendingSize, p, n);
+        pendingSize += n;
+        p += n;
+        size -= n;
+        if (pendingSize < sizeof(pending)) {
+            return;
+        }
+        for (int lane = 0; lane < 4; lane++) {
+            acc[lane] = round(acc[lane], read64(pending + 8 * lane));
+        }
+        pendingSize = 0;
+    }
+
+    // Accumulators in locals so they stay in registers
+    uint64_t v1 = acc[0], v2 = acc[1], v3 = acc[2], v4 = acc[3];
+    while (size >= 32) {
+        v1 = round(v1, read64(p));
+        v2 = round(v2, read64(p + 8));
+        v3 = round(v3, read64(p + 16));
+        v4 = round(v4, read64(p + 24));
+        p += 32;
+        size -= 32;
+    }
+    acc[0] = v1;
+    acc[1] = v2;
+    acc[2] = v3;
+    acc[3] = v4;
+
+    std::memcpy(pending, p, size);
+    pendingSize = size;
+}
+
+uint64_t Xxh64::digest() const {
+    uint64_t hash;
+    if (totalSize >= 32) {
+        hash = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) + rotl(acc[3], 18);
+        for (int lane = 0; lane < 4; lane++) {
+            hash = mergeRound(hash, acc[lane]);
+        }
+    } else {
+        hash = seed + PRIME5;
+    }
+    hash += totalSize;
+    return finalize(hash, pending, pendingSize);
+}
+
+uint64_t xxh64(const void* data, size_t size, uint64_t seed) {
+    Xxh64 state(seed);
+    state.update(data, size);
+    return state.digest();
+}
+
+std::string toHex(uint64_t value) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(16, '0');
+    for (int i = 15; i >= 0; i--) {
+        hex[i] = digits[value & 0xf];
+        value >>= 4;
+    }
+    return hex;
+}
+
+namespace {
+    std::string hexBytes(const unsigned char* bytes, size_t size) {
+        static const char digits[] = "0123456789abcdef";
+        std::string hex;
+        hex.reserve(size * 2);
+        for (size_t i = 0; i < size; i++) {
+            hex += digits[bytes[i] >> 4];
+            hex += digits[bytes[i] & 0xf];
+        }
+        return hex;
+    }
+}
+
+std::string sha256(const void* data, size_t size) {
+    unsigned char hash[EVP_MAX_MD_SIZE];
+    unsigned int hashLen = 0;
+    if (EVP_Digest(data, size, hash, &hashLen, EVP_sha256(), nullptr) != 1) {
+        DB_THROW(error::StorageError, "Failed to compute SHA-256");
+    }
+    return hexBytes(hash, hashLen);
+}
+
+DigestSink::DigestSink(OutputSink& downstream)
+    : downstream(downstream)
+    , sha256(EVP_MD_CTX_new()) {
+    if (!sha256) {
+        DB_THROW(error::StorageError, "Failed to create message digest context");
+    }
+    if (EVP_DigestInit_ex(sha256, EVP_sha256(), nullptr) != 1) {
+        EVP_MD_CTX_free(sha256);
+        DB_THROW(error::StorageError, "Failed to initialize message digest");
+    }
+}
+
+DigestSink::~DigestSink() {
+    EVP_MD_CTX_free(sha256);
+}
+
+void DigestSink::write(const char* data, size_t size) {
+    downstream.write(data, size);
+    if (EVP_DigestUpdate(sha256, data, size) != 1) {
+        DB_THROW(error::StorageError, "Failed to update message digest");
+    }
+    fast.update(data, size);
+    result.size += size;
+}
+
+void DigestSink::finish() {
+    if (!finished) {
+        unsigned char hash[EVP_MAX_MD_SIZE];
+        unsigned int hashLen = 0;
+        if (EVP_DigestFinal_ex(sha256, hash, &hashLen) != 1) {
+            DB_THROW(error::StorageError, "Failed to finalize message digest");
+        }
+        result.sha256 = hexBytes(hash, hashLen);
+        result.xxh64 = toHex(fast.digest());
+        finished = true;
+    }
+    downstream.finish();
+}
+
+Digest digestFile(const std::string& path) {
+    FileSource file(path);
+    if (!file) {
+        DB_THROW(error::StorageError, "Failed to open file for checksum calculation: " + path);
+    }
+    CountingSink discard;
+    DigestSink sink(discard);
+    copyStream(file, sink);
+    sink.finish();
+    return sink.digest();
+}
+
+} // namespace checksum
+} // namespace dbbackup
@@ -0,0 +1,389 @@
+#include "chunk_store.hpp"
+#include "checksum.hpp"
+#include "codec_registry.hpp"
+#include "compression.hpp"
+#include "error/ErrorUtils.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+using namespace dbbackup::error;
+
+namespace dbbackup {
+
+namespace {
+    constexpr const char* MANIFEST_MAGIC = "hegemon-chunks 1";
+
+    // Random values per byte for the gear hash, fixed so that cut points
+    // (and so deduplication) are stable across runs and versions
+    struct GearTable {
+        uint64_t values[256];
+
+        GearTable() {
+            uint64_t state = 0x6a09e667f3bcc908ULL;
+            for (auto& value : values) {
+                // splitmix64
+                uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                value = z ^ (z >> 31);
+            }
+        }
+    };
+
+    const GearTable GEAR;
+
+    // Mask of the top bits of the hash: with a left-shifting gear hash those
+    // depend on the most bytes, up to 64
+    uint64_t topBits(unsigned count) {
+        return count == 0 ? 0 : ~0ULL << (64 - count);
+    }
+
+    unsigned log2Floor(size_t value) {
+        unsigned bits = 0;
+        while (value >>= 1) {
+            bits++;
+        }
+        return bits;
+    }
+
+    // Temporary sibling of path, renamed over it once complete so readers
+    // never see a partial chunk or manifest
+    std::string temporaryPath(const std::string& path) {
+        return path + ".tmp" + std::to_string(::getpid());
+    }
+
+    void writeFileAtomically(const std::string& path, const std::string& contents) {
+        std::string tmp = temporaryPath(path);
+        {
+            FileSink file(tmp);
+            if (!file) {
+                DB_THROW(StorageError, "Failed to create file: " + tmp);
+            }
+            file.write(contents.data(), contents.size());
+            file.finish();
+        }
+        fs::rename(tmp, path);
+    }
+
+    std::string codecExtension(const std::string& codec) {
+        if (codec.empty()) {
+            return "";
+        }
+        auto found = CodecRegistry::getInstance().findByName(codec);
+        if (!found) {
+            DB_THROW(StorageError, "Unknown chunk codec: " + codec);
+        }
+        return found->extension();
+    }
+}
+
+// flock held for the lifetime of the object
+class ChunkStore::Lock {
+public:
+    /// Blocks for the lock unless operation includes LOCK_NB, in which case
+    /// held() tells whether it was free
+    Lock(const std::string& path, int operation) {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            DB_THROW(StorageError, "Failed to open chunk store lock: " + path + ": " + std::strerror(errno));
+        }
+        while (::flock(fd, operation) != 0) {
+            if (errno == EWOULDBLOCK) {
+                return;
+            }
+            if (errno != EINTR) {
+                std::string error = std::strerror(errno);
+                ::close(fd);
+                DB_THROW(StorageError, "Failed to lock chunk store: " + path + ": " + error);
+            }
+        }
+        locked = true;
+    }
+
+    ~Lock() {
+        if (locked) {
+            ::flock(fd, LOCK_UN);
+        }
+        ::close(fd);
+    }
+
+    Lock(const Lock&) = delete;
+    Lock& operator=(const Lock&) = delete;
+
+    bool held() const { return locked; }
+
+private:
+    int fd = -1;
+    bool locked = false;
+};
+
+FastCdc::FastCdc(size_t minSize, size_t avgSize, size_t maxSize)
+    : minimum(minSize)
+    , average(avgSize)
+    , maximum(maxSize) {
+    DB_CHECK(minSize > 0 && minSize <= avgSize && avgSize <= maxSize, ValidationError,
+             "Chunk sizes must satisfy 0 < min <= avg <= max");
+    // Normalized chunking: two bits harder to match before the average
+    // size, two bits easier after it
+    unsigned bits = log2Floor(avgSize);
+    smallMask = topBits(std::min(bits + 2, 64u));
+    largeMask = topBits(bits > 2 ? bits - 2 : 1);
+}
+
+size_t FastCdc::cut(const unsigned char* data, size_t size) const {
+    if (size <= minimum) {
+        return size;
+    }
+    size_t limit = std::min(size, maximum);
+    size_t normal = std::min(limit, average);
+
+    uint64_t hash = 0;
+    size_t i = minimum;
+    for (; i < normal; i++) {
+        hash = (hash << 1) + GEAR.values[data[i]];
+        if ((hash & smallMask) == 0) {
+            return i + 1;
+        }
+    }
+    for (; i < limit; i++) {
+        hash = (hash << 1) + GEAR.values[data[i]];
+        if ((hash & largeMask) == 0) {
+            return i + 1;
+        }
+    }
+    return limit;
+}
+
+ChunkStore::ChunkStore(const std::string& root) : root(root) {
+}
+
+bool ChunkStore::isManifest(const std::string& path) {
+    return fs::path(path).extension() == MANIFEST_EXTENSION;
+}
+
+std::string ChunkStore::chunkPath(const std::string& hash, const std::string& extension) const {
+    return (fs::path(root) / "chunks" / hash.substr(0, 2) / (hash + extension)).string();
+}
+
+std::string ChunkStore::lockPath() const {
+    return (fs::path(root) / "chunks.lock").string();
+}
+
+std::unique_ptr<ChunkStore::Writer> ChunkStore::createWriter(const std::string& manifestPath,
+                                                             const Compressor* compressor) const {
+    return std::unique_ptr<Writer>(new Writer(*this, manifestPath, compressor));
+}
+
+ChunkStore::Writer::Writer(const ChunkStore& store, std::string manifestPath, const Compressor* compressor)
+    : store(store)
+    , manifestPath(std::move(manifestPath))
+    , compressor(compressor) {
+    fs::create_directories(store.root);
+    lock = std::make_unique<Lock>(store.lockPath(), LOCK_SH);
+    manifest.codec = compressor ? compressor->getCodec().name() : "";
+}
+
+ChunkStore::Writer::~Writer() = default;
+
+void ChunkStore::Writer::write(const char* data, size_t size) {
+    pending.append(data, size);
+    counters.bytes += size;
+    if (pending.size() - pendingOffset >= 2 * chunker.maxSize()) {
+        storeChunks(false);
+    }
+}
+
+void ChunkStore::Writer::storeChunks(bool final) {
+    std::string extension = codecExtension(manifest.codec);
+    // Until the end of the stream a cut is only final with maxSize bytes
+    // available, so boundaries do not depend on how the dump was written
+    while (pending.size() > pendingOffset &&
+           (final || pending.size() - pendingOffset >= chunker.maxSize())) {
+        const char* chunk = pending.data() + pendingOffset;
+        size_t size = chunker.cut(reinterpret_cast<const unsigned char*>(chunk),
+                                  pending.size() - pendingOffset);
+        pendingOffset += size;
+
+        ChunkRef ref;
+        ref.hash = checksum::sha256(chunk, size);
+        ref.size = size;
+        manifest.chunks.push_back(ref);
+        manifest.size += size;
+        counters.chunks++;
+
+        std::string path = store.chunkPath(ref.hash, extension);
+        if (fs::exists(path)) {
+            continue;
+        }
+        StringSink encoded;
+        if (compressor) {
+            auto encoder = compressor->createEncoder(encoded);
+            encoder->write(chunk, size);
+            encoder->finish();
+        } else {
+            encoded.write(chunk, size);
+        }
+        fs::create_directories(fs::path(path).parent_path());
+        writeFileAtomically(path, encoded.str());
+        counters.newChunks++;
+        counters.storedBytes += encoded.str().size();
+    }
+    pending.erase(0, pendingOffset);
+    pendingOffset = 0;
+}
+
+void ChunkStore::Writer::finish() {
+    if (finished) {
+        return;
+    }
+    storeChunks(true);
+
+    std::ostringstream out;
+    out << MANIFEST_MAGIC << "\n";
+    out << "codec " << manifest.codec << "\n";
+    out << "size " << manifest.size << "\n";
+    for (const auto& chunk : manifest.chunks) {
+        out << chunk.hash << " " << chunk.size << "\n";
+    }
+    writeFileAtomically(manifestPath, out.str());
+    finished = true;
+}
+
+ChunkManifest ChunkStore::readManifest(const std::string& manifestPath) {
+    std::ifstream file(manifestPath);
+    if (!file) {
+        DB_THROW(StorageError, "Failed to open chunk manifest: " + manifestPath);
+    }
+
+    ChunkManifest manifest;
+    std::string line;
+    if (!std::getline(file, line) || line != MANIFEST_MAGIC) {
+        DB_THROW(StorageError, "Not a chunk manifest: " + manifestPath);
+    }
+    if (!std::getline(file, line) || line.rfind("codec ", 0) != 0) {
+        DB_THROW(StorageError, "Malformed chunk manifest: " + manifestPath);
+    }
+    manifest.codec = line.substr(6);
+    if (!std::getline(file, line) || line.rfind("size ", 0) != 0) {
+        DB_THROW(StorageError, "Malformed chunk manifest: " + manifestPath);
+    }
+    uint64_t expectedSize = std::stoull(line.substr(5));
+
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        ChunkRef chunk;
+        if (!(fields >> chunk.hash >> chunk.size) || chunk.hash.size() != 64) {
+            DB_THROW(StorageError, "Malformed chunk manifest: " + manifestPath);
+        }
+        manifest.size += chunk.size;
+        manifest.chunks.push_back(chunk);
+    }
+    if (manifest.size != expectedSize) {
+        DB_THROW(StorageError, "Truncated chunk manifest: " + manifestPath);
+    }
+    return manifest;
+}
+
+void ChunkStore::restore(const std::string& manifestPath, OutputSink& sink,
+                         const CompressionConfig& compression) const {
+    ChunkManifest manifest = readManifest(manifestPath);
+    std::string extension = codecExtension(manifest.codec);
+    std::unique_ptr<Compressor> decompressor;
+    if (!manifest.codec.empty()) {
+        decompressor = std::make_unique<Compressor>(
+            CodecRegistry::getInstance().findByName(manifest.codec), compression);
+    }
+
+    for (const auto& chunk : manifest.chunks) {
+        std::string path = chunkPath(chunk.hash, extension);
+        FileSource file(path);
+        if (!file) {
+            DB_THROW(StorageError, "Missing chunk " + chunk.hash + " of " + manifestPath);
+        }
+        StringSink decoded;
+        if (decompressor) {
+            try {
+                auto decoder = decompressor->createDecoder(decoded);
+                copyStream(file, *decoder);
+                decoder->finish();
+            } catch (const CompressionError&) {
+                DB_THROW(StorageError, "Damaged chunk " + chunk.hash + " of " + manifestPath);
+            }
+        } else {
+            copyStream(file, decoded);
+        }
+        const std::string& data = decoded.str();
+        if (data.size() != chunk.size || checksum::sha256(data.data(), data.size()) != chunk.hash) {
+            DB_THROW(StorageError, "Damaged chunk " + chunk.hash + " of " + manifestPath);
+        }
+        sink.write(data.data(), data.size());
+    }
+    sink.finish();
+}
+
+bool ChunkStore::restoreFile(const std::string& manifestPath, const std::string& outputPath,
+                             const CompressionConfig& compression) const {
+    DB_TRY_CATCH_LOG("ChunkStore", {
+        FileSink file(outputPath);
+        if (!file) {
+            DB_THROW(StorageError, "Failed to create file: " + outputPath);
+        }
+        restore(manifestPath, file, compression);
+        return true;
+    });
+    return false;
+}
+
+size_t ChunkStore::collectGarbage() const {
+    fs::path chunks = fs::path(root) / "chunks";
+    if (!fs::exists(chunks)) {
+        return 0;
+    }
+
+    // A writer may have found a chunk already stored that only its
+    // unwritten manifest will reference
+    Lock exclusive(lockPath(), LOCK_EX | LOCK_NB);
+    if (!exclusive.held()) {
+        return 0;
+    }
+
+    // Never collect anything if a manifest cannot be read: its chunks
+    // would be lost
+    std::set<std::string> referenced;
+    for (const auto& entry : fs::directory_iterator(root)) {
+        if (entry.is_regular_file() && isManifest(entry.path().string())) {
+            for (const auto& chunk : readManifest(entry.path().string()).chunks) {
+                referenced.insert(chunk.hash);
+            }
+        }
+    }
+
+    std::vector<fs::path> unreferenced;
+    for (const auto& entry : fs::recursive_directory_iterator(chunks)) {
+        if (!entry.is_regular_file()) {
+            continue;
+        }
+        // The hash is the first 64 characters, before any codec extension
+        std::string name = entry.path().filename().string();
+        if (name.size() >= 64 && referenced.count(name.substr(0, 64)) == 0 &&
+            name.find(".tmp") == std::string::npos) {
+            unreferenced.push_back(entry.path());
+        }
+    }
+    for (const auto& path : unreferenced) {
+        fs::remove(path);
+    }
+    return unreferenced.size();
+}
+
+} // namespace dbbackup
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "config.hpp"
+#include "stream.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dbbackup {
+
+class Compressor;
+
+/// FastCDC content-defined chunking: cut points depend only on the last 64
+/// bytes before them, so an insertion or deletion moves the boundaries next
+/// to it and leaves the rest of the stream's chunks unchanged. Chunk sizes
+/// are normalized towards avgSize and always within [minSize, maxSize].
+class FastCdc {
+public:
+    static constexpr size_t DEFAULT_MIN_SIZE = 16384;   // 16KB
+    static constexpr size_t DEFAULT_AVG_SIZE = 65536;   // 64KB, a power of two
+    static constexpr size_t DEFAULT_MAX_SIZE = 262144;  // 256KB
+
+    explicit FastCdc(size_t minSize = DEFAULT_MIN_SIZE,
+                     size_t avgSize = DEFAULT_AVG_SIZE,
+                     size_t maxSize = DEFAULT_MAX_SIZE);
+
+    /// Length of the chunk starting at data. size is what is available; the
+    /// result only equals size without a cut point if size <= maxSize, so
+    /// callers streaming data keep at least maxSize bytes buffered until the
+    /// end of the stream.
+    size_t cut(const unsigned char* data, size_t size) const;
+
+    size_t maxSize() const { return maximum; }
+
+private:
+    size_t minimum;
+    size_t average;
+    size_t maximum;
+    uint64_t smallMask;  // Harder to match, used below average
+    uint64_t largeMask;  // Easier to match, used above average
+};
+
+/// One chunk of a backup, addressed by the SHA-256 of its content
+struct ChunkRef {
+    std::string hash;  // Hex
+    uint64_t size = 0;
+};
+
+/// A deduplicated backup: the chunks that make up the dump, in order
+struct ChunkManifest {
+    std::string codec;  // Codec the chunks were stored with, empty if raw
+    uint64_t size = 0;  // Dump size
+    std::vector<ChunkRef> chunks;
+};
+
+struct ChunkStoreStats {
+    uint64_t chunks = 0;
+    uint64_t newChunks = 0;
+    uint64_t bytes = 0;         // Dump bytes written
+    uint64_t storedBytes = 0;   // Bytes written to new chunk files
+};
+
+/// Deduplicating store for dumps. Dumps are split with FastCdc and each
+/// distinct chunk is stored once, compressed on its own, under
+/// <root>/chunks/<first two hex digits>/<hash><codec extension>. A backup is
+/// a manifest file listing its chunks; chunks no manifest references are
+/// removed by collectGarbage. Files are renamed into place complete but not
+/// synced one by one: callers flush the filesystem once (syncFilesystem)
+/// before cataloguing a backup.
+///
+/// Writers and collectGarbage coordinate with flock on <root>/chunks.lock,
+/// also across processes: each writer holds it shared from creation until
+/// destroyed, and a collection runs only while it can take it exclusively.
+class ChunkStore {
+private:
+    class Lock;
+
+public:
+    /// Extension of manifest files, which stand in for the archive
+    static constexpr const char* MANIFEST_EXTENSION = ".chunks";
+
+    explicit ChunkStore(const std::string& root);
+
+    /// True if path names a manifest rather than an archive
+    static bool isManifest(const std::string& path);
+
+    /// Streaming writer: the dump written to it is chunked into the store,
+    /// and finishing it writes the manifest to manifestPath. compressor may
+    /// be null to store chunks raw; it must outlive the writer.
+    class Writer : public OutputSink {
+    public:
+        ~Writer() override;
+
+        void write(const char* data, size_t size) override;
+        void finish() override;
+
+        const ChunkStoreStats& stats() const { return counters; }
+
+    private:
+        friend class ChunkStore;
+        Writer(const ChunkStore& store, std::string manifestPath, const Compressor* compressor);
+
+        void storeChunks(bool final);
+
+        const ChunkStore& store;
+        // Keeps collectGarbage from removing chunks this writer found
+        // stored before its manifest lists them
+        std::unique_ptr<Lock> lock;
+        std::string manifestPath;
+        const Compressor* compressor;
+        FastCdc chunker;
+        std::string pending;
+        size_t pendingOffset = 0;
+        ChunkManifest manifest;
+        ChunkStoreStats counters;
+        bool finished = false;
+    };
+
+    std::unique_ptr<Writer> createWriter(const std::string& manifestPath, const Compressor* compressor) const;
+
+    /// Writes the dump a manifest describes to sink and finishes it. Each
+    /// chunk is checked against its hash; throws StorageError if one is
+    /// missing or damaged. compression supplies decoder settings (threads).
+    void restore(const std::string& manifestPath, OutputSink& sink, const CompressionConfig& compression) const;
+
+    /// restore() into a file. Returns false on failure instead of throwing.
+    bool restoreFile(const std::string& manifestPath, const std::string& outputPath,
+                     const CompressionConfig& compression) const;
+
+    /// Reads a manifest. Throws StorageError if it is unreadable or malformed.
+    static ChunkManifest readManifest(const std::string& manifestPath);
+
+    /// Removes chunks not referenced by any manifest in the root directory.
+    /// Returns the number of chunk files removed. Does nothing, returning 0,
+    /// while a writer is open; the next collection removes them.
+    size_t collectGarbage() const;
+
+private:
+    std::string chunkPath(const std::string& hash, const std::string& extension) const;
+    std::string lockPath() const;
+
+    std::string root;
+};
+
+} // namespace dbbackup
@@ -0,0 +1,104 @@
+#include "codec_registry.hpp"
+#include "codecs/gzip_codec.hpp"
+#include "codecs/bzip2_codec.hpp"
+#include "codecs/xz_codec.hpp"
+#include "codecs/block_framed_codec.hpp"
+#ifdef USE_ZSTD
+#include "codecs/zstd_codec.hpp"
+#endif
+#include "error/ErrorUtils.hpp"
+#include <algorithm>
+#include <fstream>
+
+using namespace dbbackup::error;
+
+namespace dbbackup {
+
+CodecRegistry& CodecRegistry::getInstance() {
+    static CodecRegistry instance;
+    return instance;
+}
+
+CodecRegistry::CodecRegistry() {
+    codecs.push_back(std::make_shared<GzipCodec>());
+    codecs.push_back(std::make_shared<Bzip2Codec>());
+    codecs.push_back(std::make_shared<XzCodec>());
+#ifdef USE_ZSTD
+    codecs.push_back(std::make_shared<ZstdCodec>());
+#endif
+    // Block containers name their inner codec, so any of them decodes
+    // through this instance; encoding wraps gzip blocks
+    codecs.push_back(std::make_shared<BlockFramedCodec>(codecs.front()));
+}
+
+void CodecRegistry::registerCodec(std::shared_ptr<const Codec> codec) {
+    DB_CHECK(codec != nullptr, ValidationError, "Cannot register a null codec");
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = std::find_if(codecs.begin(), codecs.end(),
+                           [&](const auto& existing) { return existing->name() == codec->name(); });
+    if (it != codecs.end()) {
+        *it = std::move(codec);
+    } else {
+        codecs.push_back(std::move(codec));
+    }
+}
+
+std::shared_ptr<const Codec> CodecRegistry::findByName(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& codec : codecs) {
+        if (codec->name() == name) {
+            return codec;
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<const Codec> CodecRegistry::findByExtension(const std::string& path) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& codec : codecs) {
+        std::string ext = codec->extension();
+        if (path.size() > ext.size() && path.compare(path.size() - ext.size(), ext.size(), ext) == 0) {
+            return codec;
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<const Codec> CodecRegistry::detect(const unsigned char* header, size_t size) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& codec : codecs) {
+        if (codec->matchesHeader(header, size)) {
+            return codec;
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<const Codec> CodecRegistry::detectFile(const std::string& path,
+                                                      const std::string& recordedName) const {
+    if (!recordedName.empty()) {
+        if (auto recorded = findByName(recordedName)) {
+            return recorded;
+        }
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        DB_THROW(CompressionError, "Failed to open file for format detection: " + path);
+    }
+
+    unsigned char header[HEADER_PROBE_SIZE] = {};
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    return detect(header, static_cast<size_t>(file.gcount()));
+}
+
+std::vector<std::string> CodecRegistry::names() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::string> result;
+    for (const auto& codec : codecs) {
+        result.push_back(codec->name());
+    }
+    return result;
+}
+
+} // namespace dbbackup
@@ -0,0 +1,165 @@
+#include "codec_selector.hpp"
+#include "codec_registry.hpp"
+#include "codecs/block_framed_codec.hpp"
+#include "error/ErrorUtils.hpp"
+#include "logging.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace dbbackup::error;
+
+namespace dbbackup {
+
+namespace {
+    constexpr size_t SAMPLE_BLOCK_SIZE = 131072;  // 128KB per sampled block
+    constexpr size_t SAMPLE_BLOCKS = 8;
+    constexpr double RATIO_TOLERANCE = 0.01;      // Ratios this close count as equal
+
+    // Built-in codecs tried by "auto", cheapest first
+    const char* const CANDIDATE_FORMATS[] = {"zstd", "gzip", "xz", "bzip2"};
+
+    const CompressionLevel CANDIDATE_LEVELS[] = {
+        CompressionLevel::Low, CompressionLevel::Medium, CompressionLevel::High
+    };
+
+    /// Evenly spaced blocks from data, or all of it if it is small
+    std::string buildSample(const char* data, size_t size) {
+        if (size <= SAMPLE_BLOCK_SIZE * SAMPLE_BLOCKS) {
+            return std::string(data, size);
+        }
+        std::string sample;
+        sample.reserve(SAMPLE_BLOCK_SIZE * SAMPLE_BLOCKS);
+        size_t stride = (size - SAMPLE_BLOCK_SIZE) / (SAMPLE_BLOCKS - 1);
+        for (size_t i = 0; i < SAMPLE_BLOCKS; i++) {
+            sample.append(data + i * stride, SAMPLE_BLOCK_SIZE);
+        }
+        return sample;
+    }
+}
+
+CodecSelector::CodecSelector(const CompressionConfig& config)
+    : config(config) {
+    auto& registry = CodecRegistry::getInstance();
+    for (const char* format : CANDIDATE_FORMATS) {
+        if (auto codec = registry.findByName(format)) {
+            candidates.push_back(codec);
+        }
+    }
+    DB_CHECK(!candidates.empty(), ConfigurationError, "No compression codecs available for auto selection");
+}
+
+CodecTrial CodecSelector::runTrial(std::shared_ptr<const Codec> codec, CompressionLevel level,
+                                   const std::string& sample) const {
+    CodecOptions options;
+    options.level = level;
+    options.threads = ThreadPool::resolveThreadCount(config.threads);
+    options.longDistance = config.longDistance;
+
+    CountingSink counter;
+    auto start = std::chrono::steady_clock::now();
+    auto encoder = codec->createEncoder(counter, options);
+    encoder->write(sample.data(), sample.size());
+    encoder->finish();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    CodecTrial trial;
+    trial.codec = std::move(codec);
+    trial.level = level;
+    trial.ratio = sample.empty() ? 1.0
+        : static_cast<double>(counter.bytesWritten()) / static_cast<double>(sample.size());
+    double seconds = std::max(elapsed.count(), 1e-6);
+    trial.throughputMBps = static_cast<double>(sample.size()) / (1024.0 * 1024.0) / seconds;
+    return trial;
+}
+
+std::vector<CodecTrial> CodecSelector::evaluate(const char* data, size_t size) const {
+    std::string sample = buildSample(data, size);
+    std::vector<CodecTrial> trials;
+    for (const auto& codec : candidates) {
+        for (CompressionLevel level : CANDIDATE_LEVELS) {
+            trials.push_back(runTrial(codec, level, sample));
+            // Higher levels are only slower, skip them once the target is missed
+            if (trials.back().throughputMBps < config.targetThroughputMBps) {
+                break;
+            }
+        }
+    }
+    return trials;
+}
+
+CodecTrial CodecSelector::select(const char* data, size_t size) const {
+    std::vector<CodecTrial> trials = evaluate(data, size);
+
+    const CodecTrial* best = nullptr;
+    for (const auto& trial : trials) {
+        if (trial.throughputMBps < config.targetThroughputMBps) {
+            continue;
+        }
+        if (!best || trial.ratio < best->ratio - RATIO_TOLERANCE ||
+            (std::fabs(trial.ratio - best->ratio) <= RATIO_TOLERANCE &&
+             trial.throughputMBps > best->throughputMBps)) {
+            best = &trial;
+        }
+    }
+
+    if (!best) {
+        // Nothing meets the target, favour speed
+        best = &*std::max_element(trials.begin(), trials.end(),
+            [](const CodecTrial& a, const CodecTrial& b) { return a.throughputMBps < b.throughputMBps; });
+    }
+    return *best;
+}
+
+AutoSelectingEncoder::AutoSelectingEncoder(OutputSink& downstream, const CompressionConfig& config)
+    : downstream(downstream)
+    , config(config)
+    , sampleSize(static_cast<size_t>(config.sampleSizeMB) * 1024 * 1024) {
+}
+
+void AutoSelectingEncoder::write(const char* data, size_t size) {
+    if (encoder) {
+        encoder->write(data, size);
+        return;
+    }
+
+    size_t take = std::min(size, sampleSize - buffer.size());
+    buffer.append(data, take);
+    if (buffer.size() < sampleSize) {
+        return;
+    }
+
+    selectAndReplay();
+    if (take < size) {
+        encoder->write(data + take, size - take);
+    }
+}
+
+void AutoSelectingEncoder::finish() {
+    if (!encoder) {
+        selectAndReplay();
+    }
+    encoder->finish();
+}
+
+void AutoSelectingEncoder::selectAndReplay() {
+    CodecSelector selector(config);
+    selected = selector.select(buffer.data(), buffer.size());
+
+    getLogger()->info("Auto compression selected {} ({}): ratio {:.3f}, {:.1f} MB/s on sample",
+                      selected->codec->name(), levelToString(selected->level),
+                      selected->ratio, selected->throughputMBps);
+    selected->codec = BlockFramedCodec::wrap(selected->codec, config);
+
+    CodecOptions options;
+    options.level = selected->level;
+    options.threads = ThreadPool::resolveThreadCount(config.threads);
+    options.longDistance = config.longDistance;
+    encoder = selected->codec->createEncoder(downstream, options);
+
+    encoder->write(buffer.data(), buffer.size());
+    std::string().swap(buffer);
+}
+
+} // namespace dbbackup
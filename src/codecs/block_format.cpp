@@ -0,0 +1,162 @@
+#include "codecs/block_format.hpp"
+#include "checksum.hpp"
+#include "error/ErrorUtils.hpp"
+#include <cstring>
+
+using namespace dbbackup::error;
+
+namespace dbbackup {
+namespace blockformat {
+
+void putU32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+void putU64(std::string& out, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+uint32_t getU32(const char* in) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value |= static_cast<uint32_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    }
+    return value;
+}
+
+uint64_t getU64(const char* in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    }
+    return value;
+}
+
+uint32_t crc(const char* data, size_t size) {
+    return checksum::crc32(data, size);
+}
+
+std::string encodeHeader(const std::string& codecName, uint32_t blockSize) {
+    std::string header(MAGIC, sizeof(MAGIC));
+    header.push_back(static_cast<char>(VERSION));
+    header.push_back(static_cast<char>(codecName.size()));
+    header.append(codecName);
+    putU32(header, blockSize);
+    return header;
+}
+
+size_t decodeHeader(const char* data, size_t size, std::string& codecName, uint32_t& blockSize) {
+    if (size < sizeof(MAGIC) + 2) {
+        return 0;
+    }
+    if (std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0) {
+        DB_THROW(CompressionError, "Not a block container");
+    }
+    if (static_cast<uint8_t>(data[4]) != VERSION) {
+        DB_THROW(CompressionError, "Unsupported block container version");
+    }
+    size_t nameLength = static_cast<unsigned char>(data[5]);
+    size_t headerSize = sizeof(MAGIC) + 2 + nameLength + 4;
+    if (size < headerSize) {
+        return 0;
+    }
+    codecName.assign(data + 6, nameLength);
+    blockSize = getU32(data + 6 + nameLength);
+    return headerSize;
+}
+
+void encodeBlockHeader(std::string& out, const BlockHeader& header) {
+    putU32(out, header.rawSize);
+    putU32(out, header.storedSize);
+    out.push_back(static_cast<char>(header.flags));
+    putU32(out, header.crc);
+}
+
+BlockHeader decodeBlockHeader(const char* data) {
+    BlockHeader header;
+    header.rawSize = getU32(data);
+    header.storedSize = getU32(data + 4);
+    header.flags = static_cast<uint8_t>(data[8]);
+    header.crc = getU32(data + 9);
+    return header;
+}
+
+void validateBlockHeader(const BlockHeader& header, uint32_t blockSize) {
+    if (header.rawSize > blockSize || header.storedSize > header.rawSize ||
+        (header.flags != FLAG_RAW && header.flags != FLAG_COMPRESSED) ||
+        (header.flags == FLAG_RAW && header.storedSize != header.rawSize)) {
+        DB_THROW(CompressionError, "Corrupted block header");
+    }
+}
+
+std::string decodeBlock(const Codec& inner, const BlockHeader& header, const char* stored,
+                        const std::string* dictionary) {
+    std::string raw;
+    if (header.flags == FLAG_RAW) {
+        raw.assign(stored, header.storedSize);
+    } else {
+        StringSink decoded;
+        auto decoder = dictionary ? inner.createDictionaryDecoder(decoded, *dictionary, 1)
+                                  : inner.createDecoder(decoded);
+        decoder->write(stored, header.storedSize);
+        decoder->finish();
+        raw = decoded.release();
+    }
+    if (raw.size() != header.rawSize || crc(raw.data(), raw.size()) != header.crc) {
+        DB_THROW(CompressionError, "Block checksum mismatch");
+    }
+    return raw;
+}
+
+std::string encodeIndex(const std::vector<IndexEntry>& entries) {
+    std::string index;
+    index.reserve(entries.size() * INDEX_ENTRY_SIZE);
+    for (const auto& entry : entries) {
+        putU64(index, entry.fileOffset);
+        putU64(index, entry.rawOffset);
+        putU32(index, entry.rawSize);
+        putU32(index, entry.storedSize);
+    }
+    return index;
+}
+
+std::vector<IndexEntry> decodeIndex(const char* data, uint32_t count) {
+    std::vector<IndexEntry> entries(count);
+    for (uint32_t i = 0; i < count; i++) {
+        const char* p = data + static_cast<size_t>(i) * INDEX_ENTRY_SIZE;
+        entries[i].fileOffset = getU64(p);
+        entries[i].rawOffset = getU64(p + 8);
+        entries[i].rawSize = getU32(p + 16);
+        entries[i].storedSize = getU32(p + 20);
+    }
+    return entries;
+}
+
+std::string encodeFooter(const Footer& footer) {
+    std::string out;
+    putU64(out, footer.indexOffset);
+    putU64(out, footer.rawSize);
+    putU32(out, footer.blockCount);
+    putU32(out, footer.indexCrc);
+    out.append(FOOTER_MAGIC, sizeof(FOOTER_MAGIC));
+    return out;
+}
+
+Footer decodeFooter(const char* data) {
+    if (std::memcmp(data + FOOTER_SIZE - sizeof(FOOTER_MAGIC), FOOTER_MAGIC, sizeof(FOOTER_MAGIC)) != 0) {
+        DB_THROW(CompressionError, "Block container index footer missing");
+    }
+    Footer footer;
+    footer.indexOffset = getU64(data);
+    footer.rawSize = getU64(data + 8);
+    footer.blockCount = getU32(data + 16);
+    footer.indexCrc = getU32(data + 20);
+    return footer;
+}
+
+} // namespace blockformat
+} // namespace dbbackup
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "../../include/compression.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dbbackup {
+namespace blockformat {
+
+/// On-disk layout of the block container, shared by the streaming codec and
+/// the random-access reader. Integers are little-endian.
+///
+///   header:  "HGBK", u8 version, u8 name length, inner codec name, u32 block size
+///   block:   u32 raw size, u32 stored size, u8 flags, u32 CRC-32 of raw bytes, stored bytes
+///   end:     a block header with raw and stored size 0
+///   index:   per block u64 file offset, u64 raw offset, u32 raw size, u32 stored size
+///   footer:  u64 index offset, u64 total raw size, u32 block count,
+///            u32 CRC-32 of the index, "HGBX"
+
+const char MAGIC[4] = {'H', 'G', 'B', 'K'};
+const char FOOTER_MAGIC[4] = {'H', 'G', 'B', 'X'};
+constexpr uint8_t VERSION = 1;
+constexpr size_t BLOCK_HEADER_SIZE = 13;
+constexpr size_t INDEX_ENTRY_SIZE = 24;
+constexpr size_t FOOTER_SIZE = 28;
+constexpr size_t MAX_HEADER_SIZE = sizeof(MAGIC) + 2 + 255 + 4;
+constexpr uint8_t FLAG_RAW = 0;
+constexpr uint8_t FLAG_COMPRESSED = 1;
+
+struct BlockHeader {
+    uint32_t rawSize = 0;
+    uint32_t storedSize = 0;
+    uint8_t flags = FLAG_RAW;
+    uint32_t crc = 0;
+
+    bool isEnd() const { return rawSize == 0 && storedSize == 0; }
+};
+
+struct IndexEntry {
+    uint64_t fileOffset = 0;   // Offset of the block header in the container
+    uint64_t rawOffset = 0;    // Offset of the block's first byte in the decoded stream
+    uint32_t rawSize = 0;
+    uint32_t storedSize = 0;
+};
+
+struct Footer {
+    uint64_t indexOffset = 0;
+    uint64_t rawSize = 0;
+    uint32_t blockCount = 0;
+    uint32_t indexCrc = 0;
+};
+
+void putU32(std::string& out, uint32_t value);
+void putU64(std::string& out, uint64_t value);
+uint32_t getU32(const char* in);
+uint64_t getU64(const char* in);
+
+uint32_t crc(const char* data, size_t size);
+
+/// Container header naming the inner codec
+std::string encodeHeader(const std::string& codecName, uint32_t blockSize);
+
+/// Parses a container header from data. Returns its size, or 0 if more bytes
+/// are needed. Throws CompressionError if it is not a supported container.
+size_t decodeHeader(const char* data, size_t size, std::string& codecName, uint32_t& blockSize);
+
+void encodeBlockHeader(std::string& out, const BlockHeader& header);
+BlockHeader decodeBlockHeader(const char* data);
+
+/// Throws CompressionError for sizes a valid encoder cannot produce
+void validateBlockHeader(const BlockHeader& header, uint32_t blockSize);
+
+/// Decodes and verifies one block's stored bytes. dictionary is the preset
+/// dictionary the blocks were compressed with, null for none.
+std::string decodeBlock(const Codec& inner, const BlockHeader& header, const char* stored,
+                        const std::string* dictionary = nullptr);
+
+std::string encodeIndex(const std::vector<IndexEntry>& entries);
+std::vector<IndexEntry> decodeIndex(const char* data, uint32_t count);
+
+std::string encodeFooter(const Footer& footer);
+
+/// Throws CompressionError if data does not end with a valid footer
+Footer decodeFooter(const char* data);
+
+} // namespace blockformat
+} // namespace dbbackup
@@ -0,0 +1,410 @@
+#include "codecs/block_framed_codec.hpp"
+#include "codecs/block_format.hpp"
+#include "codec_registry.hpp"
+#include "error/ErrorUtils.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <string>
+#include <vector>
+
+using namespace dbbackup::error;
+
+namespace dbbackup {
+
+namespace {
+    /// One block as written to the container, header included
+    struct EncodedBlock {
+        std::string bytes;
+        uint32_t rawSize = 0;
+    };
+
+    EncodedBlock encodeBlock(const Codec& inner, const CodecOptions& options,
+                             double minBlockSavings, const std::string& raw) {
+        StringSink compressed;
+        auto encoder = inner.createEncoder(compressed, options);
+        encoder->write(raw.data(), raw.size());
+        encoder->finish();
+
+        // Not worth it: keep the raw bytes and skip decompression on restore
+        double limit = static_cast<double>(raw.size()) * (1.0 - minBlockSavings);
+        bool keepCompressed = static_cast<double>(compressed.str().size()) <= limit;
+        const std::string& stored = keepCompressed ? compressed.str() : raw;
+
+        blockformat::BlockHeader header;
+        header.rawSize = static_cast<uint32_t>(raw.size());
+        header.storedSize = static_cast<uint32_t>(stored.size());
+        header.flags = keepCompressed ? blockformat::FLAG_COMPRESSED : blockformat::FLAG_RAW;
+        header.crc = blockformat::crc(raw.data(), raw.size());
+
+        EncodedBlock block;
+        block.rawSize = header.rawSize;
+        block.bytes.reserve(blockformat::BLOCK_HEADER_SIZE + stored.size());
+        blockformat::encodeBlockHeader(block.bytes, header);
+        block.bytes.append(stored);
+        return block;
+    }
+
+    /// Splits the stream into blocks and writes them in order, followed by the
+    /// index. With more than one thread blocks are compressed on a pool,
+    /// bounded to 2x threads in flight.
+    class BlockFramedEncoder : public OutputSink {
+    public:
+        BlockFramedEncoder(OutputSink& downstream, std::shared_ptr<const Codec> inner,
+                           const CodecOptions& options, size_t blockSize, double minBlockSavings)
+            : downstream(downstream)
+            , inner(std::move(inner))
+            , innerOptions(options)
+            , blockSize(blockSize)
+            , minBlockSavings(minBlockSavings)
+            , maxInFlight(options.threads * 2) {
+            if (options.threads > 1) {
+                // Parallelism comes from the blocks, each one is encoded single-threaded
+                pool = std::make_unique<ThreadPool>(options.threads);
+                innerOptions.threads = 1;
+            }
+            pending.reserve(blockSize);
+            emit(blockformat::encodeHeader(this->inner->name(), static_cast<uint32_t>(blockSize)));
+        }
+
+        ~BlockFramedEncoder() override {
+            // Let outstanding jobs finish before their results are discarded
+            for (auto& job : inFlight) {
+                job.wait();
+            }
+        }
+
+        void write(const char* data, size_t size) override {
+            while (size > 0) {
+                size_t n = std::min(size, blockSize - pending.size());
+                pending.append(data, n);
+                data += n;
+                size -= n;
+                if (pending.size() == blockSize) {
+                    submitBlock();
+                }
+            }
+        }
+
+        void finish() override {
+            if (finished) {
+                return;
+            }
+            if (!pending.empty()) {
+                submitBlock();
+            }
+            while (!inFlight.empty()) {
+                writeOldestBlock();
+            }
+
+            std::string end;
+            blockformat::encodeBlockHeader(end, blockformat::BlockHeader());
+            emit(end);
+
+            blockformat::Footer footer;
+            footer.indexOffset = offset;
+            footer.rawSize = rawOffset;
+            footer.blockCount = static_cast<uint32_t>(index.size());
+            std::string indexBytes = blockformat::encodeIndex(index);
+            footer.indexCrc = blockformat::crc(indexBytes.data(), indexBytes.size());
+            emit(indexBytes);
+            emit(blockformat::encodeFooter(footer));
+
+            finished = true;
+            downstream.finish();
+        }
+
+    private:
+        void emit(const std::string& bytes) {
+            downstream.write(bytes.data(), bytes.size());
+            offset += bytes.size();
+        }
+
+        void submitBlock() {
+            std::string block;
+            block.swap(pending);
+            pending.reserve(blockSize);
+
+            if (!pool) {
+                writeBlock(encodeBlock(*inner, innerOptions, minBlockSavings, block));
+                return;
+            }
+
+            std::shared_ptr<const Codec> codec = inner;
+            CodecOptions options = innerOptions;
+            double savings = minBlockSavings;
+            inFlight.push_back(pool->submit(
+                [codec, options, savings, block = std::move(block)]() {
+                    return encodeBlock(*codec, options, savings, block);
+                }));
+
+            // Bound memory: wait for the oldest block once enough are queued
+            while (inFlight.size() >= maxInFlight) {
+                writeOldestBlock();
+            }
+        }
+
+        void writeOldestBlock() {
+            std::future<EncodedBlock> job = std::move(inFlight.front());
+            inFlight.pop_front();
+            writeBlock(job.get());
+        }
+
+        void writeBlock(const EncodedBlock& block) {
+            blockformat::IndexEntry entry;
+            entry.fileOffset = offset;
+            entry.rawOffset = rawOffset;
+            entry.rawSize = block.rawSize;
+            entry.storedSize = static_cast<uint32_t>(block.bytes.size() - blockformat::BLOCK_HEADER_SIZE);
+            index.push_back(entry);
+
+            emit(block.bytes);
+            rawOffset += block.rawSize;
+        }
+
+        OutputSink& downstream;
+        std::shared_ptr<const Codec> inner;
+        CodecOptions innerOptions;
+        size_t blockSize;
+        double minBlockSavings;
+        size_t maxInFlight;
+        std::string pending;
+        std::unique_ptr<ThreadPool> pool;
+        std::deque<std::future<EncodedBlock>> inFlight;
+        std::vector<blockformat::IndexEntry> index;
+        uint64_t offset = 0;
+        uint64_t rawOffset = 0;
+        bool finished = false;
+    };
+
+    /// Parses the container incrementally and writes the decoded blocks
+    /// downstream in order. With more than one thread blocks are decoded on a
+    /// pool, at most 2x threads blocks in flight. The trailing index is
+    /// checked against the blocks seen.
+    class BlockFramedDecoder : public OutputSink {
+    public:
+        BlockFramedDecoder(OutputSink& downstream, size_t threads,
+                           std::shared_ptr<const std::string> dictionary)
+            : downstream(downstream)
+            , maxInFlight(threads * 2)
+            , dictionary(std::move(dictionary)) {
+            if (threads > 1) {
+                pool = std::make_unique<ThreadPool>(threads);
+            }
+        }
+
+        ~BlockFramedDecoder() override {
+            // Let outstanding jobs finish before their results are discarded
+            for (auto& job : inFlight) {
+                job.wait();
+            }
+        }
+
+        void write(const char* data, size_t size) override {
+            buffer.append(data, size);
+            size_t consumed = 0;
+            while (parse(consumed)) {
+            }
+            buffer.erase(0, consumed);
+            offset += consumed;
+        }
+
+        void finish() override {
+            if (finished) {
+                return;
+            }
+            if (state != State::Trailer) {
+                DB_THROW(CompressionError, "Incomplete or corrupted compressed data");
+            }
+            checkTrailer();
+            finished = true;
+            downstream.finish();
+        }
+
+    private:
+        enum class State { Header, Blocks, Trailer };
+
+        /// Handle one element at offset consumed, false if more input is needed
+        bool parse(size_t& consumed) {
+            const char* p = buffer.data() + consumed;
+            size_t available = buffer.size() - consumed;
+
+            switch (state) {
+                case State::Header: {
+                    std::string name;
+                    size_t headerSize = blockformat::decodeHeader(p, available, name, blockSize);
+                    if (headerSize == 0) {
+                        return false;
+                    }
+                    inner = CodecRegistry::getInstance().findByName(name);
+                    if (!inner) {
+                        DB_THROW(CompressionError, "Unknown codec in block container: " + name);
+                    }
+                    if (dictionary && !inner->supportsBlockDictionary()) {
+                        DB_THROW(CompressionError, "Codec does not support dictionaries: " + name);
+                    }
+                    consumed += headerSize;
+                    state = State::Blocks;
+                    return true;
+                }
+                case State::Blocks: {
+                    if (available < blockformat::BLOCK_HEADER_SIZE) {
+                        return false;
+                    }
+                    blockformat::BlockHeader header = blockformat::decodeBlockHeader(p);
+                    if (header.isEnd()) {
+                        while (!inFlight.empty()) {
+                            writeOldestBlock();
+                        }
+                        consumed += blockformat::BLOCK_HEADER_SIZE;
+                        indexOffset = offset + consumed;
+                        state = State::Trailer;
+                        return true;
+                    }
+                    // Reject sizes a valid encoder cannot produce before buffering them
+                    blockformat::validateBlockHeader(header, blockSize);
+                    if (available < blockformat::BLOCK_HEADER_SIZE + header.storedSize) {
+                        return false;
+                    }
+                    submitBlock(header, p + blockformat::BLOCK_HEADER_SIZE);
+                    rawSize += header.rawSize;
+                    blockCount++;
+                    consumed += blockformat::BLOCK_HEADER_SIZE + header.storedSize;
+                    return true;
+                }
+                case State::Trailer:
+                    // Index and footer, checked once the stream is complete
+                    if (available > trailerSize()) {
+                        DB_THROW(CompressionError, "Unexpected data after end of block container");
+                    }
+                    return false;
+            }
+            return false;
+        }
+
+        void submitBlock(const blockformat::BlockHeader& header, const char* stored) {
+            if (!pool) {
+                std::string raw = blockformat::decodeBlock(*inner, header, stored, dictionary.get());
+                downstream.write(raw.data(), raw.size());
+                return;
+            }
+
+            std::shared_ptr<const Codec> codec = inner;
+            std::shared_ptr<const std::string> preset = dictionary;
+            inFlight.push_back(pool->submit(
+                [codec, preset, header, payload = std::string(stored, header.storedSize)]() {
+                    return blockformat::decodeBlock(*codec, header, payload.data(), preset.get());
+                }));
+
+            // Bound memory: wait for the oldest block once enough are queued
+            while (inFlight.size() >= maxInFlight) {
+                writeOldestBlock();
+            }
+        }
+
+        void writeOldestBlock() {
+            std::future<std::string> job = std::move(inFlight.front());
+            inFlight.pop_front();
+            std::string raw = job.get();
+            downstream.write(raw.data(), raw.size());
+        }
+
+        size_t trailerSize() const {
+            return static_cast<size_t>(blockCount) * blockformat::INDEX_ENTRY_SIZE + blockformat::FOOTER_SIZE;
+        }
+
+        void checkTrailer() const {
+            if (buffer.size() != trailerSize()) {
+                DB_THROW(CompressionError, "Block container index is truncated or corrupted");
+            }
+            blockformat::Footer footer = blockformat::decodeFooter(buffer.data() + buffer.size() - blockformat::FOOTER_SIZE);
+            if (footer.indexOffset != indexOffset || footer.blockCount != blockCount ||
+                footer.rawSize != rawSize ||
+                footer.indexCrc != blockformat::crc(buffer.data(), buffer.size() - blockformat::FOOTER_SIZE)) {
+                DB_THROW(CompressionError, "Block container index does not match its blocks");
+            }
+        }
+
+        OutputSink& downstream;
+        size_t maxInFlight;
+        std::shared_ptr<const std::string> dictionary;
+        std::unique_ptr<ThreadPool> pool;
+        std::deque<std::future<std::string>> inFlight;
+        std::string buffer;
+        State state = State::Header;
+        std::shared_ptr<const Codec> inner;
+        uint32_t blockSize = 0;
+        uint64_t offset = 0;        // Container offset of buffer[0]
+        uint64_t indexOffset = 0;
+        uint64_t rawSize = 0;
+        uint32_t blockCount = 0;
+        bool finished = false;
+    };
+}
+
+BlockFramedCodec::BlockFramedCodec(std::shared_ptr<const Codec> inner, size_t blockSize,
+                                   double minBlockSavings)
+    : inner(std::move(inner))
+    , blockSize(blockSize)
+    , minBlockSavings(minBlockSavings) {
+    DB_CHECK(this->inner != nullptr, ConfigurationError, "Block container needs an inner codec");
+    DB_CHECK(blockSize > 0 && blockSize <= UINT32_MAX, ConfigurationError, "Invalid block size");
+}
+
+std::shared_ptr<const Codec> BlockFramedCodec::wrap(std::shared_ptr<const Codec> inner,
+                                                    const CompressionConfig& config) {
+    if (!config.blockFramed || inner->name() == "framed") {
+        return inner;
+    }
+    return std::make_shared<BlockFramedCodec>(std::move(inner),
+                                              static_cast<size_t>(config.blockSizeKB) * 1024,
+                                              config.minBlockSavings);
+}
+
+std::string BlockFramedCodec::name() const {
+    return "framed";
+}
+
+std::string BlockFramedCodec::extension() const {
+    return ".hgb";
+}
+
+bool BlockFramedCodec::matchesHeader(const unsigned char* header, size_t size) const {
+    return size >= sizeof(blockformat::MAGIC) &&
+           std::memcmp(header, blockformat::MAGIC, sizeof(blockformat::MAGIC)) == 0;
+}
+
+std::unique_ptr<OutputSink> BlockFramedCodec::createEncoder(OutputSink& downstream,
+                                                            const CodecOptions& options) const {
+    return std::make_unique<BlockFramedEncoder>(downstream, inner, options, blockSize, minBlockSavings);
+}
+
+std::unique_ptr<OutputSink> BlockFramedCodec::createDecoder(OutputSink& downstream) const {
+    return std::make_unique<BlockFramedDecoder>(downstream, 1, nullptr);
+}
+
+std::unique_ptr<OutputSink> BlockFramedCodec::createThreadedDecoder(OutputSink& downstream,
+                                                                    size_t threads) const {
+    return std::make_unique<BlockFramedDecoder>(downstream, threads, nullptr);
+}
+
+bool BlockFramedCodec::supportsDictionary() const {
+    return inner->supportsBlockDictionary();
+}
+
+std::unique_ptr<OutputSink> BlockFramedCodec::createDictionaryDecoder(OutputSink& downstream,
+                                                                      const std::string& dictionary,
+                                                                      size_t threads) const {
+    return std::make_unique<BlockFramedDecoder>(downstream, threads,
+                                                std::make_shared<const std::string>(dictionary));
+}
+
+std::string BlockFramedCodec::trainDictionary(const std::vector<std::string>& samples,
+                                              size_t maxSize) const {
+    return inner->trainDictionary(samples, maxSize);
+}
+
+} // namespace dbbackup
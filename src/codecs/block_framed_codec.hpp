@@ -0,0 +1,57 @@
+#pragma once
+
+#include "../../include/compression.hpp"
+#include "../../include/config.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dbbackup {
+
+/// Container of independently compressed blocks. Each block is compressed
+/// with an inner codec and kept only if it saves at least minBlockSavings of
+/// its raw size; otherwise it is stored raw, so incompressible data costs one
+/// compression attempt and no expansion beyond the block header. A trailing
+/// index makes archives seekable (see BlockArchiveReader); the layout is
+/// described in block_format.hpp.
+class BlockFramedCodec : public Codec {
+public:
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 1048576;  // 1MB
+    static constexpr double DEFAULT_MIN_SAVINGS = 0.05;    // Keep blocks compressed by >= 5%
+
+    explicit BlockFramedCodec(std::shared_ptr<const Codec> inner,
+                              size_t blockSize = DEFAULT_BLOCK_SIZE,
+                              double minBlockSavings = DEFAULT_MIN_SAVINGS);
+
+    /// inner wrapped in a container if config.blockFramed is set, else inner
+    static std::shared_ptr<const Codec> wrap(std::shared_ptr<const Codec> inner,
+                                             const CompressionConfig& config);
+
+    std::string name() const override;
+    std::string extension() const override;
+    bool matchesHeader(const unsigned char* header, size_t size) const override;
+    std::unique_ptr<OutputSink> createEncoder(OutputSink& downstream,
+                                              const CodecOptions& options) const override;
+
+    /// Decodes any container; the inner codec is read from its header
+    std::unique_ptr<OutputSink> createDecoder(OutputSink& downstream) const override;
+
+    /// Blocks are independent, so they are decoded in parallel and written in order
+    std::unique_ptr<OutputSink> createThreadedDecoder(OutputSink& downstream,
+                                                      size_t threads) const override;
+
+    /// Blocks are primed with the dictionary, which pays off most here since
+    /// every block otherwise starts with an empty window
+    bool supportsDictionary() const override;
+    std::unique_ptr<OutputSink> createDictionaryDecoder(OutputSink& downstream,
+                                                        const std::string& dictionary,
+                                                        size_t threads) const override;
+    std::string trainDictionary(const std::vector<std::string>& samples, size_t maxSize) const override;
+
+private:
+    std::shared_ptr<const Codec> inner;
+    size_t blockSize;
+    double minBlockSavings;
+};
+
+} // namespace dbbackup
@@ -0,0 +1,195 @@
+#include "codecs/bzip2_codec.hpp"
+#include "error/ErrorUtils.hpp"
+#include <bzlib.h>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace dbbackup::error;
+
+namespace dbbackup {
+
+namespace {
+    constexpr size_t CHUNK_SIZE = 65536;  // 64KB output chunks
+
+    int bzip2BlockSize(CompressionLevel level) {
+        // Block size in units of 100KB
+        switch (level) {
+            case CompressionLevel::Low: return 1;
+            case CompressionLevel::Medium: return 6;
+            case CompressionLevel::High: return 9;
+            default: return 6;
+        }
+    }
+
+    /// Streaming bzip2 encoder, forwards compressed bytes to the downstream sink
+    class Bzip2Encoder : public OutputSink {
+    public:
+        Bzip2Encoder(OutputSink& downstream, int blockSize)
+            : downstream(downstream)
+            , outBuffer(CHUNK_SIZE) {
+            if (BZ2_bzCompressInit(&stream, blockSize, 0, 0) != BZ_OK) {
+                DB_THROW(CompressionError, "Failed to initialize compression");
+            }
+        }
+
+        ~Bzip2Encoder() override {
+            BZ2_bzCompressEnd(&stream);
+        }
+
+        void write(const char* data, size_t size) override {
+            // avail_in is 32-bit, feed very large writes in slices
+            while (size > 0) {
+                unsigned int slice = static_cast<unsigned int>(std::min<size_t>(size, 1u << 30));
+                stream.next_in = const_cast<char*>(data);
+                stream.avail_in = slice;
+                while (stream.avail_in > 0) {
+                    run(BZ_RUN);
+                }
+                data += slice;
+                size -= slice;
+            }
+        }
+
+        void finish() override {
+            if (finished) {
+                return;
+            }
+            stream.next_in = nullptr;
+            stream.avail_in = 0;
+            while (run(BZ_FINISH) != BZ_STREAM_END) {
+            }
+            finished = true;
+            downstream.finish();
+        }
+
+    private:
+        int run(int action) {
+            stream.next_out = outBuffer.data();
+            stream.avail_out = static_cast<unsigned int>(outBuffer.size());
+
+            int ret = BZ2_bzCompress(&stream, action);
+            if (ret != BZ_RUN_OK && ret != BZ_FINISH_OK && ret != BZ_STREAM_END) {
+                DB_THROW(CompressionError, "Compression error");
+            }
+
+            size_t have = outBuffer.size() - stream.avail_out;
+            if (have > 0) {
+                downstream.write(outBuffer.data(), have);
+            }
+            return ret;
+        }
+
+        OutputSink& downstream;
+        bz_stream stream = {};
+        std::vector<char> outBuffer;
+        bool finished = false;
+    };
+
+    /// Streaming bzip2 decoder. Concatenated streams (as written by pbzip2)
+    /// are decoded back to back.
+    class Bzip2Decoder : public OutputSink {
+    public:
+        explicit Bzip2Decoder(OutputSink& downstream)
+            : downstream(downstream)
+            , outBuffer(CHUNK_SIZE) {
+            if (BZ2_bzDecompressInit(&stream, 0, 0) != BZ_OK) {
+                DB_THROW(CompressionError, "Failed to initialize decompression");
+            }
+        }
+
+        ~Bzip2Decoder() override {
+            BZ2_bzDecompressEnd(&stream);
+        }
+
+        void write(const char* data, size_t size) override {
+            while (size > 0) {
+                unsigned int slice = static_cast<unsigned int>(std::min<size_t>(size, 1u << 30));
+                stream.next_in = const_cast<char*>(data);
+                stream.avail_in = slice;
+                while (stream.avail_in > 0) {
+                    if (streamComplete) {
+                        // Another stream follows the one just completed
+                        char* remaining = stream.next_in;
+                        unsigned int remainingSize = stream.avail_in;
+                        BZ2_bzDecompressEnd(&stream);
+                        stream = bz_stream{};
+                        if (BZ2_bzDecompressInit(&stream, 0, 0) != BZ_OK) {
+                            DB_THROW(CompressionError, "Failed to initialize decompression");
+                        }
+                        stream.next_in = remaining;
+                        stream.avail_in = remainingSize;
+                        streamComplete = false;
+                    }
+                    run();
+                }
+                data += slice;
+                size -= slice;
+            }
+        }
+
+        void finish() override {
+            if (finished) {
+                return;
+            }
+            if (!streamComplete) {
+                DB_THROW(CompressionError, "Incomplete or corrupted compressed data");
+            }
+            finished = true;
+            downstream.finish();
+        }
+
+    private:
+        void run() {
+            do {
+                stream.next_out = outBuffer.data();
+                stream.avail_out = static_cast<unsigned int>(outBuffer.size());
+
+                int ret = BZ2_bzDecompress(&stream);
+                if (ret != BZ_OK && ret != BZ_STREAM_END) {
+                    DB_THROW(CompressionError, "Decompression error");
+                }
+
+                size_t have = outBuffer.size() - stream.avail_out;
+                if (have > 0) {
+                    downstream.write(outBuffer.data(), have);
+                }
+                if (ret == BZ_STREAM_END) {
+                    streamComplete = true;
+                    return;
+                }
+            } while (stream.avail_out == 0);
+        }
+
+        OutputSink& downstream;
+        bz_stream stream = {};
+        std::vector<char> outBuffer;
+        bool streamComplete = false;
+        bool finished = false;
+    };
+}
+
+std::string Bzip2Codec::name() const {
+    return "bzip2";
+}
+
+std::string Bzip2Codec::extension() const {
+    return ".bz2";
+}
+
+bool Bzip2Codec::matchesHeader(const unsigned char* header, size_t size) const {
+    static const unsigned char magic[] = {'B', 'Z', 'h'};
+    return size >= sizeof(magic) && std::memcmp(header, magic, sizeof(magic)) == 0;
+}
+
+std::unique_ptr<OutputSink> Bzip2Codec::createEncoder(OutputSink& downstream,
+                                                      const CodecOptions& options) const {
+    return std::make_unique<Bzip2Encoder>(downstream, bzip2BlockSize(options.level));
+}
+
+std::unique_ptr<OutputSink> Bzip2Codec::createDecoder(OutputSink& downstream) const {
+    return std::make_unique<Bzip2Decoder>(downstream);
+}
+
+} // namespace dbbackup
@@ -0,0 +1,568 @@
+#include "codecs/gzip_codec.hpp"
+#include "checksum.hpp"
+#include "error/ErrorUtils.hpp"
+#include "thread_pool.hpp"
+#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <vector>
+
+using namespace dbbackup::error;
+
+namespace dbbackup {
+
+namespace {
+    constexpr size_t CHUNK_SIZE = 16384;  // 16KB chunks for reading/writing
+
+    int zlibLevel(CompressionLevel level) {
+        switch (level) {
+            case CompressionLevel::Low: return 1;
+            case CompressionLevel::Medium: return 6;
+            case CompressionLevel::High: return 9;
+            default: return 6;
+        }
+    }
+
+    constexpr size_t DEFLATE_WINDOW = 32768;  // deflate can only reach this far back
+    constexpr size_t GZIP_HEADER_SIZE = 10;
+    constexpr size_t GZIP_TRAILER_SIZE = 8;
+
+    void writeGzipHeader(OutputSink& downstream) {
+        // Magic, deflate, no flags, no mtime, no extra flags, OS = Unix
+        static const unsigned char header[GZIP_HEADER_SIZE] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3};
+        downstream.write(reinterpret_cast<const char*>(header), sizeof(header));
+    }
+
+    void writeGzipTrailer(OutputSink& downstream, uLong crc, uint64_t totalIn) {
+        unsigned char trailer[GZIP_TRAILER_SIZE];
+        uint32_t size32 = static_cast<uint32_t>(totalIn & 0xffffffffu);
+        for (int i = 0; i < 4; i++) {
+            trailer[i] = static_cast<unsigned char>((crc >> (8 * i)) & 0xff);
+            trailer[4 + i] = static_cast<unsigned char>((size32 >> (8 * i)) & 0xff);
+        }
+        downstream.write(reinterpret_cast<const char*>(trailer), sizeof(trailer));
+    }
+
+    /// The part of a preset dictionary deflate can use: its last 32KB
+    std::vector<char> dictionaryWindow(const std::string* dictionary) {
+        if (!dictionary) {
+            return {};
+        }
+        size_t keep = std::min(dictionary->size(), DEFLATE_WINDOW);
+        return std::vector<char>(dictionary->end() - keep, dictionary->end());
+    }
+
+    /// Streaming gzip encoder, forwards deflate output to the downstream sink.
+    ///
+    /// zlib only takes preset dictionaries for raw and zlib streams, so with a
+    /// dictionary the gzip header and trailer are written here around a raw
+    /// deflate stream. The output is still a gzip member, but one that only
+    /// decodes with the same dictionary, so it is only used for the blocks
+    /// of a block container.
+    class GzipEncoder : public OutputSink {
+    public:
+        GzipEncoder(OutputSink& downstream, int level, const std::string* dictionary)
+            : downstream(downstream)
+            , outBuffer(CHUNK_SIZE)
+            , framed(dictionary != nullptr) {
+            stream.zalloc = Z_NULL;
+            stream.zfree = Z_NULL;
+            stream.opaque = Z_NULL;
+
+            int ret = deflateInit2(&stream, level, Z_DEFLATED,
+                                 framed ? -15 : 15 + 16,  // raw, or 15 window bits + 16 for gzip header
+                                 8,                       // memory level
+                                 Z_DEFAULT_STRATEGY);
+            if (ret != Z_OK) {
+                DB_THROW(CompressionError, "Failed to initialize compression");
+            }
+            if (framed) {
+                std::vector<char> window = dictionaryWindow(dictionary);
+                if (deflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(window.data()),
+                                         static_cast<uInt>(window.size())) != Z_OK) {
+                    deflateEnd(&stream);
+                    DB_THROW(CompressionError, "Failed to set compression dictionary");
+                }
+                writeGzipHeader(downstream);
+            }
+        }
+
+        ~GzipEncoder() override {
+            deflateEnd(&stream);
+        }
+
+        void write(const char* data, size_t size) override {
+            // avail_in is 32-bit, feed very large writes in slices
+            while (size > 0) {
+                uInt slice = static_cast<uInt>(std::min<size_t>(size, 1u << 30));
+                if (framed) {
+                    crc = checksum::crc32(data, slice, static_cast<uint32_t>(crc));
+                    totalIn += slice;
+                }
+                stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+                stream.avail_in = slice;
+                deflateChunks(Z_NO_FLUSH);
+                data += slice;
+                size -= slice;
+            }
+        }
+
+        void finish() override {
+            if (finished) {
+                return;
+            }
+            stream.next_in = Z_NULL;
+            stream.avail_in = 0;
+            deflateChunks(Z_FINISH);
+            if (framed) {
+                writeGzipTrailer(downstream, crc, totalIn);
+            }
+            finished = true;
+            downstream.finish();
+        }
+
+    private:
+        void deflateChunks(int flush) {
+            do {
+                stream.avail_out = CHUNK_SIZE;
+                stream.next_out = outBuffer.data();
+
+                int ret = deflate(&stream, flush);
+                if (ret == Z_STREAM_ERROR) {
+                    DB_THROW(CompressionError, "Compression error");
+                }
+
+                size_t have = CHUNK_SIZE - stream.avail_out;
+                if (have > 0) {
+                    downstream.write(reinterpret_cast<char*>(outBuffer.data()), have);
+                }
+            } while (stream.avail_out == 0);
+        }
+
+        OutputSink& downstream;
+        z_stream stream;
+        std::vector<unsigned char> outBuffer;
+        bool framed;  // Gzip framing written here around raw deflate
+        uLong crc = crc32(0L, Z_NULL, 0);
+        uint64_t totalIn = 0;
+        bool finished = false;
+    };
+
+    constexpr size_t PARALLEL_BLOCK_SIZE = 131072;  // 128KB of input per worker job
+
+    /// Block-parallel gzip encoder in the style of pigz.
+    ///
+    /// Input is cut into fixed-size blocks that are deflated independently on
+    /// a worker pool, each primed with the last 32KB of the preceding block so
+    /// the ratio stays close to a single stream. Every block but the last ends
+    /// with a sync flush, which byte-aligns it so the raw deflate outputs can be
+    /// concatenated into one gzip member. The CRC32 is combined per block.
+    /// A preset dictionary simply primes the first block.
+    class ParallelGzipEncoder : public OutputSink {
+    public:
+        ParallelGzipEncoder(OutputSink& downstream, int level, size_t threads,
+                            const std::string* dictionary)
+            : downstream(downstream)
+            , level(level)
+            , maxInFlight(threads * 2)
+            , pool(threads)
+            , history(dictionaryWindow(dictionary)) {
+            pending.reserve(PARALLEL_BLOCK_SIZE);
+            writeGzipHeader(downstream);
+        }
+
+        ~ParallelGzipEncoder() override {
+            // Let outstanding jobs finish before their results are discarded
+            for (auto& job : inFlight) {
+                job.wait();
+            }
+        }
+
+        void write(const char* data, size_t size) override {
+            while (size > 0) {
+                size_t n = std::min(size, PARALLEL_BLOCK_SIZE - pending.size());
+                pending.insert(pending.end(), data, data + n);
+                data += n;
+                size -= n;
+                if (pending.size() == PARALLEL_BLOCK_SIZE) {
+                    submitBlock(false);
+                }
+            }
+        }
+
+        void finish() override {
+            if (finished) {
+                return;
+            }
+            submitBlock(true);
+            while (!inFlight.empty()) {
+                writeOldestBlock();
+            }
+            writeGzipTrailer(downstream, crc, totalIn);
+            finished = true;
+            downstream.finish();
+        }
+
+    private:
+        struct CompressedBlock {
+            std::vector<char> data;
+            uLong crc;
+            size_t rawSize;
+        };
+
+        void submitBlock(bool last) {
+            std::vector<char> dictionary;
+            if (!history.empty()) {
+                dictionary.swap(history);
+            }
+            size_t keep = std::min(pending.size(), DEFLATE_WINDOW);
+            history.assign(pending.end() - keep, pending.end());
+
+            std::vector<char> block;
+            block.swap(pending);
+            pending.reserve(PARALLEL_BLOCK_SIZE);
+
+            int blockLevel = level;
+            inFlight.push_back(pool.submit(
+                [block = std::move(block), dictionary = std::move(dictionary), blockLevel, last]() {
+                    return compressBlock(block, dictionary, blockLevel, last);
+                }));
+
+            // Bound memory: wait for the oldest block once enough are queued
+            while (inFlight.size() >= maxInFlight) {
+                writeOldestBlock();
+            }
+        }
+
+        void writeOldestBlock() {
+            // Pop before get(): a throwing job must not leave a spent
+            // future for the destructor to wait on
+            std::future<CompressedBlock> job = std::move(inFlight.front());
+            inFlight.pop_front();
+            CompressedBlock block = job.get();
+            crc = crc32_combine(crc, block.crc, static_cast<z_off_t>(block.rawSize));
+            totalIn += block.rawSize;
+            if (!block.data.empty()) {
+                downstream.write(block.data.data(), block.data.size());
+            }
+        }
+
+        static CompressedBlock compressBlock(const std::vector<char>& input,
+                                             const std::vector<char>& dictionary,
+                                             int level, bool last) {
+            CompressedBlock result;
+            result.rawSize = input.size();
+            result.crc = checksum::crc32(input.data(), input.size());
+
+            z_stream stream;
+            stream.zalloc = Z_NULL;
+            stream.zfree = Z_NULL;
+            stream.opaque = Z_NULL;
+
+            // Raw deflate (negative window bits): the gzip framing is written once
+            if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                DB_THROW(CompressionError, "Failed to initialize compression");
+            }
+            if (!dictionary.empty()) {
+                deflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(dictionary.data()),
+                                     static_cast<uInt>(dictionary.size()));
+            }
+
+            result.data.resize(deflateBound(&stream, static_cast<uLong>(input.size())) + 16);
+            stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+            stream.avail_in = static_cast<uInt>(input.size());
+            stream.next_out = reinterpret_cast<Bytef*>(result.data.data());
+            stream.avail_out = static_cast<uInt>(result.data.size());
+
+            int ret = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+            bool complete = last ? ret == Z_STREAM_END : (ret == Z_OK && stream.avail_in == 0);
+            result.data.resize(result.data.size() - stream.avail_out);
+            deflateEnd(&stream);
+
+            if (!complete) {
+                DB_THROW(CompressionError, "Compression error");
+            }
+            return result;
+        }
+
+        OutputSink& downstream;
+        int level;
+        size_t maxInFlight;
+        ThreadPool pool;
+        std::deque<std::future<CompressedBlock>> inFlight;
+        std::vector<char> pending;
+        std::vector<char> history;
+        uLong crc = crc32(0L, Z_NULL, 0);
+        uint64_t totalIn = 0;
+        bool finished = false;
+    };
+
+    /// Streaming gzip decoder, forwards inflated bytes to the downstream sink.
+    /// Concatenated gzip members are decoded back to back, like gunzip does.
+    class GzipDecoder : public OutputSink {
+    public:
+        explicit GzipDecoder(OutputSink& downstream)
+            : downstream(downstream)
+            , outBuffer(CHUNK_SIZE) {
+            stream.zalloc = Z_NULL;
+            stream.zfree = Z_NULL;
+            stream.opaque = Z_NULL;
+            stream.avail_in = 0;
+            stream.next_in = Z_NULL;
+
+            int ret = inflateInit2(&stream, 15 + 16);  // 15 window bits + 16 for gzip header
+            if (ret != Z_OK) {
+                DB_THROW(CompressionError, "Failed to initialize decompression");
+            }
+        }
+
+        ~GzipDecoder() override {
+            inflateEnd(&stream);
+        }
+
+        void write(const char* data, size_t size) override {
+            while (size > 0) {
+                uInt slice = static_cast<uInt>(std::min<size_t>(size, 1u << 30));
+                stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+                stream.avail_in = slice;
+                while (stream.avail_in > 0) {
+                    if (memberComplete) {
+                        // Another member follows the one just completed
+                        inflateReset(&stream);
+                        memberComplete = false;
+                    }
+                    inflateChunks();
+                }
+                data += slice;
+                size -= slice;
+            }
+        }
+
+        void finish() override {
+            if (finished) {
+                return;
+            }
+            if (!memberComplete) {
+                DB_THROW(CompressionError, "Incomplete or corrupted compressed data");
+            }
+            finished = true;
+            downstream.finish();
+        }
+
+    private:
+        void inflateChunks() {
+            do {
+                stream.avail_out = CHUNK_SIZE;
+                stream.next_out = outBuffer.data();
+
+                int ret = inflate(&stream, Z_NO_FLUSH);
+                switch (ret) {
+                    case Z_NEED_DICT:
+                    case Z_DATA_ERROR:
+                    case Z_MEM_ERROR:
+                    case Z_STREAM_ERROR:
+                        DB_THROW(CompressionError, "Decompression error");
+                }
+
+                size_t have = CHUNK_SIZE - stream.avail_out;
+                if (have > 0) {
+                    downstream.write(reinterpret_cast<char*>(outBuffer.data()), have);
+                }
+                if (ret == Z_STREAM_END) {
+                    memberComplete = true;
+                    return;
+                }
+            } while (stream.avail_out == 0);
+        }
+
+        OutputSink& downstream;
+        z_stream stream;
+        std::vector<unsigned char> outBuffer;
+        bool memberComplete = false;
+        bool finished = false;
+    };
+
+    /// Decoder for the single gzip member GzipEncoder writes with a preset
+    /// dictionary: the header and trailer are checked here and the raw
+    /// deflate stream between them is inflated with the dictionary.
+    class DictionaryGzipDecoder : public OutputSink {
+    public:
+        DictionaryGzipDecoder(OutputSink& downstream, const std::string& dictionary)
+            : downstream(downstream)
+            , outBuffer(CHUNK_SIZE) {
+            stream.zalloc = Z_NULL;
+            stream.zfree = Z_NULL;
+            stream.opaque = Z_NULL;
+            stream.avail_in = 0;
+            stream.next_in = Z_NULL;
+
+            if (inflateInit2(&stream, -15) != Z_OK) {
+                DB_THROW(CompressionError, "Failed to initialize decompression");
+            }
+            std::vector<char> window = dictionaryWindow(&dictionary);
+            if (inflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(window.data()),
+                                     static_cast<uInt>(window.size())) != Z_OK) {
+                inflateEnd(&stream);
+                DB_THROW(CompressionError, "Failed to set decompression dictionary");
+            }
+        }
+
+        ~DictionaryGzipDecoder() override {
+            inflateEnd(&stream);
+        }
+
+        void write(const char* data, size_t size) override {
+            while (size > 0) {
+                if (state == State::Header) {
+                    size_t n = std::min(size, GZIP_HEADER_SIZE - header.size());
+                    header.append(data, n);
+                    data += n;
+                    size -= n;
+                    if (header.size() == GZIP_HEADER_SIZE) {
+                        checkHeader();
+                        state = State::Body;
+                    }
+                } else if (state == State::Body) {
+                    uInt slice = static_cast<uInt>(std::min<size_t>(size, 1u << 30));
+                    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+                    stream.avail_in = slice;
+                    inflateChunks();
+                    size_t used = slice - stream.avail_in;
+                    data += used;
+                    size -= used;
+                } else {
+                    size_t n = std::min(size, GZIP_TRAILER_SIZE - trailer.size());
+                    if (n == 0) {
+                        DB_THROW(CompressionError, "Unexpected data after compressed stream");
+                    }
+                    trailer.append(data, n);
+                    data += n;
+                    size -= n;
+                }
+            }
+        }
+
+        void finish() override {
+            if (finished) {
+                return;
+            }
+            if (state != State::Trailer || trailer.size() != GZIP_TRAILER_SIZE) {
+                DB_THROW(CompressionError, "Incomplete or corrupted compressed data");
+            }
+            uint32_t expectedCrc = 0;
+            uint32_t expectedSize = 0;
+            for (int i = 0; i < 4; i++) {
+                expectedCrc |= static_cast<uint32_t>(static_cast<unsigned char>(trailer[i])) << (8 * i);
+                expectedSize |= static_cast<uint32_t>(static_cast<unsigned char>(trailer[4 + i])) << (8 * i);
+            }
+            if (expectedCrc != static_cast<uint32_t>(crc) ||
+                expectedSize != static_cast<uint32_t>(totalOut & 0xffffffffu)) {
+                DB_THROW(CompressionError, "Decompression error: checksum mismatch");
+            }
+            finished = true;
+            downstream.finish();
+        }
+
+    private:
+        enum class State { Header, Body, Trailer };
+
+        void checkHeader() {
+            const unsigned char* h = reinterpret_cast<const unsigned char*>(header.data());
+            if (h[0] != 0x1f || h[1] != 0x8b || h[2] != 8) {
+                DB_THROW(CompressionError, "Decompression error: not a gzip stream");
+            }
+            if (h[3] != 0) {
+                DB_THROW(CompressionError, "Decompression error: unexpected gzip header fields");
+            }
+        }
+
+        void inflateChunks() {
+            do {
+                stream.avail_out = CHUNK_SIZE;
+                stream.next_out = outBuffer.data();
+
+                int ret = inflate(&stream, Z_NO_FLUSH);
+                switch (ret) {
+                    case Z_NEED_DICT:
+                    case Z_DATA_ERROR:
+                    case Z_MEM_ERROR:
+                    case Z_STREAM_ERROR:
+                        DB_THROW(CompressionError, "Decompression error");
+                }
+
+                size_t have = CHUNK_SIZE - stream.avail_out;
+                if (have > 0) {
+                    crc = checksum::crc32(outBuffer.data(), have, static_cast<uint32_t>(crc));
+                    totalOut += have;
+                    downstream.write(reinterpret_cast<char*>(outBuffer.data()), have);
+                }
+                if (ret == Z_STREAM_END) {
+                    state = State::Trailer;
+                    return;
+                }
+            } while (stream.avail_out == 0);
+        }
+
+        OutputSink& downstream;
+        z_stream stream;
+        std::vector<unsigned char> outBuffer;
+        State state = State::Header;
+        std::string header;
+        std::string trailer;
+        uLong crc = crc32(0L, Z_NULL, 0);
+        uint64_t totalOut = 0;
+        bool finished = false;
+    };
+}
+
+std::string GzipCodec::name() const {
+    return "gzip";
+}
+
+std::string GzipCodec::extension() const {
+    return ".gz";
+}
+
+bool GzipCodec::matchesHeader(const unsigned char* header, size_t size) const {
+    static const unsigned char magic[] = {0x1f, 0x8b};
+    return size >= sizeof(magic) && std::memcmp(header, magic, sizeof(magic)) == 0;
+}
+
+std::unique_ptr<OutputSink> GzipCodec::createEncoder(OutputSink& downstream,
+                                                     const CodecOptions& options) const {
+    const std::string* dictionary = options.dictionary.get();
+    if (options.threads > 1) {
+        return std::make_unique<ParallelGzipEncoder>(downstream, zlibLevel(options.level),
+                                                     options.threads, dictionary);
+    }
+    return std::make_unique<GzipEncoder>(downstream, zlibLevel(options.level), dictionary);
+}
+
+std::unique_ptr<OutputSink> GzipCodec::createDecoder(OutputSink& downstream) const {
+    return std::make_unique<GzipDecoder>(downstream);
+}
+
+bool GzipCodec::supportsDictionary() const {
+    return false;
+}
+
+bool GzipCodec::supportsBlockDictionary() const {
+    return true;
+}
+
+std::unique_ptr<OutputSink> GzipCodec::createDictionaryDecoder(OutputSink& downstream,
+                                                               const std::string& dictionary,
+                                                               size_t threads) const {
+    (void)threads;
+    return std::make_unique<DictionaryGzipDecoder>(downstream, dictionary);
+}
+
+std::string GzipCodec::trainDictionary(const std::vector<std::string>& samples, size_t maxSize) const {
+    // Anything beyond the deflate window would never be referenced
+    return Codec::trainDictionary(samples, std::min(maxSize, DEFLATE_WINDOW));
+}
+
+} // namespace dbbackup
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "../../include/compression.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dbbackup {
+
+class GzipCodec : public Codec {
+public:
+    std::string name() const override;
+    std::string extension() const override;
+    bool matchesHeader(const unsigned char* header, size_t size) const override;
+    std::unique_ptr<OutputSink> createEncoder(OutputSink& downstream,
+                                              const CodecOptions& options) const override;
+    std::unique_ptr<OutputSink> createDecoder(OutputSink& downstream) const override;
+
+    /// Dictionary streams are gzip-framed raw deflate primed with the last
+    /// 32KB of the dictionary. gunzip cannot read them, so a standalone .gz
+    /// never uses one; only blocks inside a block container do.
+    bool supportsDictionary() const override;
+    bool supportsBlockDictionary() const override;
+    std::unique_ptr<OutputSink> createDictionaryDecoder(OutputSink& downstream,
+                                                        const std::string& dictionary,
+                                                        size_t threads) const override;
+    std::string trainDictionary(const std::vector<std::string>& samples, size_t maxSize) const override;
+};
+
+} // namespace dbbackup
@@ -0,0 +1,143 @@
+#include "codecs/xz_codec.hpp"
+#include "error/ErrorUtils.hpp"
+#include <lzma.h>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace dbbackup::error;
+
+namespace dbbackup {
+
+namespace {
+    constexpr size_t CHUNK_SIZE = 65536;  // 64KB output chunks
+
+    uint32_t xzPreset(CompressionLevel level) {
+        switch (level) {
+            case CompressionLevel::Low: return 1;
+            case CompressionLevel::Medium: return 6;
+            case CompressionLevel::High: return 9;
+            default: return 6;
+        }
+    }
+
+    /// Shared lzma_stream plumbing for the xz encoder and decoder
+    class LzmaSink : public OutputSink {
+    public:
+        explicit LzmaSink(OutputSink& downstream)
+            : downstream(downstream)
+            , outBuffer(CHUNK_SIZE) {
+        }
+
+        ~LzmaSink() override {
+            lzma_end(&stream);
+        }
+
+        void write(const char* data, size_t size) override {
+            stream.next_in = reinterpret_cast<const uint8_t*>(data);
+            stream.avail_in = size;
+            while (stream.avail_in > 0) {
+                if (run(LZMA_RUN) == LZMA_STREAM_END) {
+                    break;
+                }
+            }
+        }
+
+        void finish() override {
+            if (finished) {
+                return;
+            }
+            stream.next_in = nullptr;
+            stream.avail_in = 0;
+            while (run(LZMA_FINISH) != LZMA_STREAM_END) {
+            }
+            finished = true;
+            downstream.finish();
+        }
+
+    protected:
+        lzma_ret run(lzma_action action) {
+            stream.next_out = outBuffer.data();
+            stream.avail_out = outBuffer.size();
+
+            lzma_ret ret = lzma_code(&stream, action);
+            size_t have = outBuffer.size() - stream.avail_out;
+            if (have > 0) {
+                downstream.write(reinterpret_cast<const char*>(outBuffer.data()), have);
+            }
+
+            if (ret != LZMA_OK && ret != LZMA_STREAM_END) {
+                if (ret == LZMA_BUF_ERROR) {
+                    DB_THROW(CompressionError, "Incomplete or corrupted compressed data");
+                }
+                DB_THROW(CompressionError, "xz error code " + std::to_string(static_cast<int>(ret)));
+            }
+            return ret;
+        }
+
+        OutputSink& downstream;
+        lzma_stream stream = LZMA_STREAM_INIT;
+        std::vector<uint8_t> outBuffer;
+        bool finished = false;
+    };
+
+    /// Streaming xz encoder. With more than one thread liblzma's multithreaded
+    /// encoder compresses independent blocks in parallel.
+    class XzEncoder : public LzmaSink {
+    public:
+        XzEncoder(OutputSink& downstream, uint32_t preset, size_t threads)
+            : LzmaSink(downstream) {
+            lzma_ret ret;
+            if (threads > 1) {
+                lzma_mt mt = {};
+                mt.threads = static_cast<uint32_t>(threads);
+                mt.block_size = 0;  // liblzma default: 3x the dictionary size
+                mt.timeout = 0;
+                mt.preset = preset;
+                mt.check = LZMA_CHECK_CRC64;
+                ret = lzma_stream_encoder_mt(&stream, &mt);
+            } else {
+                ret = lzma_easy_encoder(&stream, preset, LZMA_CHECK_CRC64);
+            }
+            if (ret != LZMA_OK) {
+                DB_THROW(CompressionError, "Failed to initialize compression");
+            }
+        }
+    };
+
+    /// Streaming xz decoder, accepts concatenated .xz streams
+    class XzDecoder : public LzmaSink {
+    public:
+        explicit XzDecoder(OutputSink& downstream)
+            : LzmaSink(downstream) {
+            if (lzma_stream_decoder(&stream, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+                DB_THROW(CompressionError, "Failed to initialize decompression");
+            }
+        }
+    };
+}
+
+std::string XzCodec::name() const {
+    return "xz";
+}
+
+std::string XzCodec::extension() const {
+    return ".xz";
+}
+
+bool XzCodec::matchesHeader(const unsigned char* header, size_t size) const {
+    static const unsigned char magic[] = {0xfd, '7', 'z', 'X', 'Z', 0x00};
+    return size >= sizeof(magic) && std::memcmp(header, magic, sizeof(magic)) == 0;
+}
+
+std::unique_ptr<OutputSink> XzCodec::createEncoder(OutputSink& downstream,
+                                                   const CodecOptions& options) const {
+    return std::make_unique<XzEncoder>(downstream, xzPreset(options.level), options.threads);
+}
+
+std::unique_ptr<OutputSink> XzCodec::createDecoder(OutputSink& downstream) const {
+    return std::make_unique<XzDecoder>(downstream);
+}
+
+} // namespace dbbackup
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "../../include/compression.hpp"
+#include <memory>
+#include <string>
+
+namespace dbbackup {
+
+class XzCodec : public Codec {
+public:
+    std::string name() const override;
+    std::string extension() const override;
+    bool matchesHeader(const unsigned char* header, size_t size) const override;
+    std::unique_ptr<OutputSink> createEncoder(OutputSink& downstream,
+                                              const CodecOptions& options) const override;
+    std::unique_ptr<OutputSink> createDecoder(OutputSink& downstream) const override;
+};
+
+} // namespace dbbackup
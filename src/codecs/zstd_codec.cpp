@@ -0,0 +1,223 @@
+#include "codecs/zstd_codec.hpp"
+#include "error/ErrorUtils.hpp"
+#include <zstd.h>
+#include <zdict.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace dbbackup::error;
+
+namespace dbbackup {
+
+namespace {
+    int zstdLevel(CompressionLevel level) {
+        switch (level) {
+            case CompressionLevel::Low: return 1;
+            case CompressionLevel::Medium: return 3;
+            case CompressionLevel::High: return 19;
+            default: return 3;
+        }
+    }
+
+    constexpr int ZSTD_LONG_WINDOW_LOG = 27;  // 128MB window, same as zstd --long
+
+    /// Streaming zstd encoder. With more than one thread zstd splits the input
+    /// into jobs compressed by its own worker pool into a single frame.
+    class ZstdEncoder : public OutputSink {
+    public:
+        ZstdEncoder(OutputSink& downstream, int level, size_t threads, bool longDistance,
+                    const std::string* dictionary)
+            : downstream(downstream)
+            , context(ZSTD_createCCtx())
+            , outBuffer(ZSTD_CStreamOutSize()) {
+            if (!context) {
+                DB_THROW(CompressionError, "Failed to initialize compression");
+            }
+            ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, level);
+            ZSTD_CCtx_setParameter(context, ZSTD_c_checksumFlag, 1);
+            if (longDistance) {
+                ZSTD_CCtx_setParameter(context, ZSTD_c_enableLongDistanceMatching, 1);
+                ZSTD_CCtx_setParameter(context, ZSTD_c_windowLog, ZSTD_LONG_WINDOW_LOG);
+            }
+            if (threads > 1) {
+                // Fails harmlessly (single-threaded) if libzstd was built without MT
+                ZSTD_CCtx_setParameter(context, ZSTD_c_nbWorkers, static_cast<int>(threads));
+            }
+            if (dictionary && ZSTD_isError(ZSTD_CCtx_loadDictionary(context, dictionary->data(),
+                                                                    dictionary->size()))) {
+                ZSTD_freeCCtx(context);
+                DB_THROW(CompressionError, "Failed to load compression dictionary");
+            }
+        }
+
+        ~ZstdEncoder() override {
+            ZSTD_freeCCtx(context);
+        }
+
+        void write(const char* data, size_t size) override {
+            ZSTD_inBuffer input = {data, size, 0};
+            while (input.pos < input.size) {
+                compressChunk(input, ZSTD_e_continue);
+            }
+        }
+
+        void finish() override {
+            if (finished) {
+                return;
+            }
+            ZSTD_inBuffer input = {nullptr, 0, 0};
+            while (compressChunk(input, ZSTD_e_end) != 0) {
+            }
+            finished = true;
+            downstream.finish();
+        }
+
+    private:
+        size_t compressChunk(ZSTD_inBuffer& input, ZSTD_EndDirective mode) {
+            ZSTD_outBuffer output = {outBuffer.data(), outBuffer.size(), 0};
+            size_t remaining = ZSTD_compressStream2(context, &output, &input, mode);
+            if (ZSTD_isError(remaining)) {
+                DB_THROW(CompressionError, std::string("Compression error: ") +
+                         ZSTD_getErrorName(remaining));
+            }
+            if (output.pos > 0) {
+                downstream.write(outBuffer.data(), output.pos);
+            }
+            return remaining;
+        }
+
+        OutputSink& downstream;
+        ZSTD_CCtx* context;
+        std::vector<char> outBuffer;
+        bool finished = false;
+    };
+
+    /// Streaming zstd decoder, forwards decompressed bytes to the downstream sink
+    class ZstdDecoder : public OutputSink {
+    public:
+        ZstdDecoder(OutputSink& downstream, const std::string* dictionary)
+            : downstream(downstream)
+            , context(ZSTD_createDCtx())
+            , outBuffer(ZSTD_DStreamOutSize()) {
+            if (!context) {
+                DB_THROW(CompressionError, "Failed to initialize decompression");
+            }
+            // Accept frames written with long distance matching
+            ZSTD_DCtx_setParameter(context, ZSTD_d_windowLogMax, ZSTD_LONG_WINDOW_LOG);
+            if (dictionary && ZSTD_isError(ZSTD_DCtx_loadDictionary(context, dictionary->data(),
+                                                                    dictionary->size()))) {
+                ZSTD_freeDCtx(context);
+                DB_THROW(CompressionError, "Failed to load decompression dictionary");
+            }
+        }
+
+        ~ZstdDecoder() override {
+            ZSTD_freeDCtx(context);
+        }
+
+        void write(const char* data, size_t size) override {
+            ZSTD_inBuffer input = {data, size, 0};
+            started = started || size > 0;
+            while (input.pos < input.size) {
+                decompressChunk(input);
+            }
+        }
+
+        void finish() override {
+            if (finished) {
+                return;
+            }
+            // Even an empty dump compresses to a frame
+            if (!started) {
+                DB_THROW(CompressionError, "No compressed data");
+            }
+            // Drain output still buffered in the decoder
+            ZSTD_inBuffer input = {nullptr, 0, 0};
+            while (lastResult != 0) {
+                if (decompressChunk(input) == 0 && lastResult != 0) {
+                    DB_THROW(CompressionError, "Incomplete or corrupted compressed data");
+                }
+            }
+            finished = true;
+            downstream.finish();
+        }
+
+    private:
+        size_t decompressChunk(ZSTD_inBuffer& input) {
+            ZSTD_outBuffer output = {outBuffer.data(), outBuffer.size(), 0};
+            lastResult = ZSTD_decompressStream(context, &output, &input);
+            if (ZSTD_isError(lastResult)) {
+                DB_THROW(CompressionError, std::string("Decompression error: ") +
+                         ZSTD_getErrorName(lastResult));
+            }
+            if (output.pos > 0) {
+                downstream.write(outBuffer.data(), output.pos);
+            }
+            return output.pos;
+        }
+
+        OutputSink& downstream;
+        ZSTD_DCtx* context;
+        std::vector<char> outBuffer;
+        size_t lastResult = 0;
+        bool started = false;  // Any input seen
+        bool finished = false;
+    };
+}
+
+std::string ZstdCodec::name() const {
+    return "zstd";
+}
+
+std::string ZstdCodec::extension() const {
+    return ".zst";
+}
+
+bool ZstdCodec::matchesHeader(const unsigned char* header, size_t size) const {
+    static const unsigned char magic[] = {0x28, 0xb5, 0x2f, 0xfd};
+    return size >= sizeof(magic) && std::memcmp(header, magic, sizeof(magic)) == 0;
+}
+
+std::unique_ptr<OutputSink> ZstdCodec::createEncoder(OutputSink& downstream,
+                                                     const CodecOptions& options) const {
+    return std::make_unique<ZstdEncoder>(downstream, zstdLevel(options.level),
+                                         options.threads, options.longDistance,
+                                         options.dictionary.get());
+}
+
+std::unique_ptr<OutputSink> ZstdCodec::createDecoder(OutputSink& downstream) const {
+    return std::make_unique<ZstdDecoder>(downstream, nullptr);
+}
+
+bool ZstdCodec::supportsDictionary() const {
+    return true;
+}
+
+std::unique_ptr<OutputSink> ZstdCodec::createDictionaryDecoder(OutputSink& downstream,
+                                                               const std::string& dictionary,
+                                                               size_t threads) const {
+    (void)threads;
+    return std::make_unique<ZstdDecoder>(downstream, &dictionary);
+}
+
+std::string ZstdCodec::trainDictionary(const std::vector<std::string>& samples, size_t maxSize) const {
+    std::string buffer;
+    std::vector<size_t> sizes;
+    for (const auto& sample : samples) {
+        buffer += sample;
+        sizes.push_back(sample.size());
+    }
+
+    std::string dictionary(maxSize, '\0');
+    size_t size = ZDICT_trainFromBuffer(&dictionary[0], dictionary.size(), buffer.data(),
+                                        sizes.data(), static_cast<unsigned>(sizes.size()));
+    if (ZDICT_isError(size)) {
+        // Too few or too uniform samples; zstd also accepts raw content dictionaries
+        return Codec::trainDictionary(samples, maxSize);
+    }
+    dictionary.resize(size);
+    return dictionary;
+}
+
+} // namespace dbbackup
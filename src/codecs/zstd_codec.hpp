@@ -0,0 +1,28 @@
+#pragma once
+
+#include "../../include/compression.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dbbackup {
+
+class ZstdCodec : public Codec {
+public:
+    std::string name() const override;
+    std::string extension() const override;
+    bool matchesHeader(const unsigned char* header, size_t size) const override;
+    std::unique_ptr<OutputSink> createEncoder(OutputSink& downstream,
+                                              const CodecOptions& options) const override;
+    std::unique_ptr<OutputSink> createDecoder(OutputSink& downstream) const override;
+
+    /// Trained dictionaries come from ZDICT, falling back to a raw content
+    /// dictionary when the samples are too few for it
+    bool supportsDictionary() const override;
+    std::unique_ptr<OutputSink> createDictionaryDecoder(OutputSink& downstream,
+                                                        const std::string& dictionary,
+                                                        size_t threads) const override;
+    std::string trainDictionary(const std::vector<std::string>& samples, size_t maxSize) const override;
+};
+
+} // namespace dbbackup
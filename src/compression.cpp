@@ -1,5 +1,9 @@
 #include "../include/compression.hpp"
+#include "compression.hpp"
+#include "codec_registry.hpp"
+#include "codecs/block_framed_codec.hpp"
 #include "error/ErrorUtils.hpp"
+#include "thread_pool.hpp"
 #include <iostream>
 #include <filesystem>
 #include <fstream>
@@ -7,8 +11,9 @@
 #include <algorithm>
 #include <sstream>
 #include <iomanip>
-#include <zlib.h>
 #include <vector>
+#include <map>
+#include <set>
 #include <stdexcept>
 
 namespace fs = std::filesystem;
@@ -17,200 +22,228 @@ using namespace dbbackup::error;
 namespace dbbackup {
 
 namespace {
-    constexpr size_t CHUNK_SIZE = 16384;  // 16KB chunks for reading/writing
+    /// Streams inputPath through the sink chain built by makeSink into outputPath
+    template <typename MakeSink>
+    void transcodeFile(const std::string& inputPath, const std::string& outputPath,
+                       const FileIOOptions& io, MakeSink makeSink) {
+        FileSource inFile(inputPath, io);
+        if (!inFile) {
+            DB_THROW(CompressionError, "Failed to open input file: " + inputPath);
+        }
+
+        FileSink outFile(outputPath, io);
+        if (!outFile) {
+            DB_THROW(CompressionError, "Failed to open output file: " + outputPath);
+        }
+
+        std::unique_ptr<OutputSink> sink = makeSink(outFile);
+        copyStream(inFile, *sink, io.bufferSize);
+        sink->finish();
+    }
 }
 
-Compressor::Compressor(const CompressionConfig& config)
-    : format(stringToFormat(config.format))
-    , level(stringToLevel(config.level)) {
+std::unique_ptr<OutputSink> Codec::createDictionaryDecoder(OutputSink& downstream,
+                                                           const std::string& dictionary,
+                                                           size_t threads) const {
+    (void)downstream;
+    (void)dictionary;
+    (void)threads;
+    DB_THROW(CompressionError, "Codec does not support dictionaries: " + name());
 }
 
-CompressionFormat Compressor::stringToFormat(const std::string& format) {
-    if (format == "gzip") return CompressionFormat::Gzip;
-    if (format == "bzip2") return CompressionFormat::Bzip2;
-    if (format == "xz") return CompressionFormat::Xz;
-    DB_THROW(ConfigurationError, "Unsupported compression format: " + format);
+std::string Codec::trainDictionary(const std::vector<std::string>& samples, size_t maxSize) const {
+    // Long INSERT lines are unique, but their first bytes are shared
+    constexpr size_t MAX_PREFIX = 128;
+
+    // In how many samples each line prefix occurs
+    std::map<std::string, size_t> counts;
+    for (const auto& sample : samples) {
+        std::set<std::string> seen;
+        size_t start = 0;
+        while (start < sample.size()) {
+            size_t end = sample.find('\n', start);
+            end = end == std::string::npos ? sample.size() : end + 1;
+            std::string prefix = sample.substr(start, std::min(end - start, MAX_PREFIX));
+            if (seen.insert(prefix).second) {
+                counts[prefix]++;
+            }
+            start = end;
+        }
+    }
+
+    std::vector<std::pair<size_t, std::string>> shared;
+    for (auto& entry : counts) {
+        if (entry.second > 1) {
+            shared.emplace_back(entry.second, entry.first);
+        }
+    }
+    std::stable_sort(shared.begin(), shared.end(),
+        [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    std::vector<const std::string*> chosen;
+    size_t total = 0;
+    for (const auto& entry : shared) {
+        if (total + entry.second.size() > maxSize) {
+            continue;
+        }
+        chosen.push_back(&entry.second);
+        total += entry.second.size();
+    }
+
+    std::string dictionary;
+    dictionary.reserve(total);
+    for (auto it = chosen.rbegin(); it != chosen.rend(); ++it) {
+        dictionary += **it;
+    }
+
+    // Nothing in common: fall back to the most recent sample bytes
+    if (dictionary.empty()) {
+        for (auto it = samples.rbegin(); it != samples.rend() && dictionary.size() < maxSize; ++it) {
+            size_t take = std::min(it->size(), maxSize - dictionary.size());
+            dictionary.insert(0, *it, it->size() - take, take);
+        }
+    }
+    return dictionary;
 }
 
-CompressionLevel Compressor::stringToLevel(const std::string& level) {
-    if (level == "low") return CompressionLevel::Low;
-    if (level == "medium") return CompressionLevel::Medium;
-    if (level == "high") return CompressionLevel::High;
-    DB_THROW(ConfigurationError, "Unsupported compression level: " + level);
+DictionarySampler::DictionarySampler(OutputSink& downstream, size_t budget, size_t pieceSize)
+    : downstream(downstream)
+    , budget(budget)
+    , pieceSize(pieceSize) {
+    piece.reserve(pieceSize);
 }
 
-int Compressor::getZlibLevel() const {
-    switch (level) {
-        case CompressionLevel::Low: return 1;
-        case CompressionLevel::Medium: return 6;
-        case CompressionLevel::High: return 9;
-        default: return 6;
+void DictionarySampler::write(const char* data, size_t size) {
+    downstream.write(data, size);
+    while (size > 0) {
+        size_t n = std::min(size, pieceSize - piece.size());
+        piece.append(data, n);
+        data += n;
+        size -= n;
+        if (piece.size() == pieceSize) {
+            closePiece();
+        }
     }
 }
 
-std::string Compressor::getFileExtension() const {
-    switch (format) {
-        case CompressionFormat::Gzip: return ".gz";
-        case CompressionFormat::Bzip2: return ".bz2";
-        case CompressionFormat::Xz: return ".xz";
-        default: return ".gz";
+void DictionarySampler::finish() {
+    if (finished) {
+        return;
+    }
+    if (!piece.empty()) {
+        closePiece();
     }
+    finished = true;
+    downstream.finish();
 }
 
-bool Compressor::compressFile(const std::string& inputPath, const std::string& outputPath) const {
-    switch (format) {
-        case CompressionFormat::Gzip:
-            return compressGzip(inputPath, outputPath);
-        case CompressionFormat::Bzip2:
-        case CompressionFormat::Xz:
-            DB_THROW(ConfigurationError, "Compression format not yet implemented");
-        default:
-            DB_THROW(ConfigurationError, "Unknown compression format");
+void DictionarySampler::closePiece() {
+    if (pieceIndex % stride == 0) {
+        keptBytes += piece.size();
+        kept.push_back(std::move(piece));
+    }
+    piece.clear();
+    piece.reserve(pieceSize);
+    pieceIndex++;
+
+    // Over budget: keep every other sample and halve the sampling rate
+    while (keptBytes > budget && kept.size() > 1) {
+        std::vector<std::string> thinned;
+        keptBytes = 0;
+        for (size_t i = 0; i < kept.size(); i += 2) {
+            keptBytes += kept[i].size();
+            thinned.push_back(std::move(kept[i]));
+        }
+        kept.swap(thinned);
+        stride *= 2;
     }
-    return false;
 }
 
-bool Compressor::decompressFile(const std::string& inputPath, const std::string& outputPath) const {
-    switch (format) {
-        case CompressionFormat::Gzip:
-            return decompressGzip(inputPath, outputPath);
-        case CompressionFormat::Bzip2:
-        case CompressionFormat::Xz:
-            DB_THROW(ConfigurationError, "Decompression format not yet implemented");
-        default:
-            DB_THROW(ConfigurationError, "Unknown compression format");
+Compressor::Compressor(const CompressionConfig& config)
+    : Compressor(BlockFramedCodec::wrap(lookupCodec(config.format), config), config) {
+}
+
+Compressor::Compressor(std::shared_ptr<const Codec> codec, const CompressionConfig& config)
+    : level(stringToLevel(config.level))
+    , decodeThreads(ThreadPool::resolveThreadCount(config.decodeThreads))
+    , dictionarySize(0)
+    , codec(std::move(codec)) {
+    DB_CHECK(this->codec != nullptr, ConfigurationError, "No compression codec given");
+    options.level = level;
+    options.threads = ThreadPool::resolveThreadCount(config.threads);
+    options.longDistance = config.longDistance;
+    dictionarySize = static_cast<size_t>(std::max(config.dictionarySizeKB, 1)) * 1024;
+    io.bufferSize = static_cast<size_t>(std::max(config.bufferSizeKB, 1)) * 1024;
+    io.directIO = config.directIO;
+}
+
+std::shared_ptr<const Codec> Compressor::lookupCodec(const std::string& format) {
+    auto codec = CodecRegistry::getInstance().findByName(format);
+    if (!codec) {
+        DB_THROW(ConfigurationError, "Unsupported compression format: " + format);
     }
-    return false;
+    return codec;
 }
 
-bool Compressor::compressGzip(const std::string& inputPath, const std::string& outputPath) const {
-    DB_TRY_CATCH_LOG("Compression", {
-        std::ifstream inFile(inputPath, std::ios::binary);
-        if (!inFile) {
-            DB_THROW(CompressionError, "Failed to open input file for compression");
-        }
+std::string levelToString(CompressionLevel level) {
+    switch (level) {
+        case CompressionLevel::Low: return "low";
+        case CompressionLevel::Medium: return "medium";
+        case CompressionLevel::High: return "high";
+        default: return "medium";
+    }
+}
 
-        std::ofstream outFile(outputPath, std::ios::binary);
-        if (!outFile) {
-            DB_THROW(CompressionError, "Failed to open output file for compression");
-        }
+CompressionLevel Compressor::stringToLevel(const std::string& level) {
+    if (level == "low") return CompressionLevel::Low;
+    if (level == "medium") return CompressionLevel::Medium;
+    if (level == "high") return CompressionLevel::High;
+    DB_THROW(ConfigurationError, "Unsupported compression level: " + level);
+}
 
-        z_stream stream;
-        stream.zalloc = Z_NULL;
-        stream.zfree = Z_NULL;
-        stream.opaque = Z_NULL;
-
-        int ret = deflateInit2(&stream, getZlibLevel(), Z_DEFLATED,
-                             15 + 16,  // 15 window bits + 16 for gzip header
-                             8,        // memory level
-                             Z_DEFAULT_STRATEGY);
-        
-        if (ret != Z_OK) {
-            DB_THROW(CompressionError, "Failed to initialize compression");
-        }
+std::string Compressor::getFileExtension() const {
+    return codec->extension();
+}
 
-        std::vector<unsigned char> inBuffer(CHUNK_SIZE);
-        std::vector<unsigned char> outBuffer(CHUNK_SIZE);
-
-        do {
-            inFile.read(reinterpret_cast<char*>(inBuffer.data()), CHUNK_SIZE);
-            stream.avail_in = inFile.gcount();
-            stream.next_in = inBuffer.data();
-
-            do {
-                stream.avail_out = CHUNK_SIZE;
-                stream.next_out = outBuffer.data();
-
-                ret = deflate(&stream, inFile.eof() ? Z_FINISH : Z_NO_FLUSH);
-                if (ret == Z_STREAM_ERROR) {
-                    deflateEnd(&stream);
-                    DB_THROW(CompressionError, "Compression error");
-                }
-
-                int have = CHUNK_SIZE - stream.avail_out;
-                outFile.write(reinterpret_cast<char*>(outBuffer.data()), have);
-                
-                if (!outFile) {
-                    deflateEnd(&stream);
-                    DB_THROW(CompressionError, "Failed to write compressed data");
-                }
-            } while (stream.avail_out == 0);
-        } while (!inFile.eof());
-
-        deflateEnd(&stream);
+bool Compressor::compressFile(const std::string& inputPath, const std::string& outputPath) const {
+    DB_TRY_CATCH_LOG("Compression", {
+        transcodeFile(inputPath, outputPath, io, [this](OutputSink& out) { return createEncoder(out); });
         return true;
     });
     return false;
 }
 
-bool Compressor::decompressGzip(const std::string& inputPath, const std::string& outputPath) const {
+bool Compressor::decompressFile(const std::string& inputPath, const std::string& outputPath) const {
     DB_TRY_CATCH_LOG("Compression", {
-        std::ifstream inFile(inputPath, std::ios::binary);
-        if (!inFile) {
-            DB_THROW(CompressionError, "Failed to open input file for decompression");
-        }
-
-        std::ofstream outFile(outputPath, std::ios::binary);
-        if (!outFile) {
-            DB_THROW(CompressionError, "Failed to open output file for decompression");
-        }
+        transcodeFile(inputPath, outputPath, io, [this](OutputSink& out) { return createDecoder(out); });
+        return true;
+    });
+    return false;
+}
 
-        z_stream stream;
-        stream.zalloc = Z_NULL;
-        stream.zfree = Z_NULL;
-        stream.opaque = Z_NULL;
-        stream.avail_in = 0;
-        stream.next_in = Z_NULL;
+std::unique_ptr<OutputSink> Compressor::createEncoder(OutputSink& downstream) const {
+    return codec->createEncoder(downstream, options);
+}
 
-        int ret = inflateInit2(&stream, 15 + 16);  // 15 window bits + 16 for gzip header
-        if (ret != Z_OK) {
-            DB_THROW(CompressionError, "Failed to initialize decompression");
-        }
+std::unique_ptr<OutputSink> Compressor::createDecoder(OutputSink& downstream) const {
+    if (options.dictionary) {
+        return codec->createDictionaryDecoder(downstream, *options.dictionary, decodeThreads);
+    }
+    return codec->createThreadedDecoder(downstream, decodeThreads);
+}
 
-        std::vector<unsigned char> inBuffer(CHUNK_SIZE);
-        std::vector<unsigned char> outBuffer(CHUNK_SIZE);
+void Compressor::setDictionary(std::shared_ptr<const std::string> dictionary) {
+    if (dictionary && !codec->supportsDictionary()) {
+        DB_THROW(ConfigurationError, "Compression format does not support dictionaries: " + codec->name());
+    }
+    options.dictionary = std::move(dictionary);
+}
 
-        do {
-            inFile.read(reinterpret_cast<char*>(inBuffer.data()), CHUNK_SIZE);
-            stream.avail_in = inFile.gcount();
-            
-            if (stream.avail_in == 0) {
-                break;
-            }
-            stream.next_in = inBuffer.data();
-
-            do {
-                stream.avail_out = CHUNK_SIZE;
-                stream.next_out = outBuffer.data();
-
-                ret = inflate(&stream, Z_NO_FLUSH);
-                switch (ret) {
-                    case Z_NEED_DICT:
-                    case Z_DATA_ERROR:
-                    case Z_MEM_ERROR:
-                        inflateEnd(&stream);
-                        DB_THROW(CompressionError, "Decompression error");
-                }
-
-                int have = CHUNK_SIZE - stream.avail_out;
-                outFile.write(reinterpret_cast<char*>(outBuffer.data()), have);
-                
-                if (!outFile) {
-                    inflateEnd(&stream);
-                    DB_THROW(CompressionError, "Failed to write decompressed data");
-                }
-            } while (stream.avail_out == 0);
-        } while (ret != Z_STREAM_END);
-
-        inflateEnd(&stream);
-        
-        if (ret != Z_STREAM_END) {
-            DB_THROW(CompressionError, "Incomplete or corrupted compressed data");
-        }
-        
-        return true;
-    });
-    return false;
+std::string Compressor::trainDictionary(const std::vector<std::string>& samples) const {
+    if (!codec->supportsDictionary()) {
+        DB_THROW(ConfigurationError, "Compression format does not support dictionaries: " + codec->name());
+    }
+    return codec->trainDictionary(samples, dictionarySize);
 }
 
 size_t Compressor::estimateCompressedSize(size_t inputSize) const {
@@ -236,100 +269,36 @@ size_t Compressor::estimateCompressedSize(size_t inputSize) const {
     return static_cast<size_t>(inputSize * ratio) + overhead;
 }
 
-bool compressFile(const std::string& inputPath, const std::string& outputPath) {
-    std::ifstream inFile(inputPath, std::ios::binary);
-    if (!inFile) {
+bool compressFile(const std::string& inputPath, const std::string& outputPath, const std::string& format) {
+    try {
+        CompressionConfig config;
+        config.format = format;
+        config.level = "high";
+        return Compressor(config).compressFile(inputPath, outputPath);
+    } catch (const DatabaseBackupError&) {
         return false;
     }
+}
 
-    std::ofstream outFile(outputPath, std::ios::binary);
-    if (!outFile) {
-        return false;
-    }
-
-    z_stream zs;
-    zs.zalloc = Z_NULL;
-    zs.zfree = Z_NULL;
-    zs.opaque = Z_NULL;
-
-    // Use maximum compression level and best strategy
-    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 31, 9, Z_FILTERED) != Z_OK) {
-        return false;
+std::string stripCompressionExtension(const std::string& path, const Codec& codec) {
+    std::string ext = codec.extension();
+    if (path.size() > ext.size() && path.compare(path.size() - ext.size(), ext.size(), ext) == 0) {
+        return path.substr(0, path.size() - ext.size());
     }
-
-    // Use a larger buffer for better compression
-    std::vector<char> inBuffer(262144);  // 256KB
-    std::vector<char> outBuffer(262144); // 256KB
-
-    do {
-        inFile.read(inBuffer.data(), inBuffer.size());
-        zs.avail_in = static_cast<uInt>(inFile.gcount());
-        zs.next_in = reinterpret_cast<Bytef*>(inBuffer.data());
-
-        do {
-            zs.avail_out = static_cast<uInt>(outBuffer.size());
-            zs.next_out = reinterpret_cast<Bytef*>(outBuffer.data());
-
-            int ret = deflate(&zs, inFile.eof() ? Z_FINISH : Z_NO_FLUSH);
-            if (ret == Z_STREAM_ERROR) {
-                deflateEnd(&zs);
-                return false;
-            }
-
-            outFile.write(outBuffer.data(), outBuffer.size() - zs.avail_out);
-        } while (zs.avail_out == 0);
-    } while (!inFile.eof());
-
-    deflateEnd(&zs);
-    return true;
+    return path + ".raw";
 }
 
 bool decompressFile(const std::string& inputPath, const std::string& outputPath) {
-    std::ifstream inFile(inputPath, std::ios::binary);
-    if (!inFile) {
-        return false;
-    }
-
-    std::ofstream outFile(outputPath, std::ios::binary);
-    if (!outFile) {
-        return false;
-    }
-
-    z_stream zs;
-    zs.zalloc = Z_NULL;
-    zs.zfree = Z_NULL;
-    zs.opaque = Z_NULL;
-    zs.avail_in = 0;
-    zs.next_in = Z_NULL;
-
-    if (inflateInit2(&zs, 31) != Z_OK) {
+    try {
+        auto codec = CodecRegistry::getInstance().detectFile(inputPath);
+        if (!codec) {
+            logError("Compression", "Unrecognized compression format: " + inputPath);
+            return false;
+        }
+        return Compressor(codec, CompressionConfig{}).decompressFile(inputPath, outputPath);
+    } catch (const DatabaseBackupError&) {
         return false;
     }
-
-    std::vector<char> inBuffer(32768);
-    std::vector<char> outBuffer(32768);
-
-    do {
-        inFile.read(inBuffer.data(), inBuffer.size());
-        zs.avail_in = static_cast<uInt>(inFile.gcount());
-        zs.next_in = reinterpret_cast<Bytef*>(inBuffer.data());
-
-        do {
-            zs.avail_out = static_cast<uInt>(outBuffer.size());
-            zs.next_out = reinterpret_cast<Bytef*>(outBuffer.data());
-
-            int ret = inflate(&zs, Z_NO_FLUSH);
-            if (ret == Z_STREAM_ERROR || ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR) {
-                inflateEnd(&zs);
-                return false;
-            }
-
-            outFile.write(outBuffer.data(), outBuffer.size() - zs.avail_out);
-        } while (zs.avail_out == 0);
-    } while (inFile.good() && !inFile.eof());
-
-    inflateEnd(&zs);
-    return true;
 }
 
 } // namespace dbbackup
@@ -1,15 +1,21 @@
 #pragma once
 
+#include "../include/compression.hpp"
 #include <string>
 
 namespace dbbackup {
 
-/// Compresses the file at inputPath, writes to outputPath.
-/// Returns true on success.
-bool compressFile(const std::string& inputPath, const std::string& outputPath);
+/// Compresses the file at inputPath with the named codec at its highest
+/// level, writes to outputPath. Returns true on success.
+bool compressFile(const std::string& inputPath, const std::string& outputPath,
+                  const std::string& format = "gzip");
 
-/// Decompresses the file at inputPath, writes to outputPath.
-/// Returns true on success.
+/// Decompresses the file at inputPath, writes to outputPath. The format is
+/// detected from the file's magic bytes. Returns true on success.
 bool decompressFile(const std::string& inputPath, const std::string& outputPath);
 
+/// Path a compressed file decompresses to: the codec's extension removed,
+/// or ".raw" appended if the name doesn't carry it
+std::string stripCompressionExtension(const std::string& path, const Codec& codec);
+
 } // namespace dbbackup
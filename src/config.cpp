@@ -1,4 +1,5 @@
 #include "config.hpp"
+#include "codec_registry.hpp"
 #include "error/ErrorUtils.hpp"
 #include <fstream>
 #include <nlohmann/json.hpp>
@@ -150,6 +151,28 @@ Config Config::fromFile(const std::string& configPath) {
         if (storageConfig.contains("cloudPath")) {
             config.storage.cloudPath = storageConfig["cloudPath"].get<std::string>();
         }
+        if (storageConfig.contains("deduplicate")) {
+            config.storage.deduplicate = storageConfig["deduplicate"].get<bool>();
+        }
+        if (storageConfig.contains("upload")) {
+            const auto& uploadConfig = storageConfig["upload"];
+            config.storage.upload.partSizeMB = uploadConfig.value("partSizeMB", 64);
+            config.storage.upload.concurrency = uploadConfig.value("concurrency", 4);
+            config.storage.upload.bandwidthLimitMBps = uploadConfig.value("bandwidthLimitMBps", 0.0);
+        }
+        if (storageConfig.contains("tiering")) {
+            const auto& tieringConfig = storageConfig["tiering"];
+            config.storage.tiering.hotBackups = tieringConfig.value("hotBackups", 0);
+            config.storage.tiering.archivePath = tieringConfig.value("archivePath", "");
+        }
+        if (storageConfig.contains("scrub")) {
+            const auto& scrubConfig = storageConfig["scrub"];
+            config.storage.scrub.enabled = scrubConfig.value("enabled", false);
+            config.storage.scrub.intervalDays = scrubConfig.value("intervalDays", 30);
+            config.storage.scrub.bandwidthLimitMBps = scrubConfig.value("bandwidthLimitMBps", 20.0);
+            config.storage.scrub.cpuPercent = scrubConfig.value("cpuPercent", 25);
+            config.storage.scrub.decompress = scrubConfig.value("decompress", false);
+        }
 
         // Logging configuration
         DB_CHECK(configJson.contains("logging"), ConfigurationError, "Missing 'logging' section in config");
@@ -181,6 +204,19 @@ Config Config::fromFile(const std::string& configPath) {
                 config.backup.compression.enabled = compressionConfig.value("enabled", false);
                 config.backup.compression.format = compressionConfig.value("format", "gzip");
                 config.backup.compression.level = compressionConfig.value("level", "medium");
+                config.backup.compression.threads = compressionConfig.value("threads", 1);
+                config.backup.compression.decodeThreads = compressionConfig.value("decodeThreads", 0);
+                config.backup.compression.longDistance = compressionConfig.value("longDistance", false);
+                config.backup.compression.sampleSizeMB = compressionConfig.value("sampleSizeMB", 16);
+                config.backup.compression.targetThroughputMBps =
+                    compressionConfig.value("targetThroughputMBps", 50.0);
+                config.backup.compression.blockFramed = compressionConfig.value("blockFramed", false);
+                config.backup.compression.blockSizeKB = compressionConfig.value("blockSizeKB", 1024);
+                config.backup.compression.minBlockSavings = compressionConfig.value("minBlockSavings", 0.05);
+                config.backup.compression.useDictionary = compressionConfig.value("useDictionary", false);
+                config.backup.compression.dictionarySizeKB = compressionConfig.value("dictionarySizeKB", 112);
+                config.backup.compression.bufferSizeKB = compressionConfig.value("bufferSizeKB", 1024);
+                config.backup.compression.directIO = compressionConfig.value("directIO", false);
             }
             
             // Retention settings
@@ -188,6 +224,9 @@ Config Config::fromFile(const std::string& configPath) {
                 const auto& retentionConfig = backupConfig["retention"];
                 config.backup.retention.days = retentionConfig.value("days", 30);
                 config.backup.retention.maxBackups = retentionConfig.value("maxBackups", 10);
+                config.backup.retention.keepDaily = retentionConfig.value("keepDaily", 0);
+                config.backup.retention.keepWeekly = retentionConfig.value("keepWeekly", 0);
+                config.backup.retention.keepMonthly = retentionConfig.value("keepMonthly", 0);
             }
             
             // Schedule settings
@@ -273,19 +312,93 @@ Config Config::fromFile(const std::string& configPath) {
         DB_CHECK(!config.logging.logPath.empty(), ConfigurationError, "Log path cannot be empty");
         DB_CHECK(!config.logging.logLevel.empty(), ConfigurationError, "Log level cannot be empty");
 
+        // Validate upload configuration
+        DB_CHECK(config.storage.cloudProvider.empty() || config.storage.cloudProvider == "local" ||
+                config.storage.cloudProvider == "filesystem",
+                ConfigurationError, "Unsupported cloud provider: " + config.storage.cloudProvider);
+        if (!config.storage.cloudProvider.empty() && config.storage.cloudProvider != "local") {
+            DB_CHECK(!config.storage.cloudPath.empty(), ConfigurationError,
+                    "storage.cloudPath is required for cloud provider " + config.storage.cloudProvider);
+            const auto& upload = config.storage.upload;
+            DB_CHECK(upload.partSizeMB >= 5 && upload.partSizeMB <= 5120,
+                    ConfigurationError, "Invalid upload part size");
+            DB_CHECK(upload.concurrency >= 1 && upload.concurrency <= 64,
+                    ConfigurationError, "Invalid upload concurrency");
+            DB_CHECK(upload.bandwidthLimitMBps >= 0,
+                    ConfigurationError, "Invalid upload bandwidth limit");
+            // A manifest is useless off-site without its chunk store
+            DB_CHECK(!config.storage.deduplicate, ConfigurationError,
+                    "Deduplicated storage cannot be combined with an off-site copy");
+        }
+
+        // Validate tiering configuration
+        DB_CHECK(config.storage.tiering.hotBackups >= 0, ConfigurationError, "Invalid tiering hot backup count");
+        if (config.storage.tiering.hotBackups > 0) {
+            DB_CHECK(!config.storage.tiering.archivePath.empty() &&
+                    config.storage.tiering.archivePath != config.storage.localPath,
+                    ConfigurationError, "Tiering needs an archive path other than the local path");
+        }
+
+        // Validate scrub configuration
+        if (config.storage.scrub.enabled) {
+            DB_CHECK(config.storage.scrub.intervalDays >= 1, ConfigurationError, "Invalid scrub interval");
+            DB_CHECK(config.storage.scrub.bandwidthLimitMBps >= 0, ConfigurationError, "Invalid scrub bandwidth limit");
+            DB_CHECK(config.storage.scrub.cpuPercent >= 1 && config.storage.scrub.cpuPercent <= 100,
+                    ConfigurationError, "Invalid scrub CPU percentage");
+        }
+
         // Validate backup configuration
         if (config.backup.compression.enabled) {
-            DB_CHECK(config.backup.compression.format == "gzip" || 
-                    config.backup.compression.format == "bzip2" ||
-                    config.backup.compression.format == "xz",
+            DB_CHECK(config.backup.compression.format == "auto" ||
+                    CodecRegistry::getInstance().findByName(config.backup.compression.format) != nullptr,
                     ConfigurationError, "Invalid compression format");
+            // Containers come from blockFramed, which honours the block settings
+            DB_CHECK(config.backup.compression.format != "framed", ConfigurationError,
+                    "Compression format \"framed\" is not configurable; set \"blockFramed\": true instead");
             
             DB_CHECK(config.backup.compression.level == "low" ||
                     config.backup.compression.level == "medium" ||
                     config.backup.compression.level == "high",
                     ConfigurationError, "Invalid compression level");
+
+            DB_CHECK(config.backup.compression.threads >= 0,
+                    ConfigurationError, "Invalid compression thread count");
+            DB_CHECK(config.backup.compression.decodeThreads >= 0,
+                    ConfigurationError, "Invalid decode thread count");
+
+            if (config.backup.compression.blockFramed) {
+                DB_CHECK(config.backup.compression.blockSizeKB > 0 &&
+                        config.backup.compression.blockSizeKB <= 65536,
+                        ConfigurationError, "Invalid compression block size");
+                DB_CHECK(config.backup.compression.minBlockSavings >= 0 &&
+                        config.backup.compression.minBlockSavings < 1,
+                        ConfigurationError, "Invalid minimum block savings");
+            }
+
+            DB_CHECK(config.backup.compression.bufferSizeKB > 0 &&
+                    config.backup.compression.bufferSizeKB <= 65536,
+                    ConfigurationError, "Invalid compression buffer size");
+
+            if (config.backup.compression.useDictionary) {
+                DB_CHECK(config.backup.compression.dictionarySizeKB > 0 &&
+                        config.backup.compression.dictionarySizeKB <= 1024,
+                        ConfigurationError, "Invalid compression dictionary size");
+            }
+
+            if (config.backup.compression.format == "auto") {
+                DB_CHECK(config.backup.compression.sampleSizeMB > 0,
+                        ConfigurationError, "Invalid compression sample size");
+                DB_CHECK(config.backup.compression.targetThroughputMBps > 0,
+                        ConfigurationError, "Invalid compression target throughput");
+            }
         }
 
+        // Validate retention configuration
+        const auto& retention = config.backup.retention;
+        DB_CHECK(retention.days >= 0 && retention.maxBackups >= 0 &&
+                retention.keepDaily >= 0 && retention.keepWeekly >= 0 && retention.keepMonthly >= 0,
+                ConfigurationError, "Invalid retention policy");
+
         // Validate schedule configuration
         if (config.backup.schedule.enabled) {
             std::regex cron_pattern("^(\\*|[0-9,\\-\\*/]+)\\s+(\\*|[0-9,\\-\\*/]+)\\s+(\\*|[0-9,\\-\\*/]+)\\s+(\\*|[0-9,\\-\\*/]+)\\s+(\\*|[0-9,\\-\\*/]+)$");
@@ -3,7 +3,9 @@
 #include "credential_manager.hpp"
 #include <iostream>
 #include <cstdlib>
+#include <exception>
 #include <filesystem>
+#include <fstream>
 #include <sstream>
 
 using namespace dbbackup::error;
@@ -96,16 +98,32 @@ bool MySQLConnection::disconnect() {
 
 bool MySQLConnection::createBackup(const std::string& backupPath) {
     DB_TRY_CATCH_LOG("MySQLConnection", {
-        if (!mysql || mysql_ping(mysql) != 0) {
-            DB_THROW(BackupError, "Not connected to MySQL server");
-        }
-
         // Create the backup directory if it doesn't exist
         std::filesystem::path backupFilePath(backupPath);
         if (auto parentPath = backupFilePath.parent_path(); !parentPath.empty()) {
             std::filesystem::create_directories(parentPath);
         }
 
+        dbbackup::FileSink file(backupPath);
+        if (!file) {
+            DB_THROW(BackupError, "Failed to create backup file: " + backupPath);
+        }
+        if (!streamBackup(file, backupPath)) {
+            return false;
+        }
+        file.finish();
+        return true;
+    });
+    
+    return false;
+}
+
+bool MySQLConnection::streamBackup(dbbackup::OutputSink& sink, const std::string& scratchPath) {
+    DB_TRY_CATCH_LOG("MySQLConnection", {
+        if (!mysql || mysql_ping(mysql) != 0) {
+            DB_THROW(BackupError, "Not connected to MySQL server");
+        }
+
         // Get password from credential manager
         auto& credManager = CredentialManager::getInstance();
         auto cred = credManager.getCredential(
@@ -119,7 +137,7 @@ bool MySQLConnection::createBackup(const std::string& backupPath) {
         }
 
         // Create a temporary file for the password
-        std::string tempPwFile = backupPath + ".pw";
+        std::string tempPwFile = scratchPath + ".pw";
         {
             std::ofstream pwFile(tempPwFile);
             pwFile << "[client]\n"
@@ -129,7 +147,8 @@ bool MySQLConnection::createBackup(const std::string& backupPath) {
             std::filesystem::perms::owner_read | 
             std::filesystem::perms::owner_write);
 
-        // Construct mysqldump command using defaults-extra-file for password
+        // Construct mysqldump command using defaults-extra-file for password,
+        // dumping to stdout
         std::string cmd = "mysqldump"
             " --defaults-extra-file=" + tempPwFile +
             " --host=" + currentConfig.host +
@@ -141,14 +160,23 @@ bool MySQLConnection::createBackup(const std::string& backupPath) {
             " --create-options" +
             " --quote-names" +
             " --single-transaction" +  // For InnoDB tables
-            " --set-gtid-purged=OFF" +
-            " --result-file=" + backupPath;
-
-        int result = system(cmd.c_str());
+            " --set-gtid-purged=OFF";
+
+        // Hold on to sink failures until the password file is cleaned up
+        int result = -1;
+        std::exception_ptr streamError;
+        try {
+            result = runCommandToSink(cmd, sink);
+        } catch (...) {
+            streamError = std::current_exception();
+        }
         
         // Always remove the temporary password file
         std::filesystem::remove(tempPwFile);
 
+        if (streamError) {
+            std::rethrow_exception(streamError);
+        }
         if (result != 0) {
             DB_THROW(BackupError, "mysqldump failed with error code: " + 
                     std::to_string(result));
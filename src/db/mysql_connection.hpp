@@ -13,6 +13,7 @@ public:
     bool disconnect() override;
     bool createBackup(const std::string& backupPath) override;
     bool restoreBackup(const std::string& backupPath) override;
+    bool streamBackup(dbbackup::OutputSink& sink, const std::string& scratchPath) override;
 
 private:
     dbbackup::DatabaseConfig currentConfig;  // Store config for backup/restore operations
@@ -3,7 +3,9 @@
 #include "credential_manager.hpp"
 #include <iostream>
 #include <cstdlib>
+#include <exception>
 #include <filesystem>
+#include <fstream>
 #include <sstream>
 
 using namespace dbbackup::error;
@@ -99,16 +101,32 @@ bool PostgreSQLConnection::disconnect() {
 
 bool PostgreSQLConnection::createBackup(const std::string& backupPath) {
     DB_TRY_CATCH_LOG("PostgreSQLConnection", {
-        if (!conn || !conn->is_open()) {
-            DB_THROW(BackupError, "Not connected to PostgreSQL server");
-        }
-
         // Create the backup directory if it doesn't exist
         std::filesystem::path backupFilePath(backupPath);
         if (auto parentPath = backupFilePath.parent_path(); !parentPath.empty()) {
             std::filesystem::create_directories(parentPath);
         }
 
+        dbbackup::FileSink file(backupPath);
+        if (!file) {
+            DB_THROW(BackupError, "Failed to create backup file: " + backupPath);
+        }
+        if (!streamBackup(file, backupPath)) {
+            return false;
+        }
+        file.finish();
+        return true;
+    });
+    
+    return false;
+}
+
+bool PostgreSQLConnection::streamBackup(dbbackup::OutputSink& sink, const std::string& scratchPath) {
+    DB_TRY_CATCH_LOG("PostgreSQLConnection", {
+        if (!conn || !conn->is_open()) {
+            DB_THROW(BackupError, "Not connected to PostgreSQL server");
+        }
+
         // Get password from credential manager
         auto& credManager = CredentialManager::getInstance();
         auto cred = credManager.getCredential(
@@ -122,7 +140,7 @@ bool PostgreSQLConnection::createBackup(const std::string& backupPath) {
         }
 
         // Create a temporary file for the password
-        std::string tempPwFile = backupPath + ".pgpass";
+        std::string tempPwFile = scratchPath + ".pgpass";
         {
             std::ofstream pwFile(tempPwFile);
             pwFile << currentConfig.host << ":" 
@@ -142,16 +160,22 @@ bool PostgreSQLConnection::createBackup(const std::string& backupPath) {
         }
         setenv("PGPASSFILE", tempPwFile.c_str(), 1);
 
-        // Construct pg_dump command without password
+        // Construct pg_dump command without password, dumping to stdout
         std::string cmd = "pg_dump" +
             std::string(" -h ") + currentConfig.host +
             " -p " + std::to_string(currentConfig.port) +
             " -U " + currentConfig.credentials.username +
             " -d " + currentDatabase +
-            " -F p" + // Plain text format
-            " -f " + backupPath;
+            " -F p";  // Plain text format
 
-        int result = system(cmd.c_str());
+        // Hold on to sink failures until the password file is cleaned up
+        int result = -1;
+        std::exception_ptr streamError;
+        try {
+            result = runCommandToSink(cmd, sink);
+        } catch (...) {
+            streamError = std::current_exception();
+        }
 
         // Restore old PGPASSFILE if it existed
         if (!oldPgpassfile.empty()) {
@@ -163,6 +187,9 @@ bool PostgreSQLConnection::createBackup(const std::string& backupPath) {
         // Always remove the temporary password file
         std::filesystem::remove(tempPwFile);
 
+        if (streamError) {
+            std::rethrow_exception(streamError);
+        }
         if (result != 0) {
             DB_THROW(BackupError, "pg_dump failed with error code: " + 
                     std::to_string(result));
@@ -4,9 +4,59 @@
 #include "db/mongodb_connection.hpp"
 #include "db/sqlite_connection.hpp"
 #include "error/ErrorUtils.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <vector>
 
 using namespace dbbackup::error;
 
+bool IDBConnection::streamBackup(dbbackup::OutputSink& sink, const std::string& scratchPath) {
+    DB_TRY_CATCH_LOG("DBConnection", {
+        if (!createBackup(scratchPath)) {
+            return false;
+        }
+
+        try {
+            dbbackup::FileSource dump(scratchPath);
+            if (!dump) {
+                DB_THROW(BackupError, "Failed to open dump file: " + scratchPath);
+            }
+            dbbackup::copyStream(dump, sink);
+        } catch (...) {
+            std::filesystem::remove(scratchPath);
+            throw;
+        }
+
+        std::filesystem::remove(scratchPath);
+        return true;
+    });
+    return false;
+}
+
+int runCommandToSink(const std::string& command, dbbackup::OutputSink& sink) {
+    FILE* pipe = popen(command.c_str(), "r");
+    if (!pipe) {
+        DB_THROW(BackupError, "Failed to start command: " + command.substr(0, command.find(' ')));
+    }
+
+    std::vector<char> buffer(262144);  // 256KB reads from the pipe
+    try {
+        size_t n;
+        while ((n = fread(buffer.data(), 1, buffer.size(), pipe)) > 0) {
+            sink.write(buffer.data(), n);
+        }
+        if (ferror(pipe)) {
+            DB_THROW(BackupError, "Failed to read command output");
+        }
+    } catch (...) {
+        // Closing our end makes the child fail with SIGPIPE instead of blocking
+        pclose(pipe);
+        throw;
+    }
+
+    return pclose(pipe);
+}
+
 std::unique_ptr<IDBConnection> createDBConnection(const dbbackup::DatabaseConfig& dbConfig) {
     DB_TRY_CATCH_LOG("DBConnection", {
         if (dbConfig.type == "mysql") {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "config.hpp"
+#include "stream.hpp"
 #include <string>
 #include <memory>
 
@@ -14,7 +15,17 @@ public:
     /// Create a backup at the specified path
     virtual bool createBackup(const std::string& backupPath) = 0;
     virtual bool restoreBackup(const std::string& backupPath) = 0;
+
+    /// Stream a backup into sink without materializing a plain dump.
+    /// Backends whose dump tool can write to stdout override this; the default
+    /// dumps to scratchPath via createBackup, copies it into sink and removes it.
+    /// The sink is not finished.
+    virtual bool streamBackup(dbbackup::OutputSink& sink, const std::string& scratchPath);
 };
 
+/// Runs a shell command and copies its standard output into sink
+/// Returns the exit status as reported by pclose
+int runCommandToSink(const std::string& command, dbbackup::OutputSink& sink);
+
 /// Factory function to create a database connection object depending on dbConfig.type
 std::unique_ptr<IDBConnection> createDBConnection(const dbbackup::DatabaseConfig& dbConfig);
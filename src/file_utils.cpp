@@ -0,0 +1,239 @@
+#include "file_utils.hpp"
+#include "stream.hpp"
+#include "error/ErrorUtils.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#elif defined(__APPLE__)
+#include <sys/clonefile.h>
+#endif
+
+namespace fs = std::filesystem;
+using namespace dbbackup::error;
+
+namespace dbbackup {
+
+namespace {
+    // Closes a descriptor on scope exit
+    struct Descriptor {
+        int fd;
+        explicit Descriptor(int fd) : fd(fd) {}
+        ~Descriptor() {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+        Descriptor(const Descriptor&) = delete;
+        Descriptor& operator=(const Descriptor&) = delete;
+    };
+
+    bool deviceOf(const std::string& path, dev_t& device) {
+        struct stat info;
+        fs::path probe(path);
+        // A destination that does not exist yet lands on its directory's device
+        while (::stat(probe.c_str(), &info) != 0) {
+            if (!probe.has_parent_path() || probe.parent_path() == probe) {
+                return false;
+            }
+            probe = probe.parent_path();
+        }
+        device = info.st_dev;
+        return true;
+    }
+
+    // Errors that mean "this filesystem or kernel can't do that", as
+    // opposed to a failed copy
+    bool unsupported(int error) {
+        return error == EXDEV || error == EINVAL || error == ENOSYS || error == EOPNOTSUPP ||
+               error == ENOTTY || error == EBADF;
+    }
+
+    bool reflink(const std::string& source, const std::string& destination) {
+#if defined(__linux__) && defined(FICLONE)
+        Descriptor in(::open(source.c_str(), O_RDONLY | O_CLOEXEC));
+        // Not truncated: if the clone fails, blocks a SpaceReservation
+        // preallocated are still there for the copy that follows
+        Descriptor out(::open(destination.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644));
+        if (in.fd < 0 || out.fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (::fstat(in.fd, &info) != 0 || ::ioctl(out.fd, FICLONE, in.fd) != 0) {
+            return false;
+        }
+        return ::ftruncate(out.fd, info.st_size) == 0;
+#elif defined(__APPLE__)
+        ::unlink(destination.c_str());
+        return ::clonefile(source.c_str(), destination.c_str(), 0) == 0;
+#else
+        (void)source;
+        (void)destination;
+        return false;
+#endif
+    }
+
+    // False if the kernel cannot copy between these files; throws if it can
+    // but the copy fails
+    bool kernelCopy(const std::string& source, const std::string& destination) {
+#if defined(__linux__)
+        Descriptor in(::open(source.c_str(), O_RDONLY | O_CLOEXEC));
+        if (in.fd < 0) {
+            DB_THROW(StorageError, "Failed to open file: " + source + ": " + std::strerror(errno));
+        }
+        // Not truncated: blocks a SpaceReservation preallocated are written over
+        Descriptor out(::open(destination.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644));
+        if (out.fd < 0) {
+            DB_THROW(StorageError, "Failed to create file: " + destination + ": " + std::strerror(errno));
+        }
+        struct stat info;
+        if (::fstat(in.fd, &info) != 0) {
+            return false;
+        }
+        uint64_t remaining = static_cast<uint64_t>(info.st_size);
+        bool copied = false;
+        while (remaining > 0) {
+            ssize_t n = ::copy_file_range(in.fd, nullptr, out.fd, nullptr,
+                                          static_cast<size_t>(std::min<uint64_t>(remaining, 1ULL << 30)), 0);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (!copied && unsupported(errno)) {
+                    return false;
+                }
+                DB_THROW(StorageError, "Failed to copy file: " + source + ": " + std::strerror(errno));
+            }
+            if (n == 0) {
+                break;  // Source shrank under us
+            }
+            copied = true;
+            remaining -= static_cast<uint64_t>(n);
+        }
+        if (remaining == 0 && ::ftruncate(out.fd, info.st_size) != 0) {
+            DB_THROW(StorageError, "Failed to truncate file: " + destination + ": " + std::strerror(errno));
+        }
+        return remaining == 0;
+#else
+        (void)source;
+        (void)destination;
+        return false;
+#endif
+    }
+
+    void streamCopy(const std::string& source, const std::string& destination, checksum::Digest* digest) {
+        FileSource in(source);
+        FileIOOptions io;
+        io.overwrite = true;
+        FileSink out(destination, io);
+        if (!in || !out) {
+            DB_THROW(StorageError, "Failed to copy file: " + source + " to " + destination);
+        }
+        checksum::DigestSink sink(out);
+        copyStream(in, sink);
+        sink.finish();
+        if (digest) {
+            *digest = sink.digest();
+        }
+    }
+}
+
+std::string placeMethodToString(PlaceMethod method) {
+    switch (method) {
+        case PlaceMethod::Renamed: return "renamed";
+        case PlaceMethod::Reflinked: return "reflinked";
+        case PlaceMethod::KernelCopied: return "kernel copy";
+        case PlaceMethod::Streamed: return "streamed";
+    }
+    return "unknown";
+}
+
+void syncFile(const std::string& path) {
+    Descriptor file(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (file.fd < 0 || ::fdatasync(file.fd) != 0) {
+        DB_THROW(StorageError, "Failed to sync file: " + path + ": " + std::strerror(errno));
+    }
+}
+
+void syncDirectory(const std::string& directory) {
+    Descriptor dir(::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (dir.fd < 0) {
+        DB_THROW(StorageError, "Failed to open directory: " + directory + ": " + std::strerror(errno));
+    }
+    if (::fsync(dir.fd) != 0 && !unsupported(errno)) {
+        DB_THROW(StorageError, "Failed to sync directory: " + directory + ": " + std::strerror(errno));
+    }
+}
+
+void syncFilesystem(const std::string& path) {
+#if defined(__linux__)
+    Descriptor any(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (any.fd < 0 || ::syncfs(any.fd) != 0) {
+        DB_THROW(StorageError, "Failed to sync filesystem of: " + path + ": " + std::strerror(errno));
+    }
+#else
+    (void)path;
+    ::sync();
+#endif
+}
+
+void commitFile(const std::string& tmp, const std::string& destination) {
+    std::error_code error;
+    fs::rename(tmp, destination, error);
+    if (error) {
+        DB_THROW(StorageError, "Failed to rename " + tmp + " to " + destination + ": " + error.message());
+    }
+    syncDirectory(fs::path(destination).parent_path().string());
+}
+
+bool sameFilesystem(const std::string& a, const std::string& b) {
+    dev_t first;
+    dev_t second;
+    return deviceOf(a, first) && deviceOf(b, second) && first == second;
+}
+
+PlaceMethod placeFile(const std::string& source, const std::string& destination, bool move,
+                      checksum::Digest* digest) {
+    if (move) {
+        std::error_code error;
+        fs::rename(source, destination, error);
+        if (!error) {
+            if (digest) {
+                *digest = checksum::digestFile(destination);
+            }
+            return PlaceMethod::Renamed;
+        }
+        if (error != std::errc::cross_device_link) {
+            DB_THROW(StorageError, "Failed to move file: " + source + ": " + error.message());
+        }
+    }
+
+    // Clones never cross filesystems; trying one would only cost a syscall
+    PlaceMethod method = PlaceMethod::Streamed;
+    try {
+        if (sameFilesystem(source, destination) && reflink(source, destination)) {
+            method = PlaceMethod::Reflinked;
+        } else if (kernelCopy(source, destination)) {
+            method = PlaceMethod::KernelCopied;
+        } else {
+            streamCopy(source, destination, digest);
+        }
+        if (digest && method != PlaceMethod::Streamed) {
+            *digest = checksum::digestFile(destination);
+        }
+    } catch (...) {
+        std::error_code ignored;
+        fs::remove(destination, ignored);
+        throw;
+    }
+    return method;
+}
+
+} // namespace dbbackup
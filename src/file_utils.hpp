@@ -0,0 +1,50 @@
+#pragma once
+
+#include "checksum.hpp"
+#include <string>
+
+namespace dbbackup {
+
+/// How placeFile put the data at its destination, cheapest first
+enum class PlaceMethod {
+    Renamed,       // Same filesystem, source moved
+    Reflinked,     // Copy-on-write clone sharing the source's extents (btrfs, XFS, APFS)
+    KernelCopied,  // copy_file_range: copied without passing through user space
+    Streamed       // Read and written through user space, e.g. across devices
+};
+
+std::string placeMethodToString(PlaceMethod method);
+
+/// Put the contents of source at destination (replacing it) as cheaply as
+/// the filesystems allow. With move set the source is renamed when both are
+/// on one filesystem. Otherwise it is copied and left in place, so it is
+/// never removed before the copy is durable: the caller deletes it after
+/// syncing and committing the destination, unless Renamed is returned. If
+/// digest is given
+/// it receives the destination's size and checksums, computed on the way
+/// through when streaming and by reading the destination otherwise. Throws
+/// StorageError on failure, leaving no partial destination.
+PlaceMethod placeFile(const std::string& source, const std::string& destination, bool move,
+                      checksum::Digest* digest = nullptr);
+
+/// Flush a file's data to disk (fdatasync). Throws StorageError on failure.
+void syncFile(const std::string& path);
+
+/// Flush a directory, making renames and new entries in it durable.
+/// Filesystems that cannot sync directories are skipped.
+void syncDirectory(const std::string& directory);
+
+/// Flush everything written to the filesystem holding path (syncfs), one
+/// flush for many files
+void syncFilesystem(const std::string& path);
+
+/// Last step of writing a file durably: rename tmp, whose data must already
+/// be synced, over destination and sync the directory. After a crash either
+/// the old destination or the complete new one is there.
+void commitFile(const std::string& tmp, const std::string& destination);
+
+/// True if both paths (or, for paths that do not exist yet, their parent
+/// directories) are on the same device
+bool sameFilesystem(const std::string& a, const std::string& b);
+
+} // namespace dbbackup
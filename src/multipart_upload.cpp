@@ -0,0 +1,152 @@
+#include "multipart_upload.hpp"
+#include "error/ErrorUtils.hpp"
+#include <algorithm>
+#include <thread>
+
+using namespace dbbackup::error;
+
+namespace dbbackup {
+
+TokenBucket::TokenBucket(double bytesPerSecond)
+    : rate(bytesPerSecond), available(0), last(std::chrono::steady_clock::now()) {}
+
+void TokenBucket::acquire(size_t size) {
+    if (rate <= 0) {
+        return;
+    }
+    std::chrono::duration<double> wait;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto now = std::chrono::steady_clock::now();
+        // Unused allowance is capped at one second's worth of bursting
+        available = std::min(rate, available + std::chrono::duration<double>(now - last).count() * rate);
+        last = now;
+        available -= static_cast<double>(size);
+        wait = std::chrono::duration<double>(available < 0 ? -available / rate : 0);
+    }
+    if (wait.count() > 0) {
+        std::this_thread::sleep_for(wait);
+    }
+}
+
+UploadOptions UploadOptions::fromConfig(const UploadConfig& config) {
+    UploadOptions options;
+    options.partSize = static_cast<size_t>(std::max(config.partSizeMB, 1)) << 20;
+    options.concurrency = static_cast<size_t>(std::max(config.concurrency, 1));
+    options.bandwidth = std::max(config.bandwidthLimitMBps, 0.0) * 1024 * 1024;
+    return options;
+}
+
+MultipartUploader::MultipartUploader(ObjectStore& store, std::string key, UploadOptions options)
+    : store(store), key(std::move(key)), options(options), bandwidth(options.bandwidth) {
+    DB_CHECK(options.partSize > 0, StorageError, "Upload part size must be positive");
+    this->options.concurrency = std::max<size_t>(1, options.concurrency);
+    uploadId = store.createMultipartUpload(this->key);
+    pool = std::make_unique<ThreadPool>(this->options.concurrency);
+    buffer.reserve(options.partSize);
+}
+
+MultipartUploader::~MultipartUploader() {
+    if (!done) {
+        abort();
+    }
+}
+
+void MultipartUploader::write(const char* data, size_t size) {
+    DB_CHECK(!done, StorageError, "Write to a finished upload of " + key);
+    while (size > 0) {
+        size_t n = std::min(size, options.partSize - buffer.size());
+        buffer.append(data, n);
+        data += n;
+        size -= n;
+        if (buffer.size() == options.partSize) {
+            submitPart();
+        }
+    }
+}
+
+void MultipartUploader::submitPart() {
+    // Bound memory: wait for the oldest part before queueing past the limit
+    while (pending.size() >= options.concurrency) {
+        collectOldest();
+    }
+    auto part = std::make_shared<std::string>(std::move(buffer));
+    buffer = std::string();
+    buffer.reserve(options.partSize);
+    int number = nextPart++;
+    pending.push_back(pool->submit([this, part, number]() {
+        bandwidth.acquire(part->size());
+        return store.uploadPart(key, uploadId, number, part->data(), part->size());
+    }));
+}
+
+void MultipartUploader::collectOldest() {
+    std::future<UploadedPart> oldest = std::move(pending.front());
+    pending.pop_front();
+    try {
+        parts.push_back(oldest.get());
+    } catch (...) {
+        abort();
+        throw;
+    }
+}
+
+void MultipartUploader::finish() {
+    if (done) {
+        return;
+    }
+    try {
+        // An empty object is still uploaded as one empty part
+        if (!buffer.empty() || nextPart == 1) {
+            submitPart();
+        }
+        while (!pending.empty()) {
+            collectOldest();
+        }
+        store.completeMultipartUpload(key, uploadId, parts);
+    } catch (...) {
+        abort();
+        throw;
+    }
+    pool.reset();
+    done = true;
+}
+
+void MultipartUploader::abort() noexcept {
+    done = true;
+    // Let parts in flight land before discarding them
+    for (auto& part : pending) {
+        part.wait();
+    }
+    pending.clear();
+    pool.reset();
+    store.abortMultipartUpload(key, uploadId);
+}
+
+void uploadFile(ObjectStore& store, const std::string& path, const std::string& key,
+                const UploadOptions& options) {
+    FileSource in(path);
+    if (!in) {
+        DB_THROW(StorageError, "Failed to open file: " + path);
+    }
+    MultipartUploader uploader(store, key, options);
+    copyStream(in, uploader);
+    uploader.finish();
+}
+
+std::string dictionaryKey(const std::string& id) {
+    return "dictionaries/" + id + ".dict";
+}
+
+void uploadDictionary(ObjectStore& store, const std::string& id, const std::string& dictionary,
+                      const UploadOptions& options) {
+    std::string key = dictionaryKey(id);
+    if (store.exists(key)) {
+        return;
+    }
+    MultipartUploader uploader(store, key, options);
+    uploader.write(dictionary.data(), dictionary.size());
+    uploader.finish();
+}
+
+} // namespace dbbackup
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "object_store.hpp"
+#include "stream.hpp"
+#include "thread_pool.hpp"
+#include <chrono>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace dbbackup {
+
+/// Limits throughput shared by several threads to a byte rate. Callers take
+/// tokens before sending; a caller that overdraws the bucket waits until the
+/// debt is repaid, so bursts average out to the rate.
+class TokenBucket {
+public:
+    /// 0 = unlimited
+    explicit TokenBucket(double bytesPerSecond);
+
+    /// Block until size bytes may be sent
+    void acquire(size_t size);
+
+private:
+    double rate;
+    double available;  // Tokens, negative while in debt
+    std::chrono::steady_clock::time_point last;
+    std::mutex mutex;
+};
+
+struct UploadOptions {
+    size_t partSize = 64ULL << 20;  // Bytes per part, every part but the last
+    size_t concurrency = 4;         // Parts in flight at once
+    double bandwidth = 0;           // Bytes per second over all parts, 0 = unlimited
+
+    /// From storage.upload, converting MB to bytes
+    static UploadOptions fromConfig(const UploadConfig& config);
+};
+
+/// Uploads a stream as one object in parts, with up to
+/// options.concurrency parts in flight while the caller keeps writing.
+/// write() only blocks when that many parts are already pending, so the
+/// upload overlaps the dump and compression producing the stream and at
+/// most concurrency + 1 parts are buffered. finish() sends the last part
+/// and completes the upload; on any failure the upload is aborted and
+/// StorageError is thrown. Destroying an unfinished uploader aborts it too.
+class MultipartUploader : public OutputSink {
+public:
+    MultipartUploader(ObjectStore& store, std::string key, UploadOptions options = {});
+    ~MultipartUploader() override;
+
+    MultipartUploader(const MultipartUploader&) = delete;
+    MultipartUploader& operator=(const MultipartUploader&) = delete;
+
+    void write(const char* data, size_t size) override;
+    void finish() override;
+
+    size_t partsUploaded() const { return parts.size(); }
+
+private:
+    void submitPart();
+    void collectOldest();
+    void abort() noexcept;
+
+    ObjectStore& store;
+    std::string key;
+    UploadOptions options;
+    std::string uploadId;
+    TokenBucket bandwidth;
+    std::unique_ptr<ThreadPool> pool;
+    std::string buffer;
+    int nextPart = 1;
+    std::deque<std::future<UploadedPart>> pending;
+    std::vector<UploadedPart> parts;
+    bool done = false;
+};
+
+/// Upload a local file to key through a MultipartUploader
+void uploadFile(ObjectStore& store, const std::string& path, const std::string& key,
+                const UploadOptions& options = {});
+
+/// Key a compression dictionary is kept under off-site:
+/// dictionaries/<id>.dict, as in the local metadata
+std::string dictionaryKey(const std::string& id);
+
+/// Upload a dictionary backups were primed with, unless the store already
+/// has it, so the off-site copies decode without the local metadata
+void uploadDictionary(ObjectStore& store, const std::string& id, const std::string& dictionary,
+                      const UploadOptions& options = {});
+
+} // namespace dbbackup
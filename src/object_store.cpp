@@ -0,0 +1,158 @@
+#include "object_store.hpp"
+#include "checksum.hpp"
+#include "file_utils.hpp"
+#include "error/ErrorUtils.hpp"
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+using namespace dbbackup::error;
+
+namespace dbbackup {
+
+namespace {
+    constexpr const char* UPLOADS_DIRECTORY = ".uploads";
+
+    std::string newUploadId() {
+        static std::atomic<uint64_t> counter{0};
+        uint64_t now = static_cast<uint64_t>(
+            std::chrono::steady_clock::now().time_since_epoch().count());
+        return checksum::toHex(now ^ (static_cast<uint64_t>(::getpid()) << 32)) + "-" +
+               std::to_string(counter++);
+    }
+
+    // Keys are relative paths; anything that could escape the root is refused
+    void checkKey(const std::string& key) {
+        fs::path path(key);
+        bool valid = !key.empty() && path.is_relative() && *path.begin() != UPLOADS_DIRECTORY;
+        for (const auto& part : path) {
+            valid = valid && part != "..";
+        }
+        DB_CHECK(valid, StorageError, "Invalid object key: " + key);
+    }
+
+    void writeFile(const std::string& path, const char* data, size_t size) {
+        FileSink out(path);
+        if (!out) {
+            DB_THROW(StorageError, "Failed to create file: " + path);
+        }
+        out.write(data, size);
+        out.finish();
+    }
+}
+
+FilesystemObjectStore::FilesystemObjectStore(std::string root) : root(std::move(root)) {
+    fs::create_directories(fs::path(this->root) / UPLOADS_DIRECTORY);
+}
+
+std::string FilesystemObjectStore::objectPath(const std::string& key) const {
+    checkKey(key);
+    return (fs::path(root) / key).string();
+}
+
+std::string FilesystemObjectStore::uploadDirectory(const std::string& uploadId) const {
+    return (fs::path(root) / UPLOADS_DIRECTORY / uploadId).string();
+}
+
+std::string FilesystemObjectStore::createMultipartUpload(const std::string& key) {
+    checkKey(key);
+    std::string uploadId = newUploadId();
+    fs::create_directories(uploadDirectory(uploadId));
+    return uploadId;
+}
+
+UploadedPart FilesystemObjectStore::uploadPart(const std::string& key, const std::string& uploadId,
+                                               int partNumber, const char* data, size_t size) {
+    checkKey(key);
+    std::string directory = uploadDirectory(uploadId);
+    DB_CHECK(fs::is_directory(directory), StorageError, "No such upload: " + uploadId);
+    DB_CHECK(partNumber >= 1, StorageError, "Invalid part number: " + std::to_string(partNumber));
+
+    writeFile((fs::path(directory) / std::to_string(partNumber)).string(), data, size);
+    return UploadedPart{partNumber, checksum::toHex(checksum::xxh64(data, size))};
+}
+
+void FilesystemObjectStore::completeMultipartUpload(const std::string& key, const std::string& uploadId,
+                                                    const std::vector<UploadedPart>& parts) {
+    std::string path = objectPath(key);
+    std::string directory = uploadDirectory(uploadId);
+    DB_CHECK(fs::is_directory(directory), StorageError, "No such upload: " + uploadId);
+
+    fs::create_directories(fs::path(path).parent_path());
+    std::string tmp = path + ".tmp" + std::to_string(::getpid());
+    try {
+        FileIOOptions io;
+        io.sync = true;
+        FileSink out(tmp, io);
+        if (!out) {
+            DB_THROW(StorageError, "Failed to create file: " + tmp);
+        }
+        std::vector<char> buffer(FileIOOptions::DEFAULT_BUFFER_SIZE);
+        int previous = 0;
+        for (const auto& part : parts) {
+            DB_CHECK(part.number > previous, StorageError, "Parts out of order in upload " + uploadId);
+            previous = part.number;
+            std::string partPath = (fs::path(directory) / std::to_string(part.number)).string();
+            FileSource in(partPath);
+            if (!in) {
+                DB_THROW(StorageError, "Missing part " + std::to_string(part.number) + " of upload " + uploadId);
+            }
+            checksum::Xxh64 etag;
+            size_t n;
+            while ((n = in.read(buffer.data(), buffer.size())) > 0) {
+                etag.update(buffer.data(), n);
+                out.write(buffer.data(), n);
+            }
+            DB_CHECK(checksum::toHex(etag.digest()) == part.etag, StorageError,
+                     "ETag mismatch for part " + std::to_string(part.number) + " of upload " + uploadId);
+        }
+        out.finish();
+        commitFile(tmp, path);
+    } catch (...) {
+        std::error_code ignored;
+        fs::remove(tmp, ignored);
+        throw;
+    }
+    fs::remove_all(directory);
+}
+
+void FilesystemObjectStore::abortMultipartUpload(const std::string&, const std::string& uploadId) noexcept {
+    std::error_code ignored;
+    fs::remove_all(uploadDirectory(uploadId), ignored);
+}
+
+void FilesystemObjectStore::getObject(const std::string& key, OutputSink& sink) {
+    std::string path = objectPath(key);
+    FileSource in(path);
+    if (!in) {
+        DB_THROW(StorageError, "No such object: " + key);
+    }
+    copyStream(in, sink);
+    sink.finish();
+}
+
+bool FilesystemObjectStore::exists(const std::string& key) {
+    return fs::is_regular_file(objectPath(key));
+}
+
+bool FilesystemObjectStore::remove(const std::string& key) {
+    return fs::remove(objectPath(key));
+}
+
+std::unique_ptr<ObjectStore> createObjectStore(const StorageConfig& config) {
+    // "local" keeps backups on local storage only
+    if (config.cloudProvider.empty() || config.cloudProvider == "local") {
+        return nullptr;
+    }
+    if (config.cloudProvider == "filesystem") {
+        DB_CHECK(!config.cloudPath.empty(), ConfigurationError,
+                 "storage.cloudPath is required for cloud provider " + config.cloudProvider);
+        return std::make_unique<FilesystemObjectStore>(config.cloudPath);
+    }
+    DB_THROW(ConfigurationError, "Unsupported cloud provider: " + config.cloudProvider +
+             " (this build uploads to \"filesystem\" targets only)");
+}
+
+} // namespace dbbackup
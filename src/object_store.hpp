@@ -0,0 +1,79 @@
+#pragma once
+
+#include "config.hpp"
+#include "stream.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dbbackup {
+
+/// A part of a multipart upload as reported back by the store
+struct UploadedPart {
+    int number = 0;    // 1-based, as in S3
+    std::string etag;  // Store-assigned tag, passed back when completing
+};
+
+/// Remote object storage with the S3 multipart upload model: parts of one
+/// object are uploaded independently and in any order, then stitched
+/// together by completeMultipartUpload. Implementations must allow
+/// concurrent uploadPart calls and throw StorageError on failure.
+class ObjectStore {
+public:
+    virtual ~ObjectStore() = default;
+
+    /// Start an upload of key, returns its upload id
+    virtual std::string createMultipartUpload(const std::string& key) = 0;
+
+    virtual UploadedPart uploadPart(const std::string& key, const std::string& uploadId,
+                                    int partNumber, const char* data, size_t size) = 0;
+
+    /// Publish the object from parts, which are given in part number order
+    virtual void completeMultipartUpload(const std::string& key, const std::string& uploadId,
+                                         const std::vector<UploadedPart>& parts) = 0;
+
+    /// Discard an upload and its parts. Must not throw.
+    virtual void abortMultipartUpload(const std::string& key, const std::string& uploadId) noexcept = 0;
+
+    /// Write an object to sink and finish it. Throws StorageError if missing.
+    virtual void getObject(const std::string& key, OutputSink& sink) = 0;
+
+    virtual bool exists(const std::string& key) = 0;
+
+    /// Delete an object. Returns false if it did not exist.
+    virtual bool remove(const std::string& key) = 0;
+};
+
+/// S3 stand-in keeping objects as files under root, with in-progress
+/// uploads under root/.uploads/<upload id>/. Completing an upload joins the
+/// parts into a temporary file, syncs it and renames it into place, so
+/// readers never see a partial object, even after a crash. Used with
+/// cloudProvider "filesystem" (e.g. an NFS mount for off-site copies) and
+/// in tests.
+class FilesystemObjectStore : public ObjectStore {
+public:
+    explicit FilesystemObjectStore(std::string root);
+
+    std::string createMultipartUpload(const std::string& key) override;
+    UploadedPart uploadPart(const std::string& key, const std::string& uploadId,
+                            int partNumber, const char* data, size_t size) override;
+    void completeMultipartUpload(const std::string& key, const std::string& uploadId,
+                                 const std::vector<UploadedPart>& parts) override;
+    void abortMultipartUpload(const std::string& key, const std::string& uploadId) noexcept override;
+    void getObject(const std::string& key, OutputSink& sink) override;
+    bool exists(const std::string& key) override;
+    bool remove(const std::string& key) override;
+
+private:
+    std::string objectPath(const std::string& key) const;
+    std::string uploadDirectory(const std::string& uploadId) const;
+
+    std::string root;
+};
+
+/// Object store for storage.cloudProvider with objects under
+/// storage.cloudPath, null if there is none or it is "local". Throws
+/// ConfigurationError for providers this build cannot reach.
+std::unique_ptr<ObjectStore> createObjectStore(const StorageConfig& config);
+
+} // namespace dbbackup
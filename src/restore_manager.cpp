@@ -1,8 +1,12 @@
 #include "restore_manager.hpp"
 #include "compression.hpp"
+#include "codec_registry.hpp"
+#include "chunk_store.hpp"
 #include "logging.hpp"
 #include "notifications.hpp"
+#include "storage.hpp"
 
+#include <filesystem>
 #include <iostream>
 
 using namespace dbbackup;
@@ -18,18 +22,36 @@ bool RestoreManager::restore(const std::string& backupFilePath, bool selectiveRe
     auto logger = getLogger();
     logger->info("Starting restore from file: {}", backupFilePath);
 
-    // Potentially check if it's compressed
-    // For simplicity, assume anything ending in .gz is compressed
+    // Detect compression from backup metadata or the file contents
     std::string actualBackupPath = backupFilePath;
-    bool isCompressed = false;
-    if(backupFilePath.size() > 3 && backupFilePath.substr(backupFilePath.size()-3) == ".gz") {
-        isCompressed = true;
+    std::shared_ptr<const Codec> codec;
+    if(ChunkStore::isManifest(backupFilePath)) {
+        // Deduplicated backup: reassemble the dump from the chunk store
+        std::string reassembledFilePath = std::filesystem::path(backupFilePath).replace_extension().string();
+        ChunkStore chunks(std::filesystem::path(backupFilePath).parent_path().string());
+        if(!chunks.restoreFile(backupFilePath, reassembledFilePath, m_config.backup.compression)) {
+            logger->error("Failed to reassemble deduplicated backup.");
+            sendNotificationIfNeeded(m_config.logging, "Restore failed: missing or damaged chunks.");
+            return false;
+        }
+        actualBackupPath = reassembledFilePath;
+    } else if(std::filesystem::exists(backupFilePath)) {
+        codec = CodecRegistry::getInstance().detectFile(
+            backupFilePath, recordedCompression(m_config.storage, backupFilePath));
     }
 
     // Decompress if needed
-    if(isCompressed) {
-        std::string decompressedFilePath = backupFilePath.substr(0, backupFilePath.size()-3);
-        if(!dbbackup::decompressFile(backupFilePath, decompressedFilePath)) {
+    if(codec) {
+        std::string decompressedFilePath = stripCompressionExtension(backupFilePath, *codec);
+        bool decompressed = false;
+        try {
+            Compressor decompressor(codec, m_config.backup.compression);
+            decompressor.setDictionary(recordedDictionary(m_config.storage, backupFilePath));
+            decompressed = decompressor.decompressFile(backupFilePath, decompressedFilePath);
+        } catch(const std::exception&) {
+            decompressed = false;
+        }
+        if(!decompressed) {
             logger->error("Failed to decompress backup file.");
             sendNotificationIfNeeded(m_config.logging, "Restore failed: decompression error.");
             return false;
@@ -0,0 +1,96 @@
+#include "retention.hpp"
+#include <algorithm>
+#include <ctime>
+#include <iomanip>
+#include <set>
+#include <sstream>
+
+namespace dbbackup {
+
+namespace {
+    bool parseTimestamp(const std::string& timestamp, std::tm& parsed) {
+        parsed = std::tm();
+        std::istringstream in(timestamp);
+        in >> std::get_time(&parsed, "%Y%m%d_%H%M%S");
+        if (in.fail()) {
+            return false;
+        }
+        parsed.tm_isdst = -1;
+        // Normalizes the fields and fills in tm_wday and tm_yday for %G%V
+        return std::mktime(&parsed) != -1;
+    }
+
+    std::string format(const std::tm& time, const char* pattern) {
+        char buffer[32];
+        return std::string(buffer, std::strftime(buffer, sizeof(buffer), pattern, &time));
+    }
+
+    // Keeps the newest backup in each of the first limit periods seen
+    class PeriodRule {
+    public:
+        PeriodRule(int limit, const char* pattern) : limit(limit), pattern(pattern) {}
+
+        /// Call newest first; true if this backup is the one kept for its period
+        bool keeps(const std::tm& time) {
+            if (limit <= 0) {
+                return false;
+            }
+            std::string period = format(time, pattern);
+            if (seen.count(period) || seen.size() >= static_cast<size_t>(limit)) {
+                return false;
+            }
+            seen.insert(period);
+            return true;
+        }
+
+    private:
+        int limit;
+        const char* pattern;
+        std::set<std::string> seen;
+    };
+}
+
+RetentionPlan planRetention(const std::vector<BackupMetadata>& backups,
+                            const RetentionConfig& policy,
+                            std::chrono::system_clock::time_point now) {
+    std::vector<BackupMetadata> newestFirst = backups;
+    std::sort(newestFirst.begin(), newestFirst.end(),
+        [](const BackupMetadata& a, const BackupMetadata& b) {
+            return a.timestamp > b.timestamp;
+        });
+
+    std::time_t cutoff = std::chrono::system_clock::to_time_t(now - std::chrono::hours(24) * policy.days);
+    PeriodRule daily(policy.keepDaily, "%Y%m%d");
+    PeriodRule weekly(policy.keepWeekly, "%G%V");
+    PeriodRule monthly(policy.keepMonthly, "%Y%m");
+
+    RetentionPlan plan;
+    for (size_t i = 0; i < newestFirst.size(); i++) {
+        const BackupMetadata& backup = newestFirst[i];
+        std::tm time;
+        if (!parseTimestamp(backup.timestamp, time)) {
+            plan.keep.push_back(backup);
+            continue;
+        }
+
+        // Every rule sees every backup, so each tracks its own periods
+        bool protectedByGfs = daily.keeps(time);
+        protectedByGfs = weekly.keeps(time) || protectedByGfs;
+        protectedByGfs = monthly.keeps(time) || protectedByGfs;
+        if (i == 0) {
+            plan.keep.push_back(backup);
+            continue;
+        }
+
+        bool tooMany = policy.maxBackups > 0 && i >= static_cast<size_t>(policy.maxBackups);
+        bool tooOld = policy.days > 0 && std::mktime(&time) < cutoff;
+        if ((tooMany || tooOld) && !protectedByGfs) {
+            plan.prune.push_back(backup);
+        } else {
+            plan.keep.push_back(backup);
+        }
+    }
+    return plan;
+}
+
+} // namespace dbbackup
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "catalog.hpp"
+#include "config.hpp"
+#include <chrono>
+#include <vector>
+
+namespace dbbackup {
+
+/// Outcome of evaluating a retention policy over the catalog
+struct RetentionPlan {
+    std::vector<BackupMetadata> keep;   // Newest first
+    std::vector<BackupMetadata> prune;  // Newest first
+};
+
+/// Decides which backups a policy keeps, in one pass over them. A backup is
+/// pruned if it is older than policy.days or beyond the newest
+/// policy.maxBackups, unless a GFS rule keeps it: the newest backup of each
+/// of the last keepDaily days, keepWeekly ISO weeks and keepMonthly months
+/// is always kept. The newest backup is never pruned, nor is one whose
+/// timestamp cannot be parsed. Timestamps are local time, YYYYMMDD_HHMMSS.
+RetentionPlan planRetention(const std::vector<BackupMetadata>& backups,
+                            const RetentionConfig& policy,
+                            std::chrono::system_clock::time_point now = std::chrono::system_clock::now());
+
+} // namespace dbbackup
@@ -1,6 +1,8 @@
 #include "scheduling.hpp"
 #include "backup_manager.hpp"
 #include "logging.hpp"
+#include "notifications.hpp"
+#include "scrubber.hpp"
 #include <chrono>
 #include <thread>
 #include <ctime>
@@ -22,6 +24,15 @@ Scheduler::~Scheduler() {
 void Scheduler::start() {
     if (!m_running) {
         m_running = true;
+        if (m_config.storage.scrub.enabled) {
+            const dbbackup::LoggingConfig& logging = m_config.logging;
+            m_scrubber = std::make_unique<Scrubber>(m_config.storage,
+                ScrubOptions::fromConfig(m_config.storage.scrub),
+                [logging](const BackupMetadata& backup) {
+                    sendNotificationIfNeeded(logging, "Scrub found backup " + backup.filename + " damaged");
+                });
+            m_scrubber->start();
+        }
         m_thread = std::thread(&Scheduler::runScheduler, this);
     }
 }
@@ -32,6 +43,7 @@ void Scheduler::stop() {
         if (m_thread.joinable()) {
             m_thread.join();
         }
+        m_scrubber.reset();
     }
 }
 
@@ -79,10 +91,32 @@ void Scheduler::runScheduler() {
                     // Only run if we haven't already done a backup in this hour
                     time_t hourStart = now - (tm->tm_min * 60 + tm->tm_sec);
                     if (lastBackupTime < hourStart) {
-                        logger->info("Starting scheduled backup");
+                        dbbackup::SizeEstimate expected = backupManager.estimateBackup();
+                        if (expected.seconds > 0) {
+                            logger->info("Starting scheduled backup, expected to take {:.0f}s (at most {:.0f}s)",
+                                         expected.seconds, expected.secondsUpperBound);
+                        } else {
+                            logger->info("Starting scheduled backup");
+                        }
                         
-                        // Perform a full backup by default
-                        if (backupManager.backup("full")) {
+                        // Perform a full backup by default, with the scrub
+                        // held off the disks until it is done
+                        if (m_scrubber) {
+                            m_scrubber->pause();
+                        }
+                        bool succeeded = false;
+                        try {
+                            succeeded = backupManager.backup("full");
+                        } catch (...) {
+                            if (m_scrubber) {
+                                m_scrubber->resume();
+                            }
+                            throw;
+                        }
+                        if (m_scrubber) {
+                            m_scrubber->resume();
+                        }
+                        if (succeeded) {
                             logger->info("Scheduled backup completed successfully");
                             lastBackupTime = now;
                         } else {
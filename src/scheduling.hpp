@@ -2,10 +2,17 @@
 
 #include "config.hpp"
 #include <atomic>
+#include <memory>
 #include <thread>
 
+namespace dbbackup {
+class Scrubber;
+}
+
 /// A simple internal scheduler example. 
 /// In production, you'd likely use Cron, Task Scheduler, etc.
+/// With storage.scrub enabled it also runs a Scrubber, paused while a
+/// scheduled backup runs.
 class Scheduler {
 public:
     Scheduler(const dbbackup::Config& cfg);
@@ -19,5 +26,6 @@ private:
 
     dbbackup::Config m_config;
     std::atomic_bool m_running;
+    std::unique_ptr<dbbackup::Scrubber> m_scrubber;
     std::thread m_thread;
 };
@@ -0,0 +1,316 @@
+#include "scrubber.hpp"
+#include "checksum.hpp"
+#include "chunk_store.hpp"
+#include "codec_registry.hpp"
+#include "compression.hpp"
+#include "logging.hpp"
+#include "stream.hpp"
+#include "error/ErrorUtils.hpp"
+#include <algorithm>
+#include <ctime>
+#include <filesystem>
+#include <iomanip>
+#include <optional>
+#include <sstream>
+
+using namespace dbbackup::error;
+
+namespace dbbackup {
+
+namespace {
+    std::string formatTimestamp(std::chrono::system_clock::time_point time) {
+        std::time_t t = std::chrono::system_clock::to_time_t(time);
+        std::stringstream ss;
+        ss << std::put_time(std::localtime(&t), "%Y%m%d_%H%M%S");
+        return ss.str();
+    }
+
+    // CPU time of the calling thread, user and system
+    double threadCpuSeconds() {
+        struct timespec now;
+        if (::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) {
+            return 0;
+        }
+        return static_cast<double>(now.tv_sec) + static_cast<double>(now.tv_nsec) / 1e9;
+    }
+
+    // Unwinds a restore stop() interrupted
+    struct Interrupted {};
+
+    // Hands each write to a function
+    class FunctionSink : public OutputSink {
+    public:
+        explicit FunctionSink(std::function<void(const char*, size_t)> function)
+            : function(std::move(function)) {}
+
+        void write(const char* data, size_t size) override {
+            function(data, size);
+        }
+
+        void finish() override {}
+
+    private:
+        std::function<void(const char*, size_t)> function;
+    };
+}
+
+ScrubOptions ScrubOptions::fromConfig(const ScrubConfig& config) {
+    ScrubOptions options;
+    options.interval = std::chrono::hours(24 * std::max(config.intervalDays, 1));
+    options.bandwidth = std::max(config.bandwidthLimitMBps, 0.0) * 1024 * 1024;
+    options.cpuShare = std::clamp(config.cpuPercent, 1, 100) / 100.0;
+    options.decompress = config.decompress;
+    return options;
+}
+
+Scrubber::Scrubber(const StorageConfig& config, ScrubOptions options, DamageHandler onDamaged)
+    : storage(createStorageBackend(config))
+    , localPath(config.localPath)
+    , chunks(config.localPath)
+    , options(options)
+    , onDamaged(std::move(onDamaged))
+    , bandwidth(options.bandwidth) {
+    DB_CHECK(options.chunkSize > 0, ValidationError, "Scrub chunk size must be positive");
+    this->options.cpuShare = std::clamp(options.cpuShare, 0.01, 1.0);
+}
+
+Scrubber::~Scrubber() {
+    stop();
+}
+
+std::vector<BackupMetadata> Scrubber::due() const {
+    std::string cutoff = formatTimestamp(std::chrono::system_clock::now() - options.interval);
+    std::vector<BackupMetadata> result;
+    for (const auto& backup : storage->list()) {
+        if (backup.verifiedAt.empty() || backup.verifiedAt < cutoff) {
+            result.push_back(backup);
+        }
+    }
+    // Never verified first, in age order, then the longest unverified;
+    // timestamps order as strings
+    std::stable_sort(result.begin(), result.end(), [](const BackupMetadata& a, const BackupMetadata& b) {
+        if (a.verifiedAt != b.verifiedAt) {
+            return a.verifiedAt < b.verifiedAt;
+        }
+        return a.timestamp < b.timestamp;
+    });
+    return result;
+}
+
+bool Scrubber::scrub(const BackupMetadata& backup) {
+    auto logger = getLogger();
+    std::string problem;
+    try {
+        auto source = storage->open(backup.filename);
+
+        // Checksum with the cheapest hash recorded, decoding alongside
+        std::optional<checksum::Xxh64> fast;
+        CountingSink discard;
+        std::unique_ptr<checksum::DigestSink> digest;
+        if (!backup.fastChecksum.empty()) {
+            fast.emplace();
+        } else {
+            digest = std::make_unique<checksum::DigestSink>(discard);
+        }
+        std::unique_ptr<Compressor> compressor;
+        CountingSink decoded;
+        std::unique_ptr<OutputSink> decoder;
+        if (options.decompress && !backup.compression.empty() && !ChunkStore::isManifest(backup.filename)) {
+            auto codec = CodecRegistry::getInstance().findByName(backup.compression);
+            if (!codec) {
+                DB_THROW(StorageError, "Unknown codec " + backup.compression);
+            }
+            // One thread, so the CPU budget sees all the decoding
+            CompressionConfig single;
+            single.threads = 1;
+            single.decodeThreads = 1;
+            compressor = std::make_unique<Compressor>(codec, single);
+            if (!backup.dictionary.empty()) {
+                compressor->setDictionary(
+                    std::make_shared<const std::string>(storage->loadDictionary(backup.dictionary)));
+            }
+            decoder = compressor->createDecoder(decoded);
+        }
+
+        std::vector<char> buffer(options.chunkSize);
+        uint64_t size = 0;
+        if (!waitWhilePaused()) {
+            return false;
+        }
+        cpuMark = threadCpuSeconds();
+        while (true) {
+            size_t n = source->read(buffer.data(), buffer.size());
+            if (n == 0) {
+                break;
+            }
+            size += n;
+            if (fast) {
+                fast->update(buffer.data(), n);
+            } else {
+                digest->write(buffer.data(), n);
+            }
+            if (decoder) {
+                decoder->write(buffer.data(), n);
+            }
+            if (!pace(n)) {
+                return false;
+            }
+        }
+        bytesRead += size;
+
+        if (size != backup.size) {
+            problem = "size " + std::to_string(size) + " does not match the recorded " + std::to_string(backup.size);
+        } else if (fast && checksum::toHex(fast->digest()) != backup.fastChecksum) {
+            problem = "XXH64 does not match";
+        } else if (digest) {
+            digest->finish();
+            if (digest->digest().sha256 != backup.checksum) {
+                problem = "SHA-256 does not match";
+            }
+        }
+        if (problem.empty() && decoder) {
+            decoder->finish();
+            if (backup.originalSize > 0 && decoded.bytesWritten() != backup.originalSize) {
+                problem = "decodes to " + std::to_string(decoded.bytesWritten()) +
+                          " bytes, not the " + std::to_string(backup.originalSize) + " dumped";
+            }
+        }
+
+        // The data of a deduplicated backup is in its chunks, shared with
+        // other backups: restore it, which checks each one's SHA-256
+        if (problem.empty() && ChunkStore::isManifest(backup.filename)) {
+            CompressionConfig single;
+            single.threads = 1;
+            single.decodeThreads = 1;
+            FunctionSink restored([this](const char*, size_t n) {
+                bytesRead += n;
+                if (!pace(n)) {
+                    throw Interrupted();
+                }
+            });
+            chunks.restore((std::filesystem::path(localPath) / backup.filename).string(), restored, single);
+        }
+    } catch (const Interrupted&) {
+        return false;
+    } catch (const std::exception& e) {
+        problem = e.what();
+    }
+
+    bool intact = problem.empty();
+    if (!storage->markVerified(backup.filename, intact)) {
+        // Pruned while it was being read
+        return intact;
+    }
+    if (intact) {
+        logger->debug("Scrubbed {}: intact", backup.filename);
+    } else {
+        logger->error("Scrubbed {}: damaged, {}", backup.filename, problem);
+        if (onDamaged) {
+            onDamaged(backup);
+        }
+    }
+    return intact;
+}
+
+ScrubResult Scrubber::scrubDue() {
+    ScrubResult result;
+    uint64_t start = bytesRead;
+    for (const auto& backup : due()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) {
+                break;
+            }
+        }
+        if (scrub(backup)) {
+            result.verified++;
+        } else {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) {
+                break;
+            }
+            result.damaged++;
+        }
+    }
+    result.bytes = bytesRead - start;
+    return result;
+}
+
+void Scrubber::start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (thread.joinable()) {
+        return;
+    }
+    stopping = false;
+    thread = std::thread(&Scrubber::run, this);
+}
+
+void Scrubber::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void Scrubber::pause() {
+    std::lock_guard<std::mutex> lock(mutex);
+    paused = true;
+}
+
+void Scrubber::resume() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        paused = false;
+    }
+    changed.notify_all();
+}
+
+void Scrubber::run() {
+    auto logger = getLogger();
+    logger->info("Scrubber started");
+    do {
+        try {
+            ScrubResult result = scrubDue();
+            if (result.verified + result.damaged > 0) {
+                logger->info("Scrubbed {} backups ({} bytes), {} damaged",
+                             result.verified + result.damaged, result.bytes, result.damaged);
+            }
+        } catch (const std::exception& e) {
+            logger->error("Error in scrubber: {}", e.what());
+        }
+    } while (idle(IDLE_INTERVAL));
+    logger->info("Scrubber stopped");
+}
+
+bool Scrubber::waitWhilePaused() {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this]() { return !paused || stopping; });
+    return !stopping;
+}
+
+bool Scrubber::pace(size_t bytes) {
+    bandwidth.acquire(bytes);
+
+    // Sleep off the CPU used since the last settlement beyond the budget
+    double used = threadCpuSeconds() - cpuMark;
+    if (options.cpuShare < 1 && !idle(std::chrono::duration<double>(used / options.cpuShare - used))) {
+        return false;
+    }
+    bool running = waitWhilePaused();
+    cpuMark = threadCpuSeconds();
+    return running;
+}
+
+bool Scrubber::idle(std::chrono::duration<double> duration) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (duration.count() > 0) {
+        changed.wait_for(lock, duration, [this]() { return stopping; });
+    }
+    return !stopping;
+}
+
+} // namespace dbbackup
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "config.hpp"
+#include "storage.hpp"
+#include "chunk_store.hpp"
+#include "multipart_upload.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dbbackup {
+
+struct ScrubOptions {
+    std::chrono::seconds interval{std::chrono::hours(24 * 30)};  // Verify each backup again after this long
+    double bandwidth = 0;     // Bytes read per second, 0 = unlimited
+    double cpuShare = 1;      // Fraction of one core used while verifying
+    bool decompress = false;  // Also decode archives
+    size_t chunkSize = 1 << 20;  // Bytes read between checks for pause, stop and budget
+
+    /// From storage.scrub, converting MB to bytes and percent to a fraction
+    static ScrubOptions fromConfig(const ScrubConfig& config);
+};
+
+struct ScrubResult {
+    size_t verified = 0;  // Intact backups
+    size_t damaged = 0;
+    uint64_t bytes = 0;   // Read from storage
+};
+
+/// Re-verifies stored backups in the background, so bit rot is found by a
+/// scrub rather than by a failed restore. Each backup's file is read back
+/// and compared with its recorded size and checksum (XXH64 where recorded,
+/// SHA-256 otherwise) and, with decompress, decoded in full and its length
+/// compared with the dump's. A deduplicated backup (chunk manifest) is
+/// always restored in full through ChunkStore::restore as well, so every
+/// chunk it shares with other backups is checked against its SHA-256. The
+/// outcome and time are recorded in the catalog (see
+/// BackupMetadata::verifiedAt).
+///
+/// Backups never verified come first, oldest first, then those verified
+/// longest ago; a backup is due again after options.interval. Reading is
+/// held to options.bandwidth and the hashing and decoding on this thread
+/// to options.cpuShare of a core by sleeping between chunks. pause()
+/// takes effect within a chunk, so a backup starting does not compete
+/// with a scrub.
+class Scrubber {
+public:
+    /// Called with each backup found damaged
+    using DamageHandler = std::function<void(const BackupMetadata&)>;
+
+    Scrubber(const StorageConfig& config, ScrubOptions options, DamageHandler onDamaged = nullptr);
+
+    /// Stops the background thread
+    ~Scrubber();
+
+    Scrubber(const Scrubber&) = delete;
+    Scrubber& operator=(const Scrubber&) = delete;
+
+    /// Backups due for verification, in the order they are scrubbed
+    std::vector<BackupMetadata> due() const;
+
+    /// Verify one backup and record the outcome. Returns true if it is
+    /// intact; false if it is damaged, or stop() interrupted the check, in
+    /// which case nothing is recorded.
+    bool scrub(const BackupMetadata& backup);
+
+    /// Scrub every due backup, returning early on stop()
+    ScrubResult scrubDue();
+
+    /// Scrub due backups on a background thread, checking for newly due
+    /// ones every IDLE_INTERVAL
+    void start();
+    void stop();
+
+    /// Hold the scrub between chunks until resume()
+    void pause();
+    void resume();
+
+    static constexpr std::chrono::minutes IDLE_INTERVAL{60};
+
+private:
+    void run();
+    /// Blocks while paused. Returns false once stopping.
+    bool waitWhilePaused();
+    /// Sleeps unless stopping. Returns false once stopping.
+    bool idle(std::chrono::duration<double> duration);
+    /// Holds the scrub to its budgets after bytes more were processed,
+    /// and while paused. Returns false once stopping.
+    bool pace(size_t bytes);
+
+    std::unique_ptr<StorageBackend> storage;
+    std::string localPath;  // Where manifests and their chunks stay
+    ChunkStore chunks;
+    ScrubOptions options;
+    DamageHandler onDamaged;
+    TokenBucket bandwidth;
+    uint64_t bytesRead = 0;
+    double cpuMark = 0;  // Thread CPU seconds when the budget was last settled
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool paused = false;
+    bool stopping = false;
+    std::thread thread;
+};
+
+} // namespace dbbackup
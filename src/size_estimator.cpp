@@ -0,0 +1,133 @@
+#include "size_estimator.hpp"
+#include "chunk_store.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace dbbackup {
+
+namespace {
+    struct Spread {
+        double mean = 0;
+        double margin = 0;  // Added to the mean for the upper bound
+    };
+
+    // Two standard deviations, plus a prior that dominates with few
+    // samples: one backup says little about the next
+    Spread spread(const std::vector<double>& values) {
+        Spread result;
+        if (values.empty()) {
+            return result;
+        }
+        double n = static_cast<double>(values.size());
+        for (double value : values) {
+            result.mean += value;
+        }
+        result.mean /= n;
+        double variance = 0;
+        for (double value : values) {
+            variance += (value - result.mean) * (value - result.mean);
+        }
+        double deviation = values.size() > 1 ? std::sqrt(variance / (n - 1)) : 0;
+        result.margin = 2 * deviation + result.mean * 0.1 / n;
+        return result;
+    }
+}
+
+SizeEstimator::SizeEstimator(const std::vector<BackupMetadata>& history,
+                             std::string database, std::string codec, std::string level)
+    : database(std::move(database)), codec(std::move(codec)), level(std::move(level)) {
+    std::vector<const BackupMetadata*> newestFirst;
+    for (const auto& backup : history) {
+        newestFirst.push_back(&backup);
+    }
+    std::stable_sort(newestFirst.begin(), newestFirst.end(),
+        [](const BackupMetadata* a, const BackupMetadata* b) {
+            return a->timestamp > b->timestamp;
+        });
+
+    std::vector<double> dumpSizes;  // Newest first, any codec
+    for (const BackupMetadata* backup : newestFirst) {
+        if (backup->database != this->database || backup->originalSize == 0) {
+            continue;
+        }
+        if (dumpSizes.size() < WINDOW) {
+            dumpSizes.push_back(static_cast<double>(backup->originalSize));
+        }
+        if (samples.size() < WINDOW && matches(*backup)) {
+            double ratio = static_cast<double>(backup->size) / static_cast<double>(backup->originalSize);
+            double throughput = backup->durationSeconds > 0
+                ? static_cast<double>(backup->originalSize) / backup->durationSeconds : 0;
+            samples.push_back(Sample{ratio, throughput});
+        }
+    }
+
+    // Dumps grow with the database: carry the recent average growth per
+    // backup forward, but never predict shrinkage
+    if (!dumpSizes.empty()) {
+        double growth = 1.0;
+        if (dumpSizes.size() > 1) {
+            double sum = 0;
+            for (size_t i = 0; i + 1 < dumpSizes.size(); i++) {
+                sum += dumpSizes[i] / dumpSizes[i + 1];
+            }
+            growth = std::clamp(sum / static_cast<double>(dumpSizes.size() - 1), 1.0, 1.5);
+        }
+        predictedInput = static_cast<uint64_t>(std::ceil(dumpSizes.front() * growth));
+    }
+}
+
+bool SizeEstimator::matches(const BackupMetadata& backup) const {
+    if (backup.size == 0 || ChunkStore::isManifest(backup.filename)) {
+        return false;
+    }
+    if (codec == "auto") {
+        return !backup.compression.empty();
+    }
+    return backup.compression == codec && (codec.empty() || backup.compressionLevel == level);
+}
+
+SizeEstimate SizeEstimator::estimate(uint64_t inputBytes,
+                                     const std::function<uint64_t(uint64_t)>& fallback) const {
+    SizeEstimate result;
+    result.inputBytes = inputBytes > 0 ? inputBytes : predictedInput;
+    result.samples = samples.size();
+    if (result.inputBytes == 0) {
+        return result;
+    }
+    double input = static_cast<double>(result.inputBytes);
+
+    std::vector<double> ratios;
+    std::vector<double> throughputs;
+    for (const auto& sample : samples) {
+        ratios.push_back(sample.ratio);
+        if (sample.throughput > 0) {
+            throughputs.push_back(sample.throughput);
+        }
+    }
+
+    if (codec.empty()) {
+        result.outputBytes = result.outputUpperBound = result.inputBytes;
+    } else if (ratios.empty()) {
+        result.outputBytes = result.outputUpperBound = fallback ? fallback(result.inputBytes) : result.inputBytes;
+    } else {
+        Spread ratio = spread(ratios);
+        result.outputBytes = static_cast<uint64_t>(std::ceil(input * ratio.mean));
+        result.outputUpperBound = static_cast<uint64_t>(std::ceil(input * (ratio.mean + ratio.margin)));
+    }
+
+    if (!throughputs.empty()) {
+        Spread throughput = spread(throughputs);
+        // The slow bound: throughput that far below the mean, but not
+        // below a tenth of it
+        double slow = std::max(throughput.mean - throughput.margin, throughput.mean * 0.1);
+        result.seconds = input / throughput.mean;
+        result.secondsUpperBound = input / slow;
+    }
+    return result;
+}
+
+std::string SizeEstimator::databaseKey(const std::string& type, const std::string& name) {
+    return type + ":" + name;
+}
+
+} // namespace dbbackup
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "catalog.hpp"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace dbbackup {
+
+/// Predicted size and duration of the next backup. Upper bounds are about
+/// two standard deviations above the expected values.
+struct SizeEstimate {
+    uint64_t inputBytes = 0;        // Dump size, 0 if there is no history
+    uint64_t outputBytes = 0;       // Archive size
+    uint64_t outputUpperBound = 0;
+    double seconds = 0;             // 0 if no duration has been recorded
+    double secondsUpperBound = 0;
+    size_t samples = 0;             // Backups the ratio was learned from, 0 = default ratio
+};
+
+/// Learns compression ratios and throughput from catalogued backups of one
+/// database with one codec and level, using the most recent ones so the
+/// estimate follows the data as it changes. The dump size comes from that
+/// database's latest backup with any codec, grown at the average rate
+/// between its recent backups. Without ratio history the fallback (e.g.
+/// Compressor::estimateCompressedSize) is used, with no margin above it.
+class SizeEstimator {
+public:
+    /// Backups the estimate is learned from, newest first
+    static constexpr size_t WINDOW = 20;
+
+    /// codec "" means uncompressed (ratio 1); "auto" matches any codec and
+    /// level, for backups whose codec is chosen per dump
+    SizeEstimator(const std::vector<BackupMetadata>& history,
+                  std::string database, std::string codec, std::string level);
+
+    /// Estimate for a dump of inputBytes, or of the size predicted from
+    /// history if 0. fallback maps a dump size to an archive size when no
+    /// ratio has been learned.
+    SizeEstimate estimate(uint64_t inputBytes = 0,
+                          const std::function<uint64_t(uint64_t)>& fallback = nullptr) const;
+
+    /// Identity recorded with each backup: "<type>:<name>"
+    static std::string databaseKey(const std::string& type, const std::string& name);
+
+private:
+    struct Sample {
+        double ratio;       // Archive bytes per dump byte
+        double throughput;  // Dump bytes per second, 0 if unknown
+    };
+
+    bool matches(const BackupMetadata& backup) const;
+
+    std::string database;
+    std::string codec;
+    std::string level;
+    std::vector<Sample> samples;  // Newest first
+    uint64_t predictedInput = 0;
+};
+
+} // namespace dbbackup
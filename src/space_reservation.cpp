@@ -0,0 +1,145 @@
+#include "space_reservation.hpp"
+#include "error/ErrorUtils.hpp"
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+using namespace dbbackup::error;
+
+namespace dbbackup {
+
+namespace {
+    // Bytes held without preallocation, per device
+    std::mutex ledgerMutex;
+    std::map<uint64_t, uint64_t> ledger;
+
+    uint64_t deviceOf(const std::string& path) {
+        struct stat info;
+        if (::stat(path.c_str(), &info) != 0) {
+            DB_THROW(StorageError, "Failed to stat: " + path + ": " + std::strerror(errno));
+        }
+        return static_cast<uint64_t>(info.st_dev);
+    }
+
+    std::string insufficient(const std::string& path, uint64_t size) {
+        return "Insufficient storage space: " + std::to_string(size) + " bytes needed for " + path;
+    }
+
+    // True if the blocks were allocated, false if the filesystem cannot
+    bool preallocate(int fd, const std::string& path, uint64_t size) {
+#if defined(__linux__)
+        int result;
+        do {
+            result = ::fallocate(fd, 0, 0, static_cast<off_t>(size));
+        } while (result != 0 && errno == EINTR);
+        if (result == 0) {
+            return true;
+        }
+        if (errno == ENOSPC || errno == EDQUOT) {
+            // Give back whatever was allocated before running out
+            int error = errno;
+            (void)::ftruncate(fd, 0);
+            errno = error;
+            DB_THROW(StorageError, insufficient(path, size));
+        }
+        if (errno != EOPNOTSUPP && errno != ENOSYS && errno != EINVAL) {
+            DB_THROW(StorageError, "Failed to preallocate: " + path + ": " + std::strerror(errno));
+        }
+#else
+        (void)fd;
+        (void)path;
+        (void)size;
+#endif
+        return false;
+    }
+}
+
+SpaceReservation::SpaceReservation(const std::string& path, uint64_t size) : bytes(size) {
+    bool created = true;
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0 && errno == EEXIST) {
+        created = false;
+        fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        DB_THROW(StorageError, "Failed to create file: " + path + ": " + std::strerror(errno));
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        int error = errno;
+        ::close(fd);
+        DB_THROW(StorageError, "Failed to stat: " + path + ": " + std::strerror(error));
+    }
+    device = static_cast<uint64_t>(info.st_dev);
+
+    try {
+        allocated = size == 0 || preallocate(fd, path, size);
+    } catch (...) {
+        ::close(fd);
+        if (created) {
+            ::unlink(path.c_str());
+        }
+        throw;
+    }
+    ::close(fd);
+    if (allocated) {
+        return;
+    }
+
+    // Count against free space under the lock, so two jobs cannot both
+    // claim the same bytes
+    std::lock_guard<std::mutex> lock(ledgerMutex);
+    fs::path directory = fs::path(path).parent_path();
+    uint64_t available = fs::space(directory.empty() ? fs::path(".") : directory).available;
+    uint64_t others = ledger[device];
+    if (available < others || available - others < size) {
+        if (created) {
+            ::unlink(path.c_str());
+        }
+        DB_THROW(StorageError, insufficient(path, size));
+    }
+    ledger[device] += size;
+}
+
+SpaceReservation::~SpaceReservation() {
+    release();
+}
+
+SpaceReservation::SpaceReservation(SpaceReservation&& other) noexcept
+    : device(other.device), bytes(other.bytes), allocated(other.allocated) {
+    other.bytes = 0;
+}
+
+SpaceReservation& SpaceReservation::operator=(SpaceReservation&& other) noexcept {
+    if (this != &other) {
+        release();
+        device = other.device;
+        bytes = other.bytes;
+        allocated = other.allocated;
+        other.bytes = 0;
+    }
+    return *this;
+}
+
+void SpaceReservation::release() noexcept {
+    if (bytes > 0 && !allocated) {
+        std::lock_guard<std::mutex> lock(ledgerMutex);
+        ledger[device] -= bytes;
+    }
+    bytes = 0;
+}
+
+uint64_t SpaceReservation::held(const std::string& path) {
+    uint64_t device = deviceOf(path);
+    std::lock_guard<std::mutex> lock(ledgerMutex);
+    auto found = ledger.find(device);
+    return found == ledger.end() ? 0 : found->second;
+}
+
+} // namespace dbbackup
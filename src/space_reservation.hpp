@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace dbbackup {
+
+/// Space set aside for a file about to be written, so a backup fails before
+/// it starts rather than with ENOSPC halfway through. Where the filesystem
+/// supports fallocate the file is extended to the reserved size with its
+/// blocks allocated up front: the space leaves the volume at once, visibly
+/// to every process sharing it, and the file is laid out contiguously
+/// instead of growing extent by extent. Write such a file with
+/// FileIOOptions::overwrite, which reuses the blocks and cuts the file to
+/// the bytes actually written. Elsewhere the bytes are only held against
+/// the volume's free space, for the reservations of this process.
+class SpaceReservation {
+public:
+    /// Holds nothing
+    SpaceReservation() = default;
+
+    /// Reserve size bytes for the file at path, creating it. Throws
+    /// StorageError if they do not fit.
+    SpaceReservation(const std::string& path, uint64_t size);
+
+    /// Returns held bytes; preallocated blocks belong to the file
+    ~SpaceReservation();
+
+    SpaceReservation(SpaceReservation&& other) noexcept;
+    SpaceReservation& operator=(SpaceReservation&& other) noexcept;
+    SpaceReservation(const SpaceReservation&) = delete;
+    SpaceReservation& operator=(const SpaceReservation&) = delete;
+
+    uint64_t size() const { return bytes; }
+
+    /// True if the file's blocks were allocated rather than only counted
+    bool preallocated() const { return allocated; }
+
+    /// Bytes this process holds without preallocation on the filesystem of
+    /// path
+    static uint64_t held(const std::string& path);
+
+private:
+    void release() noexcept;
+
+    uint64_t device = 0;
+    uint64_t bytes = 0;
+    bool allocated = false;
+};
+
+} // namespace dbbackup
@@ -1,4 +1,12 @@
 #include "storage.hpp"
+#include "checksum.hpp"
+#include "chunk_store.hpp"
+#include "file_utils.hpp"
+#include "logging.hpp"
+#include "retention.hpp"
+#include "space_reservation.hpp"
+#include "thread_pool.hpp"
+#include "stream.hpp"
 #include "error/ErrorUtils.hpp"
 #include <iostream>
 #include <filesystem>
@@ -7,11 +15,15 @@
 #include <algorithm>
 #include <sstream>
 #include <iomanip>
+#include <vector>
 #include <openssl/evp.h>
 
 namespace fs = std::filesystem;
 using namespace dbbackup::error;
 
+// Unlinks are metadata operations; a few in flight hide their latency
+static constexpr size_t PRUNE_THREADS = 8;
+
 // Helper function to get current timestamp as string
 static std::string getCurrentTimestamp() {
     auto now = std::chrono::system_clock::now();
@@ -21,7 +33,15 @@ static std::string getCurrentTimestamp() {
     return ss.str();
 }
 
-LocalStorage::LocalStorage(const dbbackup::StorageConfig& config) : config(config) {
+// Dictionaries live next to the backup metadata as <id>.dict, with a
+// <codec>.current file naming the one new backups use
+static fs::path dictionaryDirectory(const dbbackup::StorageConfig& config) {
+    return fs::path(config.localPath) / "metadata" / "dictionaries";
+}
+
+LocalStorage::LocalStorage(const dbbackup::StorageConfig& config)
+    : config(config)
+    , catalog((fs::path(config.localPath) / "metadata").string()) {
     ensureStorageDirectory();
 }
 
@@ -42,47 +62,52 @@ void LocalStorage::ensureStorageDirectory() const {
     });
 }
 
-std::string LocalStorage::calculateChecksum(const std::string& filePath) const {
-    std::ifstream file(filePath, std::ios::binary);
-    if (!file) {
-        DB_THROW(StorageError, "Failed to open file for checksum calculation");
+std::string LocalStorage::shareIdentical(const std::string& path, const BackupMetadata& metadata) {
+    if (metadata.checksum.empty() || dbbackup::ChunkStore::isManifest(metadata.filename)) {
+        return "";
     }
-
-    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
-    if (!ctx) {
-        DB_THROW(StorageError, "Failed to create message digest context");
-    }
-
-    if (EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr) != 1) {
-        EVP_MD_CTX_free(ctx);
-        DB_THROW(StorageError, "Failed to initialize message digest");
-    }
-
-    char buffer[4096];
-    while (file.read(buffer, sizeof(buffer))) {
-        if (EVP_DigestUpdate(ctx, buffer, file.gcount()) != 1) {
-            EVP_MD_CTX_free(ctx);
-            DB_THROW(StorageError, "Failed to update message digest");
+    // Newest first: the most recent copy is the likeliest to be intact
+    auto identical = catalog.listByChecksum(metadata.checksum);
+    for (auto it = identical.rbegin(); it != identical.rend(); ++it) {
+        // Trust what the catalog and the scrubber know rather than reading
+        // the copy again: a copy that rotted would take the new backup
+        // down with it, but re-reading it costs more than the write saved
+        if (it->filename == metadata.filename || it->damaged || it->size != metadata.size ||
+            (!it->fastChecksum.empty() && !metadata.fastChecksum.empty() &&
+             it->fastChecksum != metadata.fastChecksum)) {
+            continue;
+        }
+        fs::path existing = fs::path(config.localPath) / it->filename;
+        std::error_code error;
+        if (fs::file_size(existing, error) != metadata.size || error) {
+            continue;
+        }
+        if (fs::equivalent(existing, path, error)) {
+            return it->filename;
         }
-    }
-
-    unsigned char hash[EVP_MAX_MD_SIZE];
-    unsigned int hashLen;
-    if (EVP_DigestFinal_ex(ctx, hash, &hashLen) != 1) {
-        EVP_MD_CTX_free(ctx);
-        DB_THROW(StorageError, "Failed to finalize message digest");
-    }
-
-    EVP_MD_CTX_free(ctx);
 
-    std::stringstream ss;
-    for (unsigned int i = 0; i < hashLen; i++) {
-        ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(hash[i]);
+        // Link beside the new file and rename it over, so its name never
+        // goes missing
+        fs::path link = fs::path(path).parent_path() / (".tmp_" + metadata.filename + ".link");
+        fs::remove(link, error);
+        fs::create_hard_link(existing, link, error);
+        if (error) {
+            getLogger()->debug("Cannot link {} to {}: {}", path, existing.string(), error.message());
+            return "";
+        }
+        try {
+            dbbackup::commitFile(link.string(), path);
+        } catch (...) {
+            fs::remove(link, error);
+            throw;
+        }
+        getLogger()->info("Backup {} is identical to {}; stored once", metadata.filename, it->filename);
+        return it->filename;
     }
-    return ss.str();
+    return "";
 }
 
-BackupMetadata LocalStorage::storeBackup(const std::string& sourcePath) {
+BackupMetadata LocalStorage::storeBackup(const std::string& sourcePath, bool move) {
     BackupMetadata metadata;
     DB_TRY_CATCH_LOG("Storage", {
         fs::path source(sourcePath);
@@ -90,36 +115,192 @@ BackupMetadata LocalStorage::storeBackup(const std::string& sourcePath) {
             DB_THROW(StorageError, "Source backup file does not exist");
         }
 
-        // Check available space
-        size_t requiredSpace = fs::file_size(source) * 1.1; // Add 10% buffer
-        if (getAvailableSpace() < requiredSpace) {
-            DB_THROW(StorageError, "Insufficient storage space");
-        }
-
         // Generate unique filename with timestamp
         std::string timestamp = getCurrentTimestamp();
         fs::path destPath = fs::path(config.localPath) / 
             (fs::path(source).stem().string() + "_" + timestamp + fs::path(source).extension().string());
+        fs::path tmpPath = fs::path(config.localPath) / (".tmp_" + destPath.filename().string() + ".partial");
+
+        // Reserve the space a copy needs before starting it. Only a move
+        // within the filesystem is sure to be a rename; a reflink can fall
+        // back to a full copy.
+        dbbackup::SpaceReservation reservation;
+        if (!move || !dbbackup::sameFilesystem(source.string(), config.localPath)) {
+            reservation = dbbackup::SpaceReservation(tmpPath.string(), fs::file_size(source));
+        }
 
-        // Copy file
-        fs::copy_file(source, destPath, fs::copy_options::overwrite_existing);
+        // Move, clone or copy the file as cheaply as the filesystems allow,
+        // then make it durable under its name before cataloguing it
+        dbbackup::checksum::Digest digest;
+        auto method = dbbackup::placeFile(source.string(), tmpPath.string(), move, &digest);
+        bool renamed = method == dbbackup::PlaceMethod::Renamed;
+        try {
+            dbbackup::syncFile(tmpPath.string());
+            dbbackup::commitFile(tmpPath.string(), destPath.string());
+        } catch (...) {
+            // A renamed source is put back rather than lost; a copied one
+            // was never touched
+            std::error_code error;
+            if (renamed) {
+                fs::rename(tmpPath, source, error);
+            } else {
+                fs::remove(tmpPath, error);
+            }
+            throw;
+        }
+        // Only now that the copy is durable under its name
+        if (move && !renamed) {
+            fs::remove(source);
+        }
+        getLogger()->debug("Stored {} ({})", destPath.string(), dbbackup::placeMethodToString(method));
 
         // Create metadata
         metadata.filename = destPath.filename().string();
         metadata.timestamp = timestamp;
-        metadata.size = fs::file_size(destPath);
-        metadata.checksum = calculateChecksum(destPath.string());
-        
-        saveMetadata(metadata);
+        metadata.size = digest.size;
+        metadata.checksum = digest.sha256;
+        metadata.fastChecksum = digest.xxh64;
+
+        shareIdentical(destPath.string(), metadata);
+        catalog.add(metadata);
 
         // Clean old backups if needed
-        if (config.backup && config.backup->retention.maxBackups > 0) {
-            cleanOldBackups(config.backup->retention.maxBackups);
+        if (config.backup) {
+            applyRetention(config.backup->retention);
         }
     });
     return metadata;
 }
 
+BackupMetadata LocalStorage::registerBackup(const std::string& backupPath,
+                                           const std::string& compression,
+                                           const std::string& compressionLevel,
+                                           const std::string& dictionary) {
+    BackupMetadata metadata;
+    DB_TRY_CATCH_LOG("Storage", {
+        fs::path path(backupPath);
+        if (!fs::exists(path)) {
+            DB_THROW(StorageError, "Backup file does not exist");
+        }
+
+        metadata.filename = path.filename().string();
+        metadata.timestamp = getCurrentTimestamp();
+        auto digest = dbbackup::checksum::digestFile(path.string());
+        metadata.size = digest.size;
+        metadata.checksum = digest.sha256;
+        metadata.fastChecksum = digest.xxh64;
+        metadata.compression = compression;
+        metadata.compressionLevel = compression.empty() ? "" : compressionLevel;
+        metadata.dictionary = dictionary;
+
+        shareIdentical(path.string(), metadata);
+        catalog.add(metadata);
+    });
+    return metadata;
+}
+
+BackupMetadata LocalStorage::registerBackup(const std::string& backupPath, const BackupMetadata& written) {
+    BackupMetadata metadata = written;
+    DB_TRY_CATCH_LOG("Storage", {
+        fs::path path(backupPath);
+        if (!fs::exists(path)) {
+            DB_THROW(StorageError, "Backup file does not exist");
+        }
+        // A stat is enough to catch a writer that lost bytes after digesting them
+        if (fs::file_size(path) != written.size) {
+            DB_THROW(StorageError, "Backup file size does not match the bytes written: " + backupPath);
+        }
+
+        metadata.filename = path.filename().string();
+        metadata.timestamp = getCurrentTimestamp();
+        if (metadata.compression.empty()) {
+            metadata.compressionLevel.clear();
+        }
+
+        shareIdentical(path.string(), metadata);
+        catalog.add(metadata);
+    });
+    return metadata;
+}
+
+std::string LocalStorage::saveDictionary(const std::string& codec, const std::string& dictionary) {
+    DB_TRY_CATCH_LOG("Storage", {
+        DB_CHECK(!codec.empty() && !dictionary.empty(), ValidationError, "Empty compression dictionary");
+
+        // Content-addressed, so retraining an identical dictionary is a no-op
+        unsigned char hash[EVP_MAX_MD_SIZE];
+        unsigned int hashLen = 0;
+        if (EVP_Digest(dictionary.data(), dictionary.size(), hash, &hashLen, EVP_sha256(), nullptr) != 1) {
+            DB_THROW(StorageError, "Failed to hash compression dictionary");
+        }
+        std::stringstream ss;
+        ss << codec << "_";
+        for (unsigned int i = 0; i < 8; i++) {
+            ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(hash[i]);
+        }
+        std::string id = ss.str();
+
+        putDictionary(id, dictionary);
+
+        fs::path directory = dictionaryDirectory(config);
+        std::ofstream current(directory / (codec + ".current"));
+        current << id << "\n";
+        if (!current) {
+            DB_THROW(StorageError, "Failed to record current compression dictionary");
+        }
+        return id;
+    });
+    return "";
+}
+
+void LocalStorage::putDictionary(const std::string& id, const std::string& dictionary) {
+    DB_CHECK(!id.empty() && fs::path(id).filename() == id, ValidationError, "Invalid dictionary id: " + id);
+    fs::path directory = dictionaryDirectory(config);
+    fs::path dictionaryPath = directory / (id + ".dict");
+    if (fs::exists(dictionaryPath)) {
+        return;
+    }
+    fs::create_directories(directory);
+
+    // Durable before any backup primed with it is catalogued here
+    fs::path tmpPath = directory / (".tmp_" + id + ".dict");
+    try {
+        dbbackup::FileIOOptions io;
+        io.sync = true;
+        dbbackup::FileSink file(tmpPath.string(), io);
+        if (!file) {
+            DB_THROW(StorageError, "Failed to save compression dictionary: " + id);
+        }
+        file.write(dictionary.data(), dictionary.size());
+        file.finish();
+        dbbackup::commitFile(tmpPath.string(), dictionaryPath.string());
+    } catch (...) {
+        std::error_code ignored;
+        fs::remove(tmpPath, ignored);
+        throw;
+    }
+}
+
+std::string LocalStorage::loadDictionary(const std::string& id) const {
+    fs::path dictionaryPath = dictionaryDirectory(config) / (id + ".dict");
+    std::ifstream file(dictionaryPath, std::ios::binary);
+    if (!file) {
+        DB_THROW(StorageError, "Compression dictionary not found: " + id);
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+std::string LocalStorage::currentDictionary(const std::string& codec) const {
+    std::ifstream current(dictionaryDirectory(config) / (codec + ".current"));
+    std::string id;
+    if (!current || !std::getline(current, id)) {
+        return "";
+    }
+    return fs::exists(dictionaryDirectory(config) / (id + ".dict")) ? id : "";
+}
+
 std::string LocalStorage::retrieveBackup(const std::string& backupName) {
     fs::path backupPath = fs::path(config.localPath) / backupName;
     if (!fs::exists(backupPath)) {
@@ -128,65 +309,161 @@ std::string LocalStorage::retrieveBackup(const std::string& backupName) {
     return backupPath.string();
 }
 
+BackupMetadata LocalStorage::put(const BackupMetadata& backup, dbbackup::InputSource& source) {
+    BackupMetadata metadata = backup;
+    DB_TRY_CATCH_LOG("Storage", {
+        DB_CHECK(!backup.filename.empty() && fs::path(backup.filename).filename() == backup.filename,
+                ValidationError, "Invalid backup name: " + backup.filename);
+        fs::path destPath = fs::path(config.localPath) / backup.filename;
+        fs::path tmpPath = fs::path(config.localPath) / (".tmp_" + backup.filename + ".partial");
+        try {
+            dbbackup::FileIOOptions io;
+            io.sync = true;
+            dbbackup::FileSink file(tmpPath.string(), io);
+            if (!file) {
+                DB_THROW(StorageError, "Failed to create backup file: " + tmpPath.string());
+            }
+            dbbackup::checksum::DigestSink digest(file);
+            dbbackup::copyStream(source, digest);
+            digest.finish();
+            metadata.size = digest.digest().size;
+            metadata.checksum = digest.digest().sha256;
+            metadata.fastChecksum = digest.digest().xxh64;
+            dbbackup::commitFile(tmpPath.string(), destPath.string());
+        } catch (...) {
+            std::error_code ignored;
+            fs::remove(tmpPath, ignored);
+            throw;
+        }
+
+        if (metadata.timestamp.empty()) {
+            metadata.timestamp = getCurrentTimestamp();
+        }
+        shareIdentical(destPath.string(), metadata);
+        catalog.add(metadata);
+    });
+    return metadata;
+}
+
+std::unique_ptr<dbbackup::InputSource> LocalStorage::open(const std::string& backupName) const {
+    auto file = std::make_unique<dbbackup::FileSource>((fs::path(config.localPath) / backupName).string());
+    if (!*file) {
+        DB_THROW(StorageError, "Backup file does not exist: " + backupName);
+    }
+    return file;
+}
+
 std::vector<BackupMetadata> LocalStorage::listBackups() const {
-    return loadMetadata();
+    return catalog.list();
 }
 
-bool LocalStorage::deleteBackup(const std::string& backupName) {
+std::optional<BackupMetadata> LocalStorage::findBackup(const std::string& backupName) const {
+    return catalog.find(backupName);
+}
+
+bool LocalStorage::markVerified(const std::string& backupName, bool intact) {
+    return catalog.markVerified(backupName, getCurrentTimestamp(), !intact);
+}
+
+bool LocalStorage::verifyBackup(const std::string& backupName, bool full) const {
     DB_TRY_CATCH_LOG("Storage", {
         fs::path backupPath = fs::path(config.localPath) / backupName;
-        if (!fs::exists(backupPath)) {
+        auto metadata = catalog.find(backupName);
+        if (!metadata || !fs::exists(backupPath) || fs::file_size(backupPath) != metadata->size) {
             return false;
         }
-
-        // Remove the file
-        fs::remove(backupPath);
-
-        // Update metadata
-        auto metadata = loadMetadata();
-        metadata.erase(
-            std::remove_if(metadata.begin(), metadata.end(),
-                [&backupName](const BackupMetadata& m) { return m.filename == backupName; }),
-            metadata.end()
-        );
-        
-        // Save updated metadata
-        fs::path metadataPath = fs::path(config.localPath) / "metadata" / "backups.json";
-        std::ofstream metadataFile(metadataPath);
-        if (!metadataFile) {
-            DB_THROW(StorageError, "Failed to update metadata after deletion");
+        auto digest = dbbackup::checksum::digestFile(backupPath.string());
+        if (!full && !metadata->fastChecksum.empty()) {
+            return digest.xxh64 == metadata->fastChecksum;
         }
-
-        return true;
+        return digest.sha256 == metadata->checksum;
     });
     return false;
 }
 
+bool LocalStorage::deleteBackup(const std::string& backupName) {
+    // Same catalog-first protocol as a batch: a crash leaves an orphaned
+    // file, never an entry for a missing one
+    return removeBackups({backupName}) > 0;
+}
+
 size_t LocalStorage::cleanOldBackups(size_t keepCount) {
+    dbbackup::RetentionConfig policy;
+    policy.days = 0;
+    policy.maxBackups = static_cast<int>(keepCount);
+    return applyRetention(policy);
+}
+
+size_t LocalStorage::removeBackups(const std::vector<std::string>& backupNames) {
     DB_TRY_CATCH_LOG("Storage", {
-        auto metadata = loadMetadata();
-        if (metadata.size() <= keepCount) {
+        // Only catalogued names: files of others are not ours to unlink
+        std::vector<std::string> names;
+        bool manifests = false;
+        for (const auto& name : backupNames) {
+            if (catalog.find(name)) {
+                names.push_back(name);
+                manifests = manifests || dbbackup::ChunkStore::isManifest(name);
+            }
+        }
+        if (names.empty()) {
             return 0;
         }
 
-        // Sort by timestamp (newest first)
-        std::sort(metadata.begin(), metadata.end(),
-            [](const BackupMetadata& a, const BackupMetadata& b) {
-                return a.timestamp > b.timestamp;
-            });
-
-        size_t deletedCount = 0;
-        for (size_t i = keepCount; i < metadata.size(); i++) {
-            if (deleteBackup(metadata[i].filename)) {
-                deletedCount++;
+        // Catalog first, in one update: a crash before the files are gone
+        // leaves orphaned files, never entries for missing backups
+        size_t pruned = catalog.remove(names);
+
+        // A name sharing its contents with a kept backup only drops a
+        // link; the filesystem frees the contents with the last one
+        size_t shared = 0;
+        for (const auto& name : names) {
+            std::error_code error;
+            if (fs::hard_link_count(fs::path(config.localPath) / name, error) > 1 && !error) {
+                shared++;
             }
         }
+        if (shared > 0) {
+            getLogger()->debug("{} of {} pruned backups share their contents with other backups", shared, names.size());
+        }
 
-        return deletedCount;
+        dbbackup::ThreadPool pool(std::min(names.size(), PRUNE_THREADS));
+        std::vector<std::future<bool>> removals;
+        for (const auto& name : names) {
+            fs::path path = fs::path(config.localPath) / name;
+            removals.push_back(pool.submit([path]() {
+                std::error_code error;
+                return fs::remove(path, error);
+            }));
+        }
+        for (auto& removal : removals) {
+            removal.get();
+        }
+
+        // Chunks only pruned backups referenced go with them
+        if (manifests) {
+            dbbackup::ChunkStore(config.localPath).collectGarbage();
+        }
+        return pruned;
     });
     return 0;
 }
 
+size_t LocalStorage::removeStaleTemporaries(std::chrono::seconds olderThan) {
+    size_t removed = 0;
+    auto cutoff = fs::file_time_type::clock::now() - olderThan;
+    for (const auto& entry : fs::directory_iterator(config.localPath)) {
+        std::error_code error;
+        if (entry.path().filename().string().rfind(".tmp_", 0) != 0 ||
+            !entry.is_regular_file(error) || entry.last_write_time(error) > cutoff || error) {
+            continue;
+        }
+        if (fs::remove(entry.path(), error)) {
+            removed++;
+        }
+    }
+    return removed;
+}
+
 size_t LocalStorage::getAvailableSpace() const {
     DB_TRY_CATCH_LOG("Storage", {
         fs::space_info space = fs::space(config.localPath);
@@ -195,74 +472,6 @@ size_t LocalStorage::getAvailableSpace() const {
     return 0;
 }
 
-void LocalStorage::saveMetadata(const BackupMetadata& metadata) const {
-    DB_TRY_CATCH_LOG("Storage", {
-        fs::path metadataPath = fs::path(config.localPath) / "metadata" / "backups.json";
-        
-        // Load existing metadata
-        auto existingMetadata = loadMetadata();
-        
-        // Add new metadata
-        existingMetadata.push_back(metadata);
-        
-        // Save updated metadata
-        std::ofstream metadataFile(metadataPath);
-        if (!metadataFile) {
-            DB_THROW(StorageError, "Failed to save backup metadata");
-        }
-        
-        // Write metadata as JSON
-        metadataFile << "[\n";
-        for (size_t i = 0; i < existingMetadata.size(); i++) {
-            const auto& m = existingMetadata[i];
-            metadataFile << "  {\n";
-            metadataFile << "    \"filename\": \"" << m.filename << "\",\n";
-            metadataFile << "    \"timestamp\": \"" << m.timestamp << "\",\n";
-            metadataFile << "    \"size\": " << m.size << ",\n";
-            metadataFile << "    \"checksum\": \"" << m.checksum << "\"\n";
-            metadataFile << "  }" << (i < existingMetadata.size() - 1 ? "," : "") << "\n";
-        }
-        metadataFile << "]\n";
-    });
-}
-
-std::vector<BackupMetadata> LocalStorage::loadMetadata() const {
-    DB_TRY_CATCH_LOG("Storage", {
-        fs::path metadataPath = fs::path(config.localPath) / "metadata" / "backups.json";
-        if (!fs::exists(metadataPath)) {
-            return {};
-        }
-
-        std::vector<BackupMetadata> metadata;
-        std::ifstream metadataFile(metadataPath);
-        if (!metadataFile) {
-            DB_THROW(StorageError, "Failed to read backup metadata");
-        }
-
-        // Simple JSON parsing (in a real implementation, use a proper JSON library)
-        std::string line;
-        BackupMetadata current;
-        while (std::getline(metadataFile, line)) {
-            if (line.find("\"filename\"") != std::string::npos) {
-                current.filename = line.substr(line.find(":") + 3);
-                current.filename = current.filename.substr(0, current.filename.length() - 2);
-            } else if (line.find("\"timestamp\"") != std::string::npos) {
-                current.timestamp = line.substr(line.find(":") + 3);
-                current.timestamp = current.timestamp.substr(0, current.timestamp.length() - 2);
-            } else if (line.find("\"size\"") != std::string::npos) {
-                current.size = std::stoull(line.substr(line.find(":") + 2));
-            } else if (line.find("\"checksum\"") != std::string::npos) {
-                current.checksum = line.substr(line.find(":") + 3);
-                current.checksum = current.checksum.substr(0, current.checksum.length() - 2);
-                metadata.push_back(current);
-            }
-        }
-
-        return metadata;
-    });
-    return {};
-}
-
 // Keep the original global function for backward compatibility
 bool storeBackup(const dbbackup::StorageConfig& storageConfig, const std::string& localBackupPath) {
     DB_TRY_CATCH_LOG("Storage", {
@@ -272,3 +481,39 @@ bool storeBackup(const dbbackup::StorageConfig& storageConfig, const std::string
     });
     return false;
 }
+
+// Metadata of the catalogued backup at backupPath, false if there is none
+static bool findRecordedBackup(const dbbackup::StorageConfig& storageConfig, const std::string& backupPath,
+                               BackupMetadata& found) {
+    if (storageConfig.localPath.empty()) {
+        return false;
+    }
+    try {
+        // Backups moved to the archive tier are catalogued there
+        auto storage = createStorageBackend(storageConfig);
+        auto metadata = storage->stat(fs::path(backupPath).filename().string());
+        if (metadata) {
+            found = *metadata;
+            return true;
+        }
+    } catch (const std::exception&) {
+        // Missing or unreadable metadata just means nothing was recorded
+    }
+    return false;
+}
+
+std::string recordedCompression(const dbbackup::StorageConfig& storageConfig, const std::string& backupPath) {
+    BackupMetadata metadata;
+    return findRecordedBackup(storageConfig, backupPath, metadata) ? metadata.compression : "";
+}
+
+std::shared_ptr<const std::string> recordedDictionary(const dbbackup::StorageConfig& storageConfig,
+                                                      const std::string& backupPath) {
+    BackupMetadata metadata;
+    if (!findRecordedBackup(storageConfig, backupPath, metadata) || metadata.dictionary.empty()) {
+        return nullptr;
+    }
+    // Kept with each tier the backup may be in
+    auto storage = createStorageBackend(storageConfig);
+    return std::make_shared<const std::string>(storage->loadDictionary(metadata.dictionary));
+}
@@ -1,6 +1,11 @@
 #pragma once
 
 #include "config.hpp"
+#include "catalog.hpp"
+#include "storage_backend.hpp"
+#include <chrono>
+#include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -8,46 +13,128 @@
 /// Return true on success.
 bool storeBackup(const dbbackup::StorageConfig& storageConfig, const std::string& localBackupPath);
 
-struct BackupMetadata {
-    std::string filename;
-    std::string timestamp;
-    size_t size;
-    std::string checksum;
-};
+/// Codec name recorded for a backup in local storage metadata, empty if the
+/// backup is not catalogued or was stored uncompressed. Never throws.
+std::string recordedCompression(const dbbackup::StorageConfig& storageConfig, const std::string& backupPath);
+
+/// Compression dictionary recorded for a backup in local storage metadata,
+/// null if none was used. Throws StorageError if the recorded dictionary is
+/// missing, since the backup cannot be decoded without it.
+std::shared_ptr<const std::string> recordedDictionary(const dbbackup::StorageConfig& storageConfig,
+                                                      const std::string& backupPath);
 
-class LocalStorage {
+/// Backups as files in storage.localPath, catalogued under metadata/.
+/// Identical backups are stored once: a backup with the SHA-256 of one
+/// already catalogued becomes another hard link to that file, so each name
+/// stays a complete file to open, verify or restore, and the contents are
+/// freed when the last name referring to them is deleted.
+class LocalStorage : public StorageBackend {
 public:
     /// Initialize local storage with given configuration
     explicit LocalStorage(const dbbackup::StorageConfig& config);
 
-    /// Store a backup file with rotation policy
-    /// Returns metadata of stored backup on success
-    BackupMetadata storeBackup(const std::string& sourcePath);
+    /// Store a backup file with rotation policy. The file is renamed into
+    /// place if move is set and it is on the same filesystem, otherwise
+    /// reflinked or copied in the kernel where possible (see placeFile).
+    /// The file is synced and renamed to its final name before the catalog
+    /// lists it. Returns metadata of stored backup on success
+    BackupMetadata storeBackup(const std::string& sourcePath, bool move = false);
+
+    /// Record a backup already written into the storage directory, without
+    /// copying it. compression names the codec used ("" if none), dictionary
+    /// the id of the compression dictionary it was primed with.
+    /// Returns metadata of the registered backup
+    BackupMetadata registerBackup(const std::string& backupPath,
+                                  const std::string& compression,
+                                  const std::string& compressionLevel,
+                                  const std::string& dictionary = "");
+
+    /// Record a backup whose size and checksums were computed while it was
+    /// written (see checksum::DigestSink), so it is not read back. Filename
+    /// and timestamp are filled in; the other fields are taken from written.
+    /// Throws StorageError if the file size differs from written.size.
+    BackupMetadata registerBackup(const std::string& backupPath, const BackupMetadata& written);
+
+    /// Store a compression dictionary trained for codec and make it the one
+    /// the next backup with that codec uses. Returns its id.
+    std::string saveDictionary(const std::string& codec, const std::string& dictionary);
+
+    /// Contents of a stored dictionary. Throws StorageError if it is missing.
+    std::string loadDictionary(const std::string& id) const override;
+
+    /// Written under a temporary name, synced and renamed into place
+    void putDictionary(const std::string& id, const std::string& dictionary) override;
+
+    /// Id of the dictionary the next backup with codec should use, empty if
+    /// none has been trained yet
+    std::string currentDictionary(const std::string& codec) const;
 
     /// Retrieve a backup file by name
     /// Returns path to the backup file
     std::string retrieveBackup(const std::string& backupName);
 
+    /// Written under a temporary name, synced and renamed into place
+    /// before it is catalogued
+    BackupMetadata put(const BackupMetadata& backup, dbbackup::InputSource& source) override;
+    std::unique_ptr<dbbackup::InputSource> open(const std::string& backupName) const override;
+    std::vector<BackupMetadata> list() const override { return listBackups(); }
+    std::optional<BackupMetadata> stat(const std::string& backupName) const override { return findBackup(backupName); }
+    bool remove(const std::string& backupName) override { return deleteBackup(backupName); }
+    bool markVerified(const std::string& backupName, bool intact) override;
+
     /// List all available backups
-    /// Returns vector of backup metadata
+    /// Returns vector of backup metadata, oldest first
     std::vector<BackupMetadata> listBackups() const;
 
+    /// Metadata of a catalogued backup, nullopt if it is not catalogued
+    std::optional<BackupMetadata> findBackup(const std::string& backupName) const;
+
+    /// The catalog backing this storage, for lookups by time or type
+    const BackupCatalog& getCatalog() const { return catalog; }
+
+    /// Check a stored backup against its recorded size and checksum. The
+    /// XXH64 fast checksum is used when recorded unless full is set, which
+    /// rehashes with SHA-256. Returns false on mismatch or if the backup is
+    /// missing or not catalogued.
+    bool verifyBackup(const std::string& backupName, bool full = false) const;
+
     /// Delete a backup by name
     /// Returns true if successful
     bool deleteBackup(const std::string& backupName);
 
-    /// Clean old backups according to retention policy
+    /// Keep only the newest keepCount backups. Contents shared with a kept
+    /// backup stay on disk.
     /// Returns number of backups deleted
     size_t cleanOldBackups(size_t keepCount);
 
+    /// Delete backups with one catalog update, unlinking their files in
+    /// parallel and collecting chunk garbage once if any was deduplicated.
+    /// Returns the number of backups deleted. applyRetention prunes
+    /// through this.
+    size_t removeBackups(const std::vector<std::string>& backupNames) override;
+
+    /// Temporary files older than this are left over from a crash; live
+    /// writers touch theirs continuously
+    static constexpr std::chrono::hours STALE_TEMPORARY_AGE{24};
+
+    /// Delete .tmp_ files in the storage directory not modified for
+    /// olderThan, which backups and puts interrupted by a crash leave
+    /// behind. Returns the number removed.
+    size_t removeStaleTemporaries(std::chrono::seconds olderThan = STALE_TEMPORARY_AGE);
+
     /// Get available storage space
     /// Returns available space in bytes
     size_t getAvailableSpace() const;
 
 private:
     dbbackup::StorageConfig config;
-    std::string calculateChecksum(const std::string& filePath) const;
+    BackupCatalog catalog;
     void ensureStorageDirectory() const;
-    void saveMetadata(const BackupMetadata& metadata) const;
-    std::vector<BackupMetadata> loadMetadata() const;
+
+    /// Replace the file at path, just written for metadata, with a hard
+    /// link to a catalogued backup with the same size, SHA-256 and XXH64
+    /// that the scrubber has not found damaged. The copy is not read again.
+    /// Returns that backup's name, empty if there is none or the filesystem
+    /// cannot link. Call before cataloguing metadata.
+    std::string shareIdentical(const std::string& path, const BackupMetadata& metadata);
 };
@@ -0,0 +1,33 @@
+#include "storage_backend.hpp"
+#include "retention.hpp"
+#include "storage.hpp"
+#include "tiered_storage.hpp"
+
+size_t StorageBackend::removeBackups(const std::vector<std::string>& backupNames) {
+    size_t removed = 0;
+    for (const auto& name : backupNames) {
+        if (remove(name)) {
+            removed++;
+        }
+    }
+    return removed;
+}
+
+size_t StorageBackend::applyRetention(const dbbackup::RetentionConfig& policy) {
+    auto plan = dbbackup::planRetention(list(), policy);
+    if (plan.prune.empty()) {
+        return 0;
+    }
+    std::vector<std::string> names;
+    for (const auto& backup : plan.prune) {
+        names.push_back(backup.filename);
+    }
+    return removeBackups(names);
+}
+
+std::unique_ptr<StorageBackend> createStorageBackend(const dbbackup::StorageConfig& config) {
+    if (auto tiers = createTieredStorage(config)) {
+        return tiers;
+    }
+    return std::make_unique<LocalStorage>(config);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "catalog.hpp"
+#include "config.hpp"
+#include "stream.hpp"
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+/// A place backups are kept, addressed by filename, with its own catalog.
+/// Implementations throw StorageError on failure and must allow calls from
+/// several threads at once.
+class StorageBackend {
+public:
+    virtual ~StorageBackend() = default;
+
+    /// Store the stream as backup.filename. Timestamp, compression and
+    /// dictionary are kept from backup (a missing timestamp becomes now);
+    /// size and checksums are computed from the stream. Replaces a backup
+    /// of the same name. Returns the metadata recorded.
+    virtual BackupMetadata put(const BackupMetadata& backup, dbbackup::InputSource& source) = 0;
+
+    /// Stream of a stored backup's contents
+    virtual std::unique_ptr<dbbackup::InputSource> open(const std::string& backupName) const = 0;
+
+    /// All backups, oldest first
+    virtual std::vector<BackupMetadata> list() const = 0;
+
+    /// Metadata of a backup, nullopt if it is not stored here
+    virtual std::optional<BackupMetadata> stat(const std::string& backupName) const = 0;
+
+    /// Delete a backup. Returns false if it was not stored here.
+    virtual bool remove(const std::string& backupName) = 0;
+
+    /// Delete several backups, skipping names not stored here. Returns the
+    /// number deleted. The default removes them one by one.
+    virtual size_t removeBackups(const std::vector<std::string>& backupNames);
+
+    /// Contents of a compression dictionary backups here were primed with.
+    /// Throws StorageError if it is missing.
+    virtual std::string loadDictionary(const std::string& id) const = 0;
+
+    /// Keep a dictionary under its id with the backups here, so they decode
+    /// wherever they are copied. Does nothing if it is already kept.
+    virtual void putDictionary(const std::string& id, const std::string& dictionary) = 0;
+
+    /// Record that a stored backup was just verified and whether it was
+    /// intact. Returns false if it is not stored here.
+    virtual bool markVerified(const std::string& backupName, bool intact) = 0;
+
+    /// Delete the backups the policy does not keep (see planRetention).
+    /// Returns the number deleted.
+    virtual size_t applyRetention(const dbbackup::RetentionConfig& policy);
+};
+
+/// The backend storage config describes: local storage, or a TieredStorage
+/// when storage.tiering.hotBackups is set
+std::unique_ptr<StorageBackend> createStorageBackend(const dbbackup::StorageConfig& config);
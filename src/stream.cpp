@@ -0,0 +1,279 @@
+#include "stream.hpp"
+#include "error/ErrorUtils.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace dbbackup::error;
+
+namespace dbbackup {
+
+namespace {
+    constexpr size_t IO_ALIGNMENT = 4096;  // Page and O_DIRECT block alignment
+
+    size_t alignUp(size_t size) {
+        return (std::max<size_t>(size, 1) + IO_ALIGNMENT - 1) / IO_ALIGNMENT * IO_ALIGNMENT;
+    }
+
+    std::string errorText() {
+        return std::strerror(errno);
+    }
+}
+
+FileSink::FileSink(const std::string& path, const FileIOOptions& options)
+    : path(path)
+    , sync(options.sync)
+    , overwrite(options.overwrite)
+    , capacity(alignUp(options.bufferSize)) {
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (overwrite ? 0 : O_TRUNC);
+#ifdef O_DIRECT
+    if (options.directIO) {
+        fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+        direct = fd >= 0;
+    }
+#endif
+    if (fd < 0) {
+        fd = ::open(path.c_str(), flags, 0644);
+    }
+#if !defined(O_DIRECT) && defined(F_NOCACHE)
+    // macOS: no O_DIRECT, but caching can be turned off per descriptor
+    if (fd >= 0 && options.directIO) {
+        ::fcntl(fd, F_NOCACHE, 1);
+    }
+#endif
+    if (fd < 0) {
+        return;
+    }
+
+    void* memory = nullptr;
+    if (posix_memalign(&memory, IO_ALIGNMENT, capacity) != 0) {
+        ::close(fd);
+        fd = -1;
+        DB_THROW(StorageError, "Failed to allocate write buffer for: " + path);
+    }
+    buffer = static_cast<char*>(memory);
+}
+
+FileSink::~FileSink() {
+    if (fd >= 0) {
+        // Best effort, like an ofstream going out of scope; finish() reports errors
+        try {
+            flushBuffer(true);
+        } catch (const std::exception&) {
+        }
+        ::close(fd);
+    }
+    std::free(buffer);
+}
+
+void FileSink::write(const char* data, size_t size) {
+    if (fd < 0) {
+        DB_THROW(StorageError, "Failed to write to file: " + path);
+    }
+
+    // Large writes into an empty buffer go straight to the file, unless
+    // O_DIRECT needs them to come from aligned memory
+    if (used == 0 && size >= capacity && !direct) {
+        writeAt(data, size);
+        return;
+    }
+
+    while (size > 0) {
+        size_t n = std::min(size, capacity - used);
+        std::memcpy(buffer + used, data, n);
+        used += n;
+        data += n;
+        size -= n;
+        if (used == capacity) {
+            flushBuffer(false);
+        }
+    }
+}
+
+void FileSink::finish() {
+    if (fd < 0) {
+        return;
+    }
+    flushBuffer(true);
+    // Give back preallocated space the stream did not use
+    if (overwrite && ::ftruncate(fd, static_cast<off_t>(offset)) != 0) {
+        std::string error = errorText();
+        ::close(fd);
+        fd = -1;
+        DB_THROW(StorageError, "Failed to truncate file: " + path + ": " + error);
+    }
+    if (sync && ::fdatasync(fd) != 0) {
+        std::string error = errorText();
+        ::close(fd);
+        fd = -1;
+        DB_THROW(StorageError, "Failed to sync file: " + path + ": " + error);
+    }
+    int result = ::close(fd);
+    fd = -1;
+    if (result != 0) {
+        DB_THROW(StorageError, "Failed to close file: " + path + ": " + errorText());
+    }
+}
+
+void FileSink::flushBuffer(bool final) {
+    if (used == 0) {
+        return;
+    }
+    size_t size = used;
+    if (direct && size % IO_ALIGNMENT != 0) {
+        // O_DIRECT only takes whole blocks: write those, then the tail
+        // through the page cache
+        size_t aligned = size / IO_ALIGNMENT * IO_ALIGNMENT;
+        if (aligned > 0) {
+            writeAt(buffer, aligned);
+        }
+        if (!final) {
+            std::memmove(buffer, buffer + aligned, size - aligned);
+            used = size - aligned;
+            return;
+        }
+#ifdef O_DIRECT
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_DIRECT);
+#endif
+        direct = false;
+        used = 0;
+        writeAt(buffer + aligned, size - aligned);
+        return;
+    }
+    used = 0;
+    writeAt(buffer, size);
+}
+
+void FileSink::writeAt(const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            DB_THROW(StorageError, "Failed to write to file: " + path + ": " + errorText());
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+        offset += static_cast<uint64_t>(written);
+    }
+}
+
+FileSource::FileSource(const std::string& path, const FileIOOptions& options)
+    : path(path) {
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat info;
+    if (options.mapInput && ::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* memory = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (memory != MAP_FAILED) {
+            mapped = static_cast<const char*>(memory);
+            mappedSize = static_cast<uint64_t>(info.st_size);
+            ::madvise(memory, static_cast<size_t>(mappedSize), MADV_SEQUENTIAL);
+            return;
+        }
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+FileSource::~FileSource() {
+    if (mapped) {
+        ::munmap(const_cast<char*>(mapped), static_cast<size_t>(mappedSize));
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+size_t FileSource::read(char* data, size_t size) {
+    if (fd < 0) {
+        DB_THROW(StorageError, "Failed to read from file: " + path);
+    }
+    if (mapped) {
+        const char* view = nullptr;
+        size_t n = readView(view, size);
+        std::memcpy(data, view, n);
+        return n;
+    }
+
+    size_t total = 0;
+    while (total < size) {
+        ssize_t n = ::pread(fd, data + total, size - total, static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            DB_THROW(StorageError, "Failed to read from file: " + path + ": " + errorText());
+        }
+        if (n == 0) {
+            break;
+        }
+        total += static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return total;
+}
+
+size_t FileSource::readView(const char*& data, size_t size) {
+    size_t n = static_cast<size_t>(std::min<uint64_t>(size, mappedSize - offset));
+    data = mapped + offset;
+    offset += n;
+    return n;
+}
+
+void TeeSink::write(const char* data, size_t size) {
+    primary.write(data, size);
+    if (secondary) {
+        try {
+            secondary->write(data, size);
+        } catch (const std::exception& e) {
+            error = e.what();
+            secondary = nullptr;
+        }
+    }
+}
+
+void TeeSink::finish() {
+    primary.finish();
+    if (secondary) {
+        try {
+            secondary->finish();
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        secondary = nullptr;
+    }
+}
+
+uint64_t copyStream(InputSource& source, OutputSink& sink, size_t bufferSize) {
+    uint64_t total = 0;
+    size_t n;
+    if (source.supportsViews()) {
+        const char* view = nullptr;
+        while ((n = source.readView(view, bufferSize)) > 0) {
+            sink.write(view, n);
+            total += n;
+        }
+        return total;
+    }
+
+    std::vector<char> buffer(bufferSize);
+    while ((n = source.read(buffer.data(), buffer.size())) > 0) {
+        sink.write(buffer.data(), n);
+        total += n;
+    }
+    return total;
+}
+
+} // namespace dbbackup
@@ -0,0 +1,197 @@
+#include "tiered_storage.hpp"
+#include "storage.hpp"
+#include "chunk_store.hpp"
+#include "logging.hpp"
+#include "retention.hpp"
+#include "error/ErrorUtils.hpp"
+#include <algorithm>
+#include <map>
+#include <set>
+
+using namespace dbbackup::error;
+
+TieredStorage::TieredStorage(std::unique_ptr<StorageBackend> hot, std::unique_ptr<StorageBackend> cold,
+                             size_t hotCount)
+    : hot(std::move(hot)), cold(std::move(cold)), hotCount(hotCount) {
+    DB_CHECK(this->hot && this->cold, ConfigurationError, "Tiered storage needs two tiers");
+}
+
+TieredStorage::~TieredStorage() = default;
+
+BackupMetadata TieredStorage::put(const BackupMetadata& backup, dbbackup::InputSource& source) {
+    BackupMetadata stored = hot->put(backup, source);
+    // Fire and forget: a failed pass is retried by the next one
+    migrator.submit([this]() {
+        try {
+            migrate();
+        } catch (const std::exception& e) {
+            getLogger()->warn("Failed to migrate backups to the archive tier: {}", e.what());
+        }
+    });
+    return stored;
+}
+
+std::unique_ptr<dbbackup::InputSource> TieredStorage::open(const std::string& backupName) const {
+    // A backup may move between the stat and the open, so try both tiers
+    try {
+        return hot->open(backupName);
+    } catch (const StorageError&) {
+        return cold->open(backupName);
+    }
+}
+
+std::vector<BackupMetadata> TieredStorage::list() const {
+    return merge(cold->list(), hot->list());
+}
+
+std::vector<BackupMetadata> TieredStorage::merge(std::vector<BackupMetadata> coldBackups,
+                                                 std::vector<BackupMetadata> hotBackups) {
+    // Cold first: a backup caught mid-migration is reported from the hot tier
+    std::map<std::string, BackupMetadata> byName;
+    for (auto& backup : coldBackups) {
+        byName[backup.filename] = std::move(backup);
+    }
+    for (auto& backup : hotBackups) {
+        byName[backup.filename] = std::move(backup);
+    }
+
+    std::vector<BackupMetadata> backups;
+    backups.reserve(byName.size());
+    for (auto& entry : byName) {
+        backups.push_back(std::move(entry.second));
+    }
+    std::stable_sort(backups.begin(), backups.end(),
+        [](const BackupMetadata& a, const BackupMetadata& b) {
+            return a.timestamp < b.timestamp;
+        });
+    return backups;
+}
+
+std::optional<BackupMetadata> TieredStorage::stat(const std::string& backupName) const {
+    auto backup = hot->stat(backupName);
+    return backup ? backup : cold->stat(backupName);
+}
+
+bool TieredStorage::remove(const std::string& backupName) {
+    bool removedHot = hot->remove(backupName);
+    bool removedCold = cold->remove(backupName);
+    return removedHot || removedCold;
+}
+
+bool TieredStorage::markVerified(const std::string& backupName, bool intact) {
+    // The copy open() reads
+    return hot->markVerified(backupName, intact) || cold->markVerified(backupName, intact);
+}
+
+size_t TieredStorage::applyRetention(const dbbackup::RetentionConfig& policy) {
+    std::lock_guard<std::mutex> lock(migrationMutex);
+
+    std::vector<BackupMetadata> hotBackups = hot->list();
+    std::vector<BackupMetadata> coldBackups = cold->list();
+    std::set<std::string> onHot;
+    for (const auto& backup : hotBackups) {
+        onHot.insert(backup.filename);
+    }
+    std::set<std::string> onCold;
+    for (const auto& backup : coldBackups) {
+        onCold.insert(backup.filename);
+    }
+
+    auto plan = dbbackup::planRetention(merge(std::move(coldBackups), std::move(hotBackups)), policy);
+    std::vector<std::string> hotNames;
+    std::vector<std::string> coldNames;
+    size_t onBoth = 0;
+    for (const auto& backup : plan.prune) {
+        bool hotCopy = onHot.count(backup.filename) > 0;
+        bool coldCopy = onCold.count(backup.filename) > 0;
+        if (hotCopy) {
+            hotNames.push_back(backup.filename);
+        }
+        if (coldCopy) {
+            coldNames.push_back(backup.filename);
+        }
+        if (hotCopy && coldCopy) {
+            onBoth++;
+        }
+    }
+
+    // A backup left on both tiers by an interrupted migration counts once
+    size_t removed = 0;
+    if (!hotNames.empty()) {
+        removed += hot->removeBackups(hotNames);
+    }
+    if (!coldNames.empty()) {
+        removed += cold->removeBackups(coldNames);
+    }
+    return removed - std::min(removed, onBoth);
+}
+
+std::string TieredStorage::loadDictionary(const std::string& id) const {
+    try {
+        return hot->loadDictionary(id);
+    } catch (const StorageError&) {
+        return cold->loadDictionary(id);
+    }
+}
+
+void TieredStorage::putDictionary(const std::string& id, const std::string& dictionary) {
+    hot->putDictionary(id, dictionary);
+}
+
+size_t TieredStorage::migrate() {
+    std::lock_guard<std::mutex> lock(migrationMutex);
+
+    std::vector<BackupMetadata> newestFirst = hot->list();
+    std::reverse(newestFirst.begin(), newestFirst.end());
+    if (newestFirst.size() <= hotCount) {
+        return 0;
+    }
+
+    size_t moved = 0;
+    for (size_t i = hotCount; i < newestFirst.size(); i++) {
+        const BackupMetadata& backup = newestFirst[i];
+        if (dbbackup::ChunkStore::isManifest(backup.filename)) {
+            continue;
+        }
+
+        // An earlier pass may have copied it and failed to remove it
+        auto archived = cold->stat(backup.filename);
+        if (!backup.dictionary.empty()) {
+            cold->putDictionary(backup.dictionary, hot->loadDictionary(backup.dictionary));
+        }
+        if (!archived || archived->checksum != backup.checksum) {
+            auto source = hot->open(backup.filename);
+            archived = cold->put(backup, *source);
+            if (archived->checksum != backup.checksum) {
+                cold->remove(backup.filename);
+                DB_THROW(StorageError, "Checksum mismatch migrating backup: " + backup.filename);
+            }
+        }
+        hot->remove(backup.filename);
+        moved++;
+    }
+    if (moved > 0) {
+        getLogger()->info("Moved {} backups to the archive tier", moved);
+    }
+    return moved;
+}
+
+std::future<size_t> TieredStorage::migrateAsync() {
+    return migrator.submit([this]() { return migrate(); });
+}
+
+std::unique_ptr<TieredStorage> createTieredStorage(const dbbackup::StorageConfig& config) {
+    if (config.tiering.hotBackups <= 0) {
+        return nullptr;
+    }
+
+    // The archive tier is plain local storage on the slower path; retention
+    // is applied across both tiers, not per tier
+    dbbackup::StorageConfig archive = config;
+    archive.localPath = config.tiering.archivePath;
+    archive.tiering = dbbackup::TieringConfig();
+    archive.backup = nullptr;
+    return std::make_unique<TieredStorage>(std::make_unique<LocalStorage>(config),
+                                           std::make_unique<LocalStorage>(archive),
+                                           static_cast<size_t>(config.tiering.hotBackups));
+}
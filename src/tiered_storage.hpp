@@ -0,0 +1,68 @@
+#pragma once
+
+#include "storage_backend.hpp"
+#include "thread_pool.hpp"
+#include <future>
+#include <memory>
+#include <mutex>
+
+/// Keeps the newest hotCount backups on a fast tier (local NVMe) and moves
+/// older ones to a cheaper, slower tier, so restores of recent backups stay
+/// fast while the retention window lives on cheap storage. New backups go
+/// to the hot tier; each put schedules a migration pass on a background
+/// thread. Reads look in the hot tier first, then the cold one.
+///
+/// A backup is copied to the cold tier, with the compression dictionary it
+/// was primed with, and its checksum compared before it is removed from the
+/// hot one, so a failed migration leaves it where it was. Deduplicated backups (chunk manifests) stay on the hot tier with
+/// their chunk store.
+class TieredStorage : public StorageBackend {
+public:
+    TieredStorage(std::unique_ptr<StorageBackend> hot, std::unique_ptr<StorageBackend> cold, size_t hotCount);
+
+    /// Waits for scheduled migrations
+    ~TieredStorage() override;
+
+    BackupMetadata put(const BackupMetadata& backup, dbbackup::InputSource& source) override;
+    std::unique_ptr<dbbackup::InputSource> open(const std::string& backupName) const override;
+    std::vector<BackupMetadata> list() const override;
+    std::optional<BackupMetadata> stat(const std::string& backupName) const override;
+    bool remove(const std::string& backupName) override;
+    bool markVerified(const std::string& backupName, bool intact) override;
+
+    /// Plans once over both tiers, then prunes each with one batched
+    /// removal, so each tier updates its catalog once and collects chunk
+    /// garbage at most once. Holds off migration meanwhile, so a pruned
+    /// backup is not copied back to the cold tier.
+    size_t applyRetention(const dbbackup::RetentionConfig& policy) override;
+
+    /// From the hot tier, or the cold one where migrated backups took it
+    std::string loadDictionary(const std::string& id) const override;
+    void putDictionary(const std::string& id, const std::string& dictionary) override;
+
+    /// Move hot backups beyond the newest hotCount to the cold tier now.
+    /// Returns the number moved.
+    size_t migrate();
+
+    /// Run migrate() on the background thread
+    std::future<size_t> migrateAsync();
+
+    StorageBackend& hotTier() { return *hot; }
+    StorageBackend& coldTier() { return *cold; }
+
+private:
+    /// One entry per name, oldest first; hot entries win
+    static std::vector<BackupMetadata> merge(std::vector<BackupMetadata> coldBackups,
+                                             std::vector<BackupMetadata> hotBackups);
+
+    std::unique_ptr<StorageBackend> hot;
+    std::unique_ptr<StorageBackend> cold;
+    size_t hotCount;
+    std::mutex migrationMutex;  // One pass at a time
+    // Last, so it is joined before the tiers go away
+    dbbackup::ThreadPool migrator{1};
+};
+
+/// Tiers storage.localPath over storage.tiering.archivePath, null if
+/// storage.tiering.hotBackups is 0
+std::unique_ptr<TieredStorage> createTieredStorage(const dbbackup::StorageConfig& config);
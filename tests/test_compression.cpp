@@ -1,10 +1,16 @@
 #include <gtest/gtest.h>
 #include "../include/compression.hpp"
+#include "../include/codec_registry.hpp"
+#include "../include/codec_selector.hpp"
+#include "../include/block_archive.hpp"
+#include "../include/checksum.hpp"
+#include "../src/compression.hpp"
 #include "../include/config.hpp"
 #include "../include/error/DatabaseBackupError.hpp"
 #include <filesystem>
 #include <fstream>
 #include <random>
+#include <zlib.h>
 #include <vector>
 
 using namespace dbbackup;
@@ -51,6 +57,31 @@ void createRandomFile(const std::string& path, size_t size) {
     file.write(data.data(), data.size());
 }
 
+// Helper function to create a small per-table dump in mysqldump style
+std::string createTableDump(int table) {
+    std::string name = "table_" + std::to_string(table);
+    std::string dump =
+        "-- MySQL dump 10.13  Distrib 8.0.36, for Linux (x86_64)\n"
+        "/*!40101 SET @OLD_CHARACTER_SET_CLIENT=@@CHARACTER_SET_CLIENT */;\n"
+        "/*!40101 SET NAMES utf8mb4 */;\n"
+        "/*!40014 SET @OLD_FOREIGN_KEY_CHECKS=@@FOREIGN_KEY_CHECKS, FOREIGN_KEY_CHECKS=0 */;\n"
+        "DROP TABLE IF EXISTS `" + name + "`;\n"
+        "CREATE TABLE `" + name + "` (\n"
+        "  `id` int NOT NULL AUTO_INCREMENT,\n"
+        "  `created_at` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP,\n"
+        "  `status` varchar(32) NOT NULL,\n"
+        "  PRIMARY KEY (`id`)\n"
+        ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_0900_ai_ci;\n"
+        "LOCK TABLES `" + name + "` WRITE;\n"
+        "INSERT INTO `" + name + "` VALUES ";
+    for (int row = 0; row < 3; row++) {
+        dump += "(" + std::to_string(table * 7 + row) + ",'2024-0" + std::to_string(row + 1) +
+                "-1" + std::to_string(table % 10) + " 12:00:00','active'),";
+    }
+    dump += "(0,'2024-01-01 00:00:00','deleted');\nUNLOCK TABLES;\n";
+    return dump;
+}
+
 class CompressionTest : public ::testing::Test {
 protected:
     void SetUp() override {
@@ -220,4 +251,820 @@ TEST_F(CompressionTest, EstimateCompressedSize) {
     // For compressible data, actual size can be much smaller than estimated
     size_t actualPatternSize = fs::file_size(patternCompressedPath);
     EXPECT_LT(actualPatternSize, estimatedSize);  // Should compress better than estimated
-} 
\ No newline at end of file
+} 
+TEST_F(CompressionTest, StreamingEncoderMatchesFileCompression) {
+    fs::path inputPath = testDir / "input.txt";
+    fs::path streamedPath = testDir / "streamed.gz";
+    fs::path decompressedPath = testDir / "decompressed.txt";
+
+    createTestFile(inputPath.string(), 1024 * 1024);
+    auto originalContent = readFileContent(inputPath.string());
+
+    CompressionConfig config;
+    config.enabled = true;
+    config.format = "gzip";
+    config.level = "medium";
+
+    Compressor compressor(config);
+
+    // Feed the encoder in uneven pieces, as a dump pipe would
+    {
+        FileSink file(streamedPath.string());
+        ASSERT_TRUE(static_cast<bool>(file));
+        auto encoder = compressor.createEncoder(file);
+        size_t offset = 0;
+        size_t piece = 1;
+        while (offset < originalContent.size()) {
+            size_t n = std::min(piece, originalContent.size() - offset);
+            encoder->write(originalContent.data() + offset, n);
+            offset += n;
+            piece = piece * 3 + 7;
+        }
+        encoder->finish();
+    }
+
+    EXPECT_TRUE(compressor.decompressFile(streamedPath.string(), decompressedPath.string()));
+    EXPECT_EQ(originalContent, readFileContent(decompressedPath.string()));
+}
+
+TEST_F(CompressionTest, ParallelGzipRoundTrip) {
+    fs::path inputPath = testDir / "input.txt";
+    fs::path compressedPath = testDir / "parallel.gz";
+    fs::path decompressedPath = testDir / "decompressed.txt";
+
+    // Mix compressible and random data across many blocks, with a ragged tail
+    createTestFile(inputPath.string(), 3 * 1024 * 1024 + 12345);
+    {
+        fs::path randomPath = testDir / "random.bin";
+        createRandomFile(randomPath.string(), 512 * 1024);
+        std::ofstream out(inputPath, std::ios::binary | std::ios::app);
+        auto random = readFileContent(randomPath.string());
+        out.write(random.data(), random.size());
+    }
+
+    CompressionConfig config;
+    config.enabled = true;
+    config.format = "gzip";
+    config.level = "medium";
+    config.threads = 4;
+
+    Compressor compressor(config);
+    EXPECT_TRUE(compressor.compressFile(inputPath.string(), compressedPath.string()));
+    EXPECT_LT(fs::file_size(compressedPath), fs::file_size(inputPath));
+
+    // A single gzip member, readable by the sequential decoder
+    EXPECT_TRUE(compressor.decompressFile(compressedPath.string(), decompressedPath.string()));
+    EXPECT_EQ(readFileContent(inputPath.string()), readFileContent(decompressedPath.string()));
+}
+
+TEST_F(CompressionTest, ParallelGzipEmptyInput) {
+    fs::path inputPath = testDir / "empty.txt";
+    fs::path compressedPath = testDir / "empty.gz";
+    fs::path decompressedPath = testDir / "empty.out";
+    std::ofstream(inputPath.string()).close();
+
+    CompressionConfig config;
+    config.enabled = true;
+    config.threads = 2;
+
+    Compressor compressor(config);
+    EXPECT_TRUE(compressor.compressFile(inputPath.string(), compressedPath.string()));
+    EXPECT_TRUE(compressor.decompressFile(compressedPath.string(), decompressedPath.string()));
+    EXPECT_EQ(fs::file_size(decompressedPath), 0u);
+}
+
+TEST_F(CompressionTest, XzRoundTrip) {
+    fs::path inputPath = testDir / "input.txt";
+    fs::path compressedPath = testDir / "compressed.xz";
+    fs::path decompressedPath = testDir / "decompressed.txt";
+
+    createTestFile(inputPath.string(), 2 * 1024 * 1024);
+
+    CompressionConfig config;
+    config.enabled = true;
+    config.format = "xz";
+    config.level = "low";
+
+    Compressor compressor(config);
+    EXPECT_EQ(compressor.getFileExtension(), ".xz");
+    EXPECT_TRUE(compressor.compressFile(inputPath.string(), compressedPath.string()));
+    EXPECT_LT(fs::file_size(compressedPath), fs::file_size(inputPath));
+
+    EXPECT_TRUE(compressor.decompressFile(compressedPath.string(), decompressedPath.string()));
+    EXPECT_EQ(readFileContent(inputPath.string()), readFileContent(decompressedPath.string()));
+}
+
+TEST_F(CompressionTest, XzMultithreadedRoundTrip) {
+    fs::path inputPath = testDir / "input.txt";
+    fs::path compressedPath = testDir / "compressed.xz";
+    fs::path decompressedPath = testDir / "decompressed.txt";
+
+    // Larger than the low preset's block size so several blocks are produced
+    createRandomFile(inputPath.string(), 5 * 1024 * 1024);
+
+    CompressionConfig config;
+    config.enabled = true;
+    config.format = "xz";
+    config.level = "low";
+    config.threads = 2;
+
+    Compressor compressor(config);
+    EXPECT_TRUE(compressor.compressFile(inputPath.string(), compressedPath.string()));
+    EXPECT_TRUE(compressor.decompressFile(compressedPath.string(), decompressedPath.string()));
+    EXPECT_EQ(readFileContent(inputPath.string()), readFileContent(decompressedPath.string()));
+}
+
+TEST_F(CompressionTest, Bzip2RoundTrip) {
+    fs::path inputPath = testDir / "input.txt";
+    fs::path compressedPath = testDir / "compressed.bz2";
+    fs::path decompressedPath = testDir / "decompressed.txt";
+
+    createTestFile(inputPath.string(), 1024 * 1024);
+
+    CompressionConfig config;
+    config.enabled = true;
+    config.format = "bzip2";
+    config.level = "medium";
+
+    Compressor compressor(config);
+    EXPECT_EQ(compressor.getFileExtension(), ".bz2");
+    EXPECT_TRUE(compressor.compressFile(inputPath.string(), compressedPath.string()));
+    EXPECT_LT(fs::file_size(compressedPath), fs::file_size(inputPath));
+
+    EXPECT_TRUE(compressor.decompressFile(compressedPath.string(), decompressedPath.string()));
+    EXPECT_EQ(readFileContent(inputPath.string()), readFileContent(decompressedPath.string()));
+}
+
+TEST_F(CompressionTest, DecompressRejectsTruncatedInput) {
+    fs::path inputPath = testDir / "input.txt";
+    fs::path compressedPath = testDir / "compressed.xz";
+    fs::path decompressedPath = testDir / "decompressed.txt";
+
+    createTestFile(inputPath.string(), 256 * 1024);
+
+    CompressionConfig config;
+    config.enabled = true;
+    config.format = "xz";
+    config.level = "low";
+
+    Compressor compressor(config);
+    ASSERT_TRUE(compressor.compressFile(inputPath.string(), compressedPath.string()));
+    fs::resize_file(compressedPath, fs::file_size(compressedPath) / 2);
+
+    EXPECT_THROW(compressor.decompressFile(compressedPath.string(), decompressedPath.string()), CompressionError);
+}
+
+TEST_F(CompressionTest, RegistryDetectsEveryCodecFromItsOutput) {
+    fs::path inputPath = testDir / "input.txt";
+    createTestFile(inputPath.string(), 64 * 1024);
+
+    auto& registry = CodecRegistry::getInstance();
+    for (const auto& name : registry.names()) {
+        CompressionConfig config;
+        config.enabled = true;
+        config.format = name;
+        config.level = "low";
+
+        Compressor compressor(config);
+        fs::path compressedPath = testDir / ("compressed" + compressor.getFileExtension());
+        ASSERT_TRUE(compressor.compressFile(inputPath.string(), compressedPath.string()));
+
+        auto detected = registry.detectFile(compressedPath.string());
+        ASSERT_NE(detected, nullptr) << name;
+        EXPECT_EQ(detected->name(), name);
+        EXPECT_EQ(registry.findByExtension(compressedPath.string())->name(), name);
+
+        // The free function picks the decoder from the file contents alone
+        fs::path decompressedPath = testDir / ("decompressed_" + name);
+        EXPECT_TRUE(decompressFile(compressedPath.string(), decompressedPath.string()));
+        EXPECT_EQ(readFileContent(inputPath.string()), readFileContent(decompressedPath.string()));
+    }
+
+    EXPECT_EQ(registry.detectFile(inputPath.string()), nullptr);
+    EXPECT_EQ(registry.findByExtension(inputPath.string()), nullptr);
+}
+
+namespace {
+    /// Pass-through codec used to check that registered codecs are picked up
+    class IdentityCodec : public Codec {
+    public:
+        class Passthrough : public OutputSink {
+        public:
+            explicit Passthrough(OutputSink& downstream) : downstream(downstream) {}
+            void write(const char* data, size_t size) override { downstream.write(data, size); }
+            void finish() override { downstream.finish(); }
+        private:
+            OutputSink& downstream;
+        };
+
+        std::string name() const override { return "identity-test"; }
+        std::string extension() const override { return ".id"; }
+        bool matchesHeader(const unsigned char*, size_t) const override { return false; }
+        std::unique_ptr<OutputSink> createEncoder(OutputSink& downstream, const CodecOptions&) const override {
+            return std::make_unique<Passthrough>(downstream);
+        }
+        std::unique_ptr<OutputSink> createDecoder(OutputSink& downstream) const override {
+            return std::make_unique<Passthrough>(downstream);
+        }
+    };
+}
+
+TEST_F(CompressionTest, RegisteredCodecIsUsedByCompressor) {
+    CodecRegistry::getInstance().registerCodec(std::make_shared<IdentityCodec>());
+
+    fs::path inputPath = testDir / "input.txt";
+    fs::path outputPath = testDir / "output.id";
+    createTestFile(inputPath.string(), 1024);
+
+    CompressionConfig config;
+    config.enabled = true;
+    config.format = "identity-test";
+    config.level = "medium";
+
+    Compressor compressor(config);
+    EXPECT_EQ(compressor.getFileExtension(), ".id");
+    EXPECT_TRUE(compressor.compressFile(inputPath.string(), outputPath.string()));
+    EXPECT_EQ(readFileContent(inputPath.string()), readFileContent(outputPath.string()));
+}
+
+TEST_F(CompressionTest, AutoSelectionRoundTrip) {
+    fs::path inputPath = testDir / "input.txt";
+    createTestFile(inputPath.string(), 3 * 1024 * 1024);
+    auto content = readFileContent(inputPath.string());
+    std::string input(content.begin(), content.end());
+
+    CompressionConfig config;
+    config.enabled = true;
+    config.format = "auto";
+    config.sampleSizeMB = 1;
+    config.targetThroughputMBps = 1.0;
+
+    StringSink compressed;
+    AutoSelectingEncoder encoder(compressed, config);
+    // Uneven writes so the sample boundary falls inside a write
+    for (size_t offset = 0; offset < input.size(); offset += 300000) {
+        encoder.write(input.data() + offset, std::min<size_t>(300000, input.size() - offset));
+    }
+    encoder.finish();
+
+    ASSERT_TRUE(encoder.choice().has_value());
+    const CodecTrial& choice = *encoder.choice();
+    EXPECT_LT(choice.ratio, 0.5);
+    EXPECT_GE(choice.throughputMBps, config.targetThroughputMBps);
+
+    auto detected = CodecRegistry::getInstance().detect(
+        reinterpret_cast<const unsigned char*>(compressed.str().data()), compressed.str().size());
+    ASSERT_NE(detected, nullptr);
+    EXPECT_EQ(detected->name(), choice.codec->name());
+
+    StringSink decompressed;
+    auto decoder = choice.codec->createDecoder(decompressed);
+    decoder->write(compressed.str().data(), compressed.str().size());
+    decoder->finish();
+    EXPECT_EQ(decompressed.str(), input);
+}
+
+TEST_F(CompressionTest, AutoSelectionShortStream) {
+    CompressionConfig config;
+    config.format = "auto";
+    config.sampleSizeMB = 4;
+
+    // The whole stream fits in the sample, selection happens on finish
+    std::string input(1000, 'x');
+    StringSink compressed;
+    AutoSelectingEncoder encoder(compressed, config);
+    encoder.write(input.data(), input.size());
+    EXPECT_FALSE(encoder.choice().has_value());
+    encoder.finish();
+    ASSERT_TRUE(encoder.choice().has_value());
+
+    StringSink decompressed;
+    auto decoder = encoder.choice()->codec->createDecoder(decompressed);
+    decoder->write(compressed.str().data(), compressed.str().size());
+    decoder->finish();
+    EXPECT_EQ(decompressed.str(), input);
+}
+
+TEST_F(CompressionTest, AutoSelectionFallsBackToFastestCodec) {
+    fs::path inputPath = testDir / "input.bin";
+    createRandomFile(inputPath.string(), 512 * 1024);
+    auto input = readFileContent(inputPath.string());
+
+    CompressionConfig config;
+    config.targetThroughputMBps = 1e9;  // Unreachable
+
+    CodecSelector selector(config);
+    auto trials = selector.evaluate(input.data(), input.size());
+    ASSERT_FALSE(trials.empty());
+    // Every codec stops after its first, fastest level when the target is missed
+    for (const auto& trial : trials) {
+        EXPECT_EQ(trial.level, CompressionLevel::Low);
+    }
+
+    CodecTrial choice = selector.select(input.data(), input.size());
+    EXPECT_GE(choice.ratio, 0.99);  // Random data does not compress
+
+    // Without a sample, as for deduplicated chunks, the cheapest candidate
+    ASSERT_TRUE(selector.fastest());
+    EXPECT_EQ(selector.fastest()->name(), trials.front().codec->name());
+}
+
+TEST_F(CompressionTest, BlockFramedStoresIncompressibleBlocksRaw) {
+    fs::path textPath = testDir / "text.txt";
+    fs::path randomPath = testDir / "random.bin";
+    fs::path inputPath = testDir / "input.bin";
+    fs::path compressedPath = testDir / "compressed.hgb";
+    fs::path decompressedPath = testDir / "decompressed.bin";
+
+    // Half text, half random bytes, in block-sized runs
+    createTestFile(textPath.string(), 512 * 1024);
+    createRandomFile(randomPath.string(), 512 * 1024);
+    {
+        auto text = readFileContent(textPath.string());
+        auto random = readFileContent(randomPath.string());
+        std::ofstream out(inputPath, std::ios::binary);
+        out.write(text.data(), text.size());
+        out.write(random.data(), random.size());
+    }
+
+    CompressionConfig config;
+    config.enabled = true;
+    config.format = "gzip";
+    config.level = "medium";
+    config.blockFramed = true;
+    config.blockSizeKB = 64;
+
+    Compressor compressor(config);
+    EXPECT_EQ(compressor.getFileExtension(), ".hgb");
+    EXPECT_TRUE(compressor.compressFile(inputPath.string(), compressedPath.string()));
+
+    // Random blocks cost only their 13-byte headers on top of the raw bytes
+    size_t randomBlocks = 512 / 64;
+    EXPECT_LT(fs::file_size(compressedPath), 512 * 1024 + randomBlocks * 13 + 64 * 1024);
+
+    EXPECT_EQ(CodecRegistry::getInstance().detectFile(compressedPath.string())->name(), "framed");
+    EXPECT_TRUE(decompressFile(compressedPath.string(), decompressedPath.string()));
+    EXPECT_EQ(readFileContent(inputPath.string()), readFileContent(decompressedPath.string()));
+}
+
+TEST_F(CompressionTest, BlockFramedMultithreadedRoundTrip) {
+    fs::path inputPath = testDir / "input.txt";
+    fs::path compressedPath = testDir / "compressed.hgb";
+    fs::path decompressedPath = testDir / "decompressed.txt";
+
+    createTestFile(inputPath.string(), 3 * 1024 * 1024 + 123);
+
+    CompressionConfig config;
+    config.enabled = true;
+    config.format = "xz";
+    config.level = "low";
+    config.threads = 3;
+    config.blockFramed = true;
+    config.blockSizeKB = 256;
+
+    Compressor compressor(config);
+    EXPECT_TRUE(compressor.compressFile(inputPath.string(), compressedPath.string()));
+    EXPECT_LT(fs::file_size(compressedPath), fs::file_size(inputPath) / 10);
+    EXPECT_TRUE(compressor.decompressFile(compressedPath.string(), decompressedPath.string()));
+    EXPECT_EQ(readFileContent(inputPath.string()), readFileContent(decompressedPath.string()));
+}
+
+TEST_F(CompressionTest, BlockFramedDetectsCorruption) {
+    fs::path inputPath = testDir / "input.bin";
+    fs::path compressedPath = testDir / "compressed.hgb";
+    fs::path decompressedPath = testDir / "decompressed.bin";
+
+    createRandomFile(inputPath.string(), 200 * 1024);
+
+    CompressionConfig config;
+    config.enabled = true;
+    config.format = "gzip";
+    config.blockFramed = true;
+    config.blockSizeKB = 64;
+
+    Compressor compressor(config);
+    ASSERT_TRUE(compressor.compressFile(inputPath.string(), compressedPath.string()));
+
+    // Flip a byte inside the second (raw) block's payload
+    {
+        std::fstream file(compressedPath, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(100 * 1024);
+        char c = 0;
+        file.read(&c, 1);
+        file.seekp(100 * 1024);
+        c = static_cast<char>(c ^ 0xff);
+        file.write(&c, 1);
+    }
+    EXPECT_THROW(compressor.decompressFile(compressedPath.string(), decompressedPath.string()), CompressionError);
+
+    // Truncation loses the end marker
+    fs::resize_file(compressedPath, 70 * 1024);
+    EXPECT_THROW(compressor.decompressFile(compressedPath.string(), decompressedPath.string()), CompressionError);
+}
+
+TEST_F(CompressionTest, BlockFramedParallelDecode) {
+    fs::path inputPath = testDir / "input.txt";
+    fs::path compressedPath = testDir / "compressed.hgb";
+    fs::path decompressedPath = testDir / "decompressed.txt";
+
+    createTestFile(inputPath.string(), 2 * 1024 * 1024 + 77);
+
+    CompressionConfig config;
+    config.enabled = true;
+    config.format = "gzip";
+    config.blockFramed = true;
+    config.blockSizeKB = 64;
+
+    // Written single-threaded, restored with more threads than blocks in
+    // flight; decoding does not depend on the compression thread count
+    Compressor writer(config);
+    ASSERT_TRUE(writer.compressFile(inputPath.string(), compressedPath.string()));
+
+    config.decodeThreads = 4;
+    Compressor reader(config);
+    EXPECT_TRUE(reader.decompressFile(compressedPath.string(), decompressedPath.string()));
+    EXPECT_EQ(readFileContent(inputPath.string()), readFileContent(decompressedPath.string()));
+
+    // A damaged block late in the stream still fails the parallel restore
+    {
+        std::fstream file(compressedPath, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekg(0, std::ios::end);
+        std::streamoff target = file.tellg() / 2;
+        char c = 0;
+        file.seekg(target);
+        file.read(&c, 1);
+        c = static_cast<char>(c ^ 0xff);
+        file.seekp(target);
+        file.write(&c, 1);
+    }
+    EXPECT_THROW(reader.decompressFile(compressedPath.string(), decompressedPath.string()), CompressionError);
+}
+
+TEST_F(CompressionTest, BlockArchiveRangeReads) {
+    fs::path inputPath = testDir / "input.bin";
+    fs::path compressedPath = testDir / "compressed.hgb";
+
+    createTestFile(inputPath.string(), 700 * 1024 + 17);
+    auto input = readFileContent(inputPath.string());
+
+    CompressionConfig config;
+    config.enabled = true;
+    config.format = "gzip";
+    config.blockFramed = true;
+    config.blockSizeKB = 64;
+
+    Compressor compressor(config);
+    ASSERT_TRUE(compressor.compressFile(inputPath.string(), compressedPath.string()));
+
+    BlockArchiveReader reader(compressedPath.string());
+    EXPECT_EQ(reader.size(), input.size());
+    EXPECT_EQ(reader.blocks().size(), 11u);
+    EXPECT_EQ(reader.codecName(), "gzip");
+
+    // Ranges inside one block, across blocks, at the end and past it
+    const std::pair<uint64_t, uint64_t> ranges[] = {
+        {0, 10}, {65530, 20}, {100000, 300000}, {input.size() - 5, 100}, {0, input.size()}
+    };
+    for (const auto& range : ranges) {
+        StringSink out;
+        uint64_t written = reader.readRange(range.first, range.second, out);
+        uint64_t expected = std::min<uint64_t>(range.second, input.size() - range.first);
+        EXPECT_EQ(written, expected);
+        EXPECT_EQ(out.str(), std::string(input.data() + range.first, expected));
+    }
+
+    StringSink past;
+    EXPECT_EQ(reader.readRange(input.size(), 10, past), 0u);
+}
+
+TEST_F(CompressionTest, BlockArchiveRejectsDamagedIndex) {
+    fs::path inputPath = testDir / "input.bin";
+    fs::path compressedPath = testDir / "compressed.hgb";
+    fs::path decompressedPath = testDir / "decompressed.bin";
+
+    createTestFile(inputPath.string(), 300 * 1024);
+
+    CompressionConfig config;
+    config.enabled = true;
+    config.format = "gzip";
+    config.blockFramed = true;
+    config.blockSizeKB = 64;
+
+    Compressor compressor(config);
+    ASSERT_TRUE(compressor.compressFile(inputPath.string(), compressedPath.string()));
+
+    // Damage the first index entry (just before the 5 entries and the footer)
+    uint64_t entryOffset = fs::file_size(compressedPath) - 28 - 5 * 24;
+    {
+        std::fstream file(compressedPath, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(static_cast<std::streamoff>(entryOffset));
+        file.put('\x7f');
+    }
+    EXPECT_THROW(BlockArchiveReader reader(compressedPath.string()), CompressionError);
+    EXPECT_THROW(compressor.decompressFile(compressedPath.string(), decompressedPath.string()), CompressionError);
+}
+
+#ifdef USE_ZSTD
+TEST_F(CompressionTest, ZstdRoundTrip) {
+    fs::path inputPath = testDir / "input.txt";
+    fs::path compressedPath = testDir / "compressed.zst";
+    fs::path decompressedPath = testDir / "decompressed.txt";
+
+    createTestFile(inputPath.string(), 2 * 1024 * 1024);
+
+    CompressionConfig config;
+    config.enabled = true;
+    config.format = "zstd";
+    config.level = "medium";
+
+    Compressor compressor(config);
+    EXPECT_EQ(compressor.getFileExtension(), ".zst");
+    EXPECT_TRUE(compressor.compressFile(inputPath.string(), compressedPath.string()));
+    EXPECT_LT(fs::file_size(compressedPath), fs::file_size(inputPath));
+
+    EXPECT_TRUE(compressor.decompressFile(compressedPath.string(), decompressedPath.string()));
+    EXPECT_EQ(readFileContent(inputPath.string()), readFileContent(decompressedPath.string()));
+}
+
+TEST_F(CompressionTest, ZstdRejectsEmptyInput) {
+    fs::path emptyPath = testDir / "empty.zst";
+    fs::path decompressedPath = testDir / "decompressed.txt";
+
+    CompressionConfig config;
+    config.enabled = true;
+    config.format = "zstd";
+    config.level = "low";
+
+    // No input at all is not an empty frame
+    Compressor compressor(config);
+    std::ofstream(emptyPath, std::ios::binary).close();
+    EXPECT_THROW(compressor.decompressFile(emptyPath.string(), decompressedPath.string()), CompressionError);
+
+    // While an empty dump still round trips
+    fs::path emptyInputPath = testDir / "empty.txt";
+    std::ofstream(emptyInputPath, std::ios::binary).close();
+    ASSERT_TRUE(compressor.compressFile(emptyInputPath.string(), emptyPath.string()));
+    EXPECT_TRUE(compressor.decompressFile(emptyPath.string(), decompressedPath.string()));
+    EXPECT_EQ(fs::file_size(decompressedPath), 0u);
+}
+
+TEST_F(CompressionTest, ZstdLongDistanceMultithreaded) {
+    fs::path inputPath = testDir / "input.txt";
+    fs::path compressedPath = testDir / "compressed.zst";
+    fs::path decompressedPath = testDir / "decompressed.txt";
+
+    createRandomFile(inputPath.string(), 1024 * 1024);
+    {
+        // Repeat the random block far apart so only a long window finds it
+        auto block = readFileContent(inputPath.string());
+        std::ofstream out(inputPath, std::ios::binary | std::ios::app);
+        out.write(block.data(), block.size());
+    }
+
+    CompressionConfig config;
+    config.enabled = true;
+    config.format = "zstd";
+    config.level = "low";
+    config.threads = 2;
+    config.longDistance = true;
+
+    Compressor compressor(config);
+    EXPECT_TRUE(compressor.compressFile(inputPath.string(), compressedPath.string()));
+    EXPECT_TRUE(compressor.decompressFile(compressedPath.string(), decompressedPath.string()));
+    EXPECT_EQ(readFileContent(inputPath.string()), readFileContent(decompressedPath.string()));
+}
+#endif
+
+TEST_F(CompressionTest, DictionaryCompressionOfSmallTableDumps) {
+    std::vector<std::string> samples;
+    for (int table = 0; table < 200; table++) {
+        samples.push_back(createTableDump(table));
+    }
+
+    for (const char* format : {"zstd"}) {
+        if (!CodecRegistry::getInstance().findByName(format)) {
+            continue;
+        }
+        SCOPED_TRACE(format);
+
+        CompressionConfig config;
+        config.enabled = true;
+        config.format = format;
+        Compressor plain(config);
+        Compressor primed(config);
+        auto dictionary = std::make_shared<const std::string>(primed.trainDictionary(samples));
+        ASSERT_FALSE(dictionary->empty());
+        primed.setDictionary(dictionary);
+
+        size_t plainSize = 0;
+        size_t primedSize = 0;
+        for (int table = 1000; table < 1050; table++) {
+            std::string dump = createTableDump(table);
+
+            StringSink plainOut;
+            auto plainEncoder = plain.createEncoder(plainOut);
+            plainEncoder->write(dump.data(), dump.size());
+            plainEncoder->finish();
+            plainSize += plainOut.str().size();
+
+            StringSink primedOut;
+            auto primedEncoder = primed.createEncoder(primedOut);
+            primedEncoder->write(dump.data(), dump.size());
+            primedEncoder->finish();
+            primedSize += primedOut.str().size();
+
+            StringSink decoded;
+            auto decoder = primed.createDecoder(decoded);
+            decoder->write(primedOut.str().data(), primedOut.str().size());
+            decoder->finish();
+            EXPECT_EQ(dump, decoded.str());
+
+            // Without the dictionary the data cannot be decoded
+            if (table == 1000) {
+                StringSink unprimed;
+                auto unprimedDecoder = plain.createDecoder(unprimed);
+                EXPECT_THROW({
+                    unprimedDecoder->write(primedOut.str().data(), primedOut.str().size());
+                    unprimedDecoder->finish();
+                }, CompressionError);
+            }
+        }
+        EXPECT_LT(primedSize, plainSize / 2);
+    }
+
+    // Codecs without dictionary support reject one, as does plain gzip:
+    // a primed .gz would not decompress with gunzip
+    for (const char* format : {"xz", "gzip"}) {
+        CompressionConfig otherConfig;
+        otherConfig.format = format;
+        Compressor other(otherConfig);
+        EXPECT_THROW(other.setDictionary(std::make_shared<const std::string>("dictionary")), ConfigurationError);
+        EXPECT_THROW(other.trainDictionary(samples), ConfigurationError);
+    }
+}
+
+TEST_F(CompressionTest, BlockFramedDictionaryRoundTrip) {
+    fs::path inputPath = testDir / "input.sql";
+    fs::path compressedPath = testDir / "compressed.hgb";
+    fs::path decompressedPath = testDir / "decompressed.sql";
+
+    std::vector<std::string> samples;
+    {
+        std::ofstream input(inputPath, std::ios::binary);
+        for (int table = 0; table < 400; table++) {
+            std::string dump = createTableDump(table);
+            input << dump;
+            if (table < 100) {
+                samples.push_back(dump);
+            }
+        }
+    }
+
+    CompressionConfig config;
+    config.enabled = true;
+    config.format = "gzip";
+    config.threads = 2;
+    config.blockFramed = true;
+    config.blockSizeKB = 16;
+
+    Compressor compressor(config);
+    auto dictionary = std::make_shared<const std::string>(compressor.trainDictionary(samples));
+    compressor.setDictionary(dictionary);
+    ASSERT_TRUE(compressor.compressFile(inputPath.string(), compressedPath.string()));
+    EXPECT_TRUE(compressor.decompressFile(compressedPath.string(), decompressedPath.string()));
+    EXPECT_EQ(readFileContent(inputPath.string()), readFileContent(decompressedPath.string()));
+
+    BlockArchiveReader reader(compressedPath.string(), dictionary);
+    StringSink range;
+    EXPECT_EQ(reader.readRange(20000, 1000, range), 1000u);
+    std::vector<char> input = readFileContent(inputPath.string());
+    EXPECT_EQ(range.str(), std::string(input.begin() + 20000, input.begin() + 21000));
+}
+
+TEST_F(CompressionTest, DictionarySamplerSpreadsSamplesWithinBudget) {
+    // 256 pieces of 4KB, each filled with its own index
+    std::string data;
+    for (int piece = 0; piece < 256; piece++) {
+        data.append(4096, static_cast<char>(piece));
+    }
+
+    StringSink out;
+    DictionarySampler sampler(out, 64 * 1024);
+    for (size_t offset = 0; offset < data.size(); offset += 1000) {
+        sampler.write(data.data() + offset, std::min<size_t>(1000, data.size() - offset));
+    }
+    sampler.finish();
+    EXPECT_EQ(out.str(), data);
+
+    size_t total = 0;
+    for (const auto& sample : sampler.samples()) {
+        total += sample.size();
+    }
+    EXPECT_LE(total, 64u * 1024);
+    ASSERT_GE(sampler.samples().size(), 8u);
+    EXPECT_EQ(sampler.samples().front()[0], 0);
+    EXPECT_GE(static_cast<unsigned char>(sampler.samples().back()[0]), 200);
+}
+
+TEST_F(CompressionTest, FileSinkAndSourceRoundTrip) {
+    fs::path path = testDir / "io.bin";
+    std::string data;
+    for (size_t i = 0; i < 3 * 4096 + 1234; i++) {
+        data.push_back(static_cast<char>(i * 31 + i / 7));
+    }
+
+    // Odd-sized writes around a one-page buffer, including one larger than it
+    for (bool directIO : {false, true}) {
+        FileIOOptions io;
+        io.bufferSize = 4096;
+        io.directIO = directIO;
+        {
+            FileSink sink(path.string(), io);
+            ASSERT_TRUE(static_cast<bool>(sink));
+            sink.write(data.data(), 100);
+            sink.write(data.data() + 100, 9000);
+            sink.write(data.data() + 9100, data.size() - 9100);
+            sink.finish();
+        }
+        std::vector<char> written = readFileContent(path.string());
+        EXPECT_EQ(std::string(written.begin(), written.end()), data);
+    }
+
+    for (bool mapInput : {false, true}) {
+        FileIOOptions io;
+        io.mapInput = mapInput;
+        FileSource source(path.string(), io);
+        ASSERT_TRUE(static_cast<bool>(source));
+        EXPECT_EQ(source.supportsViews(), mapInput);
+        StringSink copy;
+        EXPECT_EQ(copyStream(source, copy, 1000), data.size());
+        EXPECT_EQ(copy.str(), data);
+    }
+
+    EXPECT_FALSE(static_cast<bool>(FileSource((testDir / "missing.bin").string())));
+}
+
+TEST_F(CompressionTest, SmallBuffersAndDirectIORoundTrip) {
+    fs::path inputPath = testDir / "input.txt";
+    fs::path compressedPath = testDir / "compressed.gz";
+    fs::path decompressedPath = testDir / "decompressed.txt";
+
+    createTestFile(inputPath.string(), 1024 * 1024 + 333);
+
+    CompressionConfig config;
+    config.enabled = true;
+    config.format = "gzip";
+    config.bufferSizeKB = 4;
+    config.directIO = true;
+
+    Compressor compressor(config);
+    EXPECT_EQ(compressor.getIOOptions().bufferSize, 4096u);
+    EXPECT_TRUE(compressor.compressFile(inputPath.string(), compressedPath.string()));
+    EXPECT_TRUE(compressor.decompressFile(compressedPath.string(), decompressedPath.string()));
+    EXPECT_EQ(readFileContent(inputPath.string()), readFileContent(decompressedPath.string()));
+}
+
+TEST_F(CompressionTest, Crc32MatchesZlib) {
+    std::string data(70000, '\0');
+    std::mt19937 gen(12345);
+    for (auto& byte : data) {
+        byte = static_cast<char>(gen());
+    }
+
+    // Every path: short tails, exact folds, unaligned starts, chained calls
+    for (size_t offset : {0, 1, 7}) {
+        for (size_t size : {0, 1, 15, 16, 63, 64, 65, 127, 128, 1000, 4096, 65536 + 13}) {
+            const char* p = data.data() + offset;
+            uint32_t expected = static_cast<uint32_t>(
+                ::crc32(0L, reinterpret_cast<const Bytef*>(p), static_cast<uInt>(size)));
+            EXPECT_EQ(checksum::crc32(p, size), expected) << "offset " << offset << " size " << size;
+
+            size_t half = size / 2;
+            EXPECT_EQ(checksum::crc32(p + half, size - half, checksum::crc32(p, half)), expected);
+        }
+    }
+    EXPECT_EQ(checksum::crc32("123456789", 9), 0xcbf43926u);
+}
+
+TEST_F(CompressionTest, Xxh64MatchesReferenceVectors) {
+    EXPECT_EQ(checksum::xxh64("", 0), 0xef46db3751d8e999ULL);
+    EXPECT_EQ(checksum::xxh64("a", 1), 0xd24ec4f1a98c6e5bULL);
+    EXPECT_EQ(checksum::xxh64("abc", 3), 0x44bc2cf5ad770999ULL);
+    EXPECT_EQ(checksum::xxh64("123456789", 9, 42), 0xa18395713e7331f3ULL);
+
+    std::string data;
+    for (int repeat = 0; repeat < 3; repeat++) {
+        for (int byte = 0; byte < 256; byte++) {
+            data.push_back(static_cast<char>(byte));
+        }
+    }
+    EXPECT_EQ(checksum::xxh64(data.data(), data.size()), 0x8e03c838c596036fULL);
+
+    // Streaming in uneven pieces gives the same digest
+    checksum::Xxh64 state(42);
+    for (size_t offset = 0; offset < data.size(); offset += 37) {
+        state.update(data.data() + offset, std::min<size_t>(37, data.size() - offset));
+    }
+    EXPECT_EQ(state.digest(), 0x5a08dead05df1080ULL);
+    EXPECT_EQ(checksum::toHex(0x5a08dead05df1080ULL), "5a08dead05df1080");
+}
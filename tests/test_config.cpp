@@ -208,3 +208,98 @@ TEST(ConfigTest, EnvironmentVariableSubstitution) {
     unsetenv("DB_PASSWORD");
     unsetenv("NOTIFICATION_URL");
 }
+
+TEST(ConfigTest, DeduplicationWithOffSiteCopyThrows) {
+    std::string tempFile = "temp_dedup_offsite_config.json";
+    {
+        std::ofstream ofs(tempFile);
+        ofs << R"({
+            "database": {
+                "type": "sqlite",
+                "database": "/tmp/test.db"
+            },
+            "storage": {
+                "localPath": "/tmp/backups",
+                "cloudProvider": "filesystem",
+                "cloudPath": "/mnt/offsite",
+                "deduplicate": true
+            },
+            "logging": {
+                "logPath": "/var/log/db_backup",
+                "logLevel": "info"
+            }
+        })";
+    }
+
+    // A manifest uploaded without its chunks could not be restored
+    EXPECT_THROW({
+        Config::fromFile(tempFile);
+    }, ConfigurationError);
+
+    // Clean up
+    remove(tempFile.c_str());
+}
+
+TEST(ConfigTest, UnsupportedCloudProviderThrows) {
+    for (const std::string storage : {
+             R"({"localPath": "/tmp/backups", "cloudProvider": "s3", "cloudPath": "bucket"})",
+             R"({"localPath": "/tmp/backups", "cloudProvider": "filesystem"})"}) {
+        std::string tempFile = "temp_cloud_provider_config.json";
+        {
+            std::ofstream ofs(tempFile);
+            ofs << R"({
+                "database": {
+                    "type": "sqlite",
+                    "database": "/tmp/test.db"
+                },
+                "storage": )" << storage << R"(,
+                "logging": {
+                    "logPath": "/var/log/db_backup",
+                    "logLevel": "info"
+                }
+            })";
+        }
+
+        // Caught at load time, not by the first backup run
+        EXPECT_THROW({
+            Config::fromFile(tempFile);
+        }, ConfigurationError) << storage;
+
+        // Clean up
+        remove(tempFile.c_str());
+    }
+}
+
+TEST(ConfigTest, FramedCompressionFormatThrows) {
+    std::string tempFile = "temp_framed_format_config.json";
+    {
+        std::ofstream ofs(tempFile);
+        ofs << R"({
+            "database": {
+                "type": "sqlite",
+                "database": "/tmp/test.db"
+            },
+            "storage": {
+                "localPath": "/tmp/backups"
+            },
+            "backup": {
+                "compression": {
+                    "enabled": true,
+                    "format": "framed"
+                }
+            },
+            "logging": {
+                "logPath": "/var/log/db_backup",
+                "logLevel": "info"
+            }
+        })";
+    }
+
+    // Containers are configured with blockFramed, not as a format
+    EXPECT_THROW({
+        Config::fromFile(tempFile);
+    }, ConfigurationError);
+
+    // Clean up
+    remove(tempFile.c_str());
+}
@@ -0,0 +1,997 @@
+#include <gtest/gtest.h>
+#include "../src/storage.hpp"
+#include "../include/config.hpp"
+#include "../include/checksum.hpp"
+#include "../include/compression.hpp"
+#include "../src/chunk_store.hpp"
+#include "../src/retention.hpp"
+#include "../src/file_utils.hpp"
+#include "../src/multipart_upload.hpp"
+#include "../src/space_reservation.hpp"
+#include "../src/size_estimator.hpp"
+#include "../src/scrubber.hpp"
+#include "../src/tiered_storage.hpp"
+#include "../include/error/DatabaseBackupError.hpp"
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+class StorageTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        testDir = fs::temp_directory_path() / "storage_test";
+        fs::remove_all(testDir);
+        fs::create_directories(testDir);
+        config.localPath = testDir.string();
+    }
+
+    void TearDown() override {
+        fs::remove_all(testDir);
+    }
+
+    std::string writeBackup(const std::string& name, size_t size) {
+        fs::path path = testDir / name;
+        std::ofstream file(path, std::ios::binary);
+        for (size_t i = 0; i < size; i++) {
+            file.put(static_cast<char>(i * 13));
+        }
+        return path.string();
+    }
+
+    fs::path testDir;
+    dbbackup::StorageConfig config;
+};
+
+TEST_F(StorageTest, RegisteredMetadataRoundTrips) {
+    // Not a multiple of the read size, so the tail must be hashed too
+    std::string path = writeBackup("backup_1.dump.gz", 3 * 1048576 + 4097);
+
+    LocalStorage storage(config);
+    BackupMetadata registered = storage.registerBackup(path, "gzip", "high", "gzip_0123456789abcdef");
+    EXPECT_EQ(registered.checksum.size(), 64u);
+    EXPECT_EQ(registered.fastChecksum.size(), 16u);
+
+    auto backups = storage.listBackups();
+    ASSERT_EQ(backups.size(), 1u);
+    EXPECT_EQ(backups[0].filename, "backup_1.dump.gz");
+    EXPECT_EQ(backups[0].size, registered.size);
+    EXPECT_EQ(backups[0].compression, "gzip");
+    EXPECT_EQ(backups[0].compressionLevel, "high");
+    EXPECT_EQ(backups[0].dictionary, "gzip_0123456789abcdef");
+    EXPECT_EQ(backups[0].checksum, registered.checksum);
+    EXPECT_EQ(backups[0].fastChecksum, registered.fastChecksum);
+}
+
+TEST_F(StorageTest, VerifyDetectsModifiedBackup) {
+    std::string path = writeBackup("backup_2.dump", 100000);
+
+    LocalStorage storage(config);
+    storage.registerBackup(path, "", "");
+    EXPECT_TRUE(storage.verifyBackup("backup_2.dump"));
+    EXPECT_TRUE(storage.verifyBackup("backup_2.dump", true));
+
+    // Same size, one byte flipped in the final partial chunk
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(99999);
+        file.put('x');
+    }
+    EXPECT_FALSE(storage.verifyBackup("backup_2.dump"));
+    EXPECT_FALSE(storage.verifyBackup("backup_2.dump", true));
+    EXPECT_FALSE(storage.verifyBackup("not_catalogued.dump"));
+}
+
+TEST_F(StorageTest, DigestWrittenInlineMatchesStoredFile) {
+    // Digest computed while writing, as a backup does, then registered
+    // without the file being read back
+    fs::path path = testDir / "backup_3.dump.zst";
+    dbbackup::checksum::Digest written;
+    {
+        dbbackup::FileSink file(path.string());
+        dbbackup::checksum::DigestSink digest(file);
+        std::string chunk(65536 + 7, 'q');
+        for (int i = 0; i < 20; i++) {
+            chunk[static_cast<size_t>(i)] = static_cast<char>(i);
+            digest.write(chunk.data(), chunk.size());
+        }
+        digest.finish();
+        written = digest.digest();
+    }
+    EXPECT_EQ(written.size, 20u * (65536 + 7));
+    dbbackup::checksum::Digest reread = dbbackup::checksum::digestFile(path.string());
+    EXPECT_EQ(reread.size, written.size);
+    EXPECT_EQ(reread.sha256, written.sha256);
+    EXPECT_EQ(reread.xxh64, written.xxh64);
+
+    BackupMetadata metadata;
+    metadata.size = written.size;
+    metadata.checksum = written.sha256;
+    metadata.fastChecksum = written.xxh64;
+    metadata.originalSize = 5 * written.size;
+    metadata.compression = "zstd";
+    metadata.compressionLevel = "medium";
+
+    LocalStorage storage(config);
+    storage.registerBackup(path.string(), metadata);
+    auto backups = storage.listBackups();
+    ASSERT_EQ(backups.size(), 1u);
+    EXPECT_EQ(backups[0].originalSize, 5 * written.size);
+    EXPECT_EQ(backups[0].compression, "zstd");
+    EXPECT_TRUE(storage.verifyBackup("backup_3.dump.zst"));
+    EXPECT_TRUE(storage.verifyBackup("backup_3.dump.zst", true));
+
+    // A digest that does not describe the file is refused
+    metadata.size += 1;
+    EXPECT_THROW(storage.registerBackup(path.string(), metadata), dbbackup::error::StorageError);
+}
+
+TEST_F(StorageTest, StoreBackupChecksumsWhileCopying) {
+    std::string path = writeBackup("source.dump", 2 * 1048576 + 3);
+    dbbackup::checksum::Digest expected = dbbackup::checksum::digestFile(path);
+
+    LocalStorage storage(config);
+    BackupMetadata stored = storage.storeBackup(path);
+    EXPECT_EQ(stored.size, expected.size);
+    EXPECT_EQ(stored.checksum, expected.sha256);
+    EXPECT_EQ(stored.fastChecksum, expected.xxh64);
+    EXPECT_TRUE(storage.verifyBackup(stored.filename, true));
+}
+
+namespace {
+    // Text with little repetition at the scale of a chunk, like table data
+    std::string dumpText(size_t lines, uint64_t seed) {
+        std::string out;
+        uint64_t state = seed;
+        for (size_t i = 0; i < lines; i++) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            out += std::to_string(i) + "\tcustomer_" + std::to_string(state >> 40) + "\t" +
+                   std::to_string((state >> 20) % 100000) + "\n";
+        }
+        return out;
+    }
+
+    dbbackup::ChunkStoreStats storeDump(const dbbackup::ChunkStore& store, const std::string& manifestPath,
+                                        const std::string& dump, const dbbackup::Compressor* compressor,
+                                        size_t writeSize) {
+        auto writer = store.createWriter(manifestPath, compressor);
+        for (size_t offset = 0; offset < dump.size(); offset += writeSize) {
+            writer->write(dump.data() + offset, std::min(writeSize, dump.size() - offset));
+        }
+        writer->finish();
+        return writer->stats();
+    }
+
+    std::string restoreDump(const dbbackup::ChunkStore& store, const std::string& manifestPath) {
+        dbbackup::StringSink sink;
+        store.restore(manifestPath, sink, dbbackup::CompressionConfig());
+        return sink.release();
+    }
+}
+
+TEST_F(StorageTest, ChunkBoundariesDoNotDependOnWriteSize) {
+    std::string dump = dumpText(100000, 1);
+    dbbackup::ChunkStore store(config.localPath);
+    storeDump(store, (testDir / "a.dump.chunks").string(), dump, nullptr, 1000);
+    storeDump(store, (testDir / "b.dump.chunks").string(), dump, nullptr, 3 * 1048576);
+
+    auto a = dbbackup::ChunkStore::readManifest((testDir / "a.dump.chunks").string());
+    auto b = dbbackup::ChunkStore::readManifest((testDir / "b.dump.chunks").string());
+    ASSERT_EQ(a.chunks.size(), b.chunks.size());
+    for (size_t i = 0; i < a.chunks.size(); i++) {
+        EXPECT_EQ(a.chunks[i].hash, b.chunks[i].hash);
+        EXPECT_GE(a.chunks[i].size, i + 1 < a.chunks.size() ? dbbackup::FastCdc::DEFAULT_MIN_SIZE : 1);
+        EXPECT_LE(a.chunks[i].size, dbbackup::FastCdc::DEFAULT_MAX_SIZE);
+    }
+    EXPECT_EQ(a.size, dump.size());
+}
+
+TEST_F(StorageTest, ChunkStoreDeduplicatesSimilarDumps) {
+    dbbackup::CompressionConfig compression;
+    compression.enabled = true;
+    compression.format = "gzip";
+    dbbackup::Compressor compressor(compression);
+    dbbackup::ChunkStore store(config.localPath);
+
+    std::string first = dumpText(200000, 2);
+    std::string second = first;
+    second.insert(second.size() / 3, "inserted row\n");
+    second.replace(2 * second.size() / 3, 5000, dumpText(200, 3).substr(0, 5000));
+
+    std::string firstPath = (testDir / "first.dump.chunks").string();
+    std::string secondPath = (testDir / "second.dump.chunks").string();
+    auto firstStats = storeDump(store, firstPath, first, &compressor, 65536);
+    auto secondStats = storeDump(store, secondPath, second, &compressor, 65536);
+    EXPECT_EQ(firstStats.newChunks, firstStats.chunks);
+    EXPECT_LT(firstStats.storedBytes, first.size());
+    // Two local edits touch a handful of chunks
+    EXPECT_LE(secondStats.newChunks, 6u);
+    EXPECT_GT(secondStats.chunks, 20u);
+
+    EXPECT_EQ(restoreDump(store, firstPath), first);
+    EXPECT_EQ(restoreDump(store, secondPath), second);
+
+    // Dropping the first backup only collects the chunks it alone used,
+    // and only once no writer could be about to reference them again
+    fs::remove(firstPath);
+    {
+        auto writer = store.createWriter((testDir / "third.dump.chunks").string(), &compressor);
+        writer->write(first.data(), first.size());
+        EXPECT_EQ(store.collectGarbage(), 0u);
+    }
+    EXPECT_GT(store.collectGarbage(), 0u);
+    EXPECT_EQ(restoreDump(store, secondPath), second);
+
+    // A damaged chunk is detected rather than restored
+    auto manifest = dbbackup::ChunkStore::readManifest(secondPath);
+    for (const auto& entry : fs::recursive_directory_iterator(testDir / "chunks")) {
+        if (entry.path().filename().string().rfind(manifest.chunks[0].hash, 0) == 0) {
+            std::ofstream(entry.path(), std::ios::binary) << "garbage";
+        }
+    }
+    EXPECT_THROW(restoreDump(store, secondPath), dbbackup::error::StorageError);
+}
+
+TEST_F(StorageTest, CatalogIndexesAndSurvivesReopening) {
+    fs::path metadataDir = testDir / "metadata";
+    {
+        BackupCatalog catalog(metadataDir.string());
+        for (int day = 1; day <= 9; day++) {
+            BackupMetadata m;
+            m.timestamp = "2024010" + std::to_string(day) + "_020000";
+            m.filename = "backup_" + m.timestamp + (day % 7 == 0 ? "_full" : "_incremental") + ".dump.zst";
+            m.size = static_cast<size_t>(day);
+            catalog.add(m);
+        }
+        EXPECT_TRUE(catalog.remove("backup_20240102_020000_incremental.dump.zst"));
+        EXPECT_FALSE(catalog.remove("backup_20240102_020000_incremental.dump.zst"));
+    }
+
+    // A second instance, as another process would, sees the same state
+    BackupCatalog catalog(metadataDir.string());
+    EXPECT_EQ(catalog.list().size(), 8u);
+    auto found = catalog.find("backup_20240105_020000_incremental.dump.zst");
+    ASSERT_TRUE(found.has_value());
+    EXPECT_EQ(found->size, 5u);
+    EXPECT_FALSE(catalog.find("backup_20240102_020000_incremental.dump.zst").has_value());
+
+    auto range = catalog.listBetween("20240103_000000", "20240106_235959");
+    ASSERT_EQ(range.size(), 4u);
+    EXPECT_EQ(range.front().timestamp, "20240103_020000");
+    EXPECT_EQ(range.back().timestamp, "20240106_020000");
+
+    auto full = catalog.listByType("full");
+    ASSERT_EQ(full.size(), 1u);
+    EXPECT_EQ(full[0].timestamp, "20240107_020000");
+
+    // Appends from another instance are picked up
+    BackupCatalog writer(metadataDir.string());
+    BackupMetadata late;
+    late.filename = "backup_20240110_020000_full.dump.zst";
+    late.timestamp = "20240110_020000";
+    writer.add(late);
+    EXPECT_EQ(catalog.listByType("full").size(), 2u);
+
+    // Compaction keeps live entries only and is picked up too
+    writer.compact();
+    std::ifstream log(metadataDir / "catalog.jsonl");
+    size_t lines = 0;
+    for (std::string line; std::getline(log, line);) {
+        lines++;
+    }
+    EXPECT_EQ(lines, 9u);
+    EXPECT_EQ(catalog.list().size(), 9u);
+}
+
+TEST_F(StorageTest, CatalogIgnoresTornRecord) {
+    fs::path metadataDir = testDir / "metadata";
+    BackupCatalog catalog(metadataDir.string());
+    BackupMetadata m;
+    m.filename = "backup_20240101_020000_full.dump";
+    m.timestamp = "20240101_020000";
+    catalog.add(m);
+
+    // A crash mid-append leaves a partial line without a newline
+    {
+        std::ofstream log(metadataDir / "catalog.jsonl", std::ios::app);
+        log << "{\"op\":\"add\",\"filename\":\"backup_2024";
+    }
+    BackupCatalog reader(metadataDir.string());
+    EXPECT_EQ(reader.list().size(), 1u);
+
+    m.filename = "backup_20240102_020000_full.dump";
+    m.timestamp = "20240102_020000";
+    reader.add(m);
+    EXPECT_EQ(BackupCatalog(metadataDir.string()).list().size(), 2u);
+}
+
+TEST_F(StorageTest, LegacyMetadataIsMigrated) {
+    fs::create_directories(testDir / "metadata");
+    {
+        std::ofstream legacy(testDir / "metadata" / "backups.json");
+        legacy << "[\n  {\n    \"filename\": \"backup_1.dump.gz\",\n    \"timestamp\": \"20240101_010101\",\n"
+                  "    \"size\": 42,\n    \"compression\": \"gzip\",\n    \"compressionLevel\": \"high\",\n"
+                  "    \"checksum\": \"abc\"\n  }\n]\n";
+    }
+
+    LocalStorage storage(config);
+    auto backups = storage.listBackups();
+    ASSERT_EQ(backups.size(), 1u);
+    EXPECT_EQ(backups[0].filename, "backup_1.dump.gz");
+    EXPECT_EQ(backups[0].size, 42u);
+    EXPECT_EQ(backups[0].compression, "gzip");
+    EXPECT_EQ(backups[0].checksum, "abc");
+    EXPECT_FALSE(fs::exists(testDir / "metadata" / "backups.json"));
+    EXPECT_TRUE(fs::exists(testDir / "metadata" / "backups.json.migrated"));
+}
+
+TEST_F(StorageTest, DeleteBackupKeepsOtherEntries) {
+    LocalStorage storage(config);
+    storage.registerBackup(writeBackup("backup_a.dump", 100), "", "");
+    storage.registerBackup(writeBackup("backup_b.dump", 200), "", "");
+    EXPECT_TRUE(storage.deleteBackup("backup_a.dump"));
+
+    auto backups = storage.listBackups();
+    ASSERT_EQ(backups.size(), 1u);
+    EXPECT_EQ(backups[0].filename, "backup_b.dump");
+    EXPECT_TRUE(storage.verifyBackup("backup_b.dump"));
+}
+
+TEST_F(StorageTest, DeleteBackupRemovesEntryOfMissingFile) {
+    LocalStorage storage(config);
+    storage.registerBackup(writeBackup("backup_a.dump", 100), "", "");
+    fs::remove(testDir / "backup_a.dump");
+
+    // A crash after the unlink must not strand the entry
+    EXPECT_TRUE(storage.deleteBackup("backup_a.dump"));
+    EXPECT_TRUE(storage.listBackups().empty());
+
+    // Files that were never catalogued are left alone
+    writeBackup("backup_b.dump", 100);
+    EXPECT_FALSE(storage.deleteBackup("backup_b.dump"));
+    EXPECT_TRUE(fs::exists(testDir / "backup_b.dump"));
+}
+
+namespace {
+    std::chrono::system_clock::time_point localTime(int year, int month, int day, int hour = 2) {
+        std::tm time = {};
+        time.tm_year = year - 1900;
+        time.tm_mon = month - 1;
+        time.tm_mday = day;
+        time.tm_hour = hour;
+        time.tm_isdst = -1;
+        return std::chrono::system_clock::from_time_t(std::mktime(&time));
+    }
+
+    std::string timestampOf(std::chrono::system_clock::time_point point) {
+        std::time_t time = std::chrono::system_clock::to_time_t(point);
+        char buffer[32];
+        std::strftime(buffer, sizeof(buffer), "%Y%m%d_%H%M%S", std::localtime(&time));
+        return buffer;
+    }
+
+    // One backup a day at 02:00 for the given number of days up to end
+    std::vector<BackupMetadata> dailyBackups(std::chrono::system_clock::time_point end, int days) {
+        std::vector<BackupMetadata> backups;
+        for (int i = 0; i < days; i++) {
+            BackupMetadata m;
+            m.timestamp = timestampOf(end - std::chrono::hours(24) * i);
+            m.filename = "backup_" + m.timestamp + "_full.dump";
+            backups.push_back(m);
+        }
+        return backups;
+    }
+}
+
+TEST_F(StorageTest, RetentionAppliesCountAgeAndGfsRules) {
+    auto now = localTime(2024, 6, 30, 12);
+    auto backups = dailyBackups(localTime(2024, 6, 30), 120);
+
+    dbbackup::RetentionConfig countOnly;
+    countOnly.days = 0;
+    countOnly.maxBackups = 10;
+    auto plan = dbbackup::planRetention(backups, countOnly, now);
+    EXPECT_EQ(plan.keep.size(), 10u);
+    EXPECT_EQ(plan.prune.size(), 110u);
+    EXPECT_EQ(plan.keep.front().timestamp, "20240630_020000");
+
+    dbbackup::RetentionConfig ageOnly;
+    ageOnly.days = 7;
+    ageOnly.maxBackups = 0;
+    plan = dbbackup::planRetention(backups, ageOnly, now);
+    EXPECT_EQ(plan.keep.size(), 7u);  // June 24 up to June 30
+    EXPECT_EQ(plan.keep.back().timestamp, "20240624_020000");
+
+    // GFS keeps the newest of each period on top of 7 days: 7 dailies
+    // (within the 7 days anyway), plus the newest of May, April and March
+    dbbackup::RetentionConfig gfs;
+    gfs.days = 7;
+    gfs.maxBackups = 0;
+    gfs.keepDaily = 7;
+    gfs.keepMonthly = 4;
+    plan = dbbackup::planRetention(backups, gfs, now);
+    std::set<std::string> kept;
+    for (const auto& backup : plan.keep) {
+        kept.insert(backup.timestamp.substr(0, 8));
+    }
+    EXPECT_EQ(kept.size(), 10u);
+    EXPECT_TRUE(kept.count("20240531"));
+    EXPECT_TRUE(kept.count("20240430"));
+    EXPECT_TRUE(kept.count("20240331"));
+    EXPECT_FALSE(kept.count("20240301"));
+
+    // The newest backup survives any policy
+    dbbackup::RetentionConfig strict;
+    strict.days = 1;
+    strict.maxBackups = 1;
+    plan = dbbackup::planRetention(dailyBackups(localTime(2024, 1, 1), 3), strict, now);
+    ASSERT_EQ(plan.keep.size(), 1u);
+    EXPECT_EQ(plan.keep[0].timestamp, "20240101_020000");
+}
+
+TEST_F(StorageTest, ApplyRetentionPrunesInOneCatalogUpdate) {
+    LocalStorage storage(config);
+    auto backups = dailyBackups(std::chrono::system_clock::now(), 40);
+    for (const auto& backup : backups) {
+        BackupMetadata m = backup;
+        std::string path = writeBackup(m.filename, 10);
+        m.size = 10;
+        m.checksum = "0";
+        storage.registerBackup(path, m);
+    }
+
+    std::ifstream before(testDir / "metadata" / "catalog.jsonl");
+    size_t linesBefore = static_cast<size_t>(std::count(std::istreambuf_iterator<char>(before),
+                                                        std::istreambuf_iterator<char>(), '\n'));
+
+    dbbackup::RetentionConfig policy;
+    policy.days = 30;
+    policy.maxBackups = 20;
+    EXPECT_EQ(storage.applyRetention(policy), 20u);
+
+    auto remaining = storage.listBackups();
+    ASSERT_EQ(remaining.size(), 20u);
+    for (const auto& backup : backups) {
+        bool listed = std::any_of(remaining.begin(), remaining.end(),
+            [&](const BackupMetadata& m) { return m.filename == backup.filename; });
+        EXPECT_EQ(fs::exists(testDir / backup.filename), listed) << backup.filename;
+    }
+
+    std::ifstream after(testDir / "metadata" / "catalog.jsonl");
+    size_t linesAfter = static_cast<size_t>(std::count(std::istreambuf_iterator<char>(after),
+                                                       std::istreambuf_iterator<char>(), '\n'));
+    EXPECT_EQ(linesAfter, linesBefore + 20);
+}
+
+TEST_F(StorageTest, PlaceFileCopiesOrMovesWithDigest) {
+    std::string source = writeBackup("source.dump", 1048576 + 17);
+    auto expected = dbbackup::checksum::digestFile(source);
+
+    // Copy: reflink, kernel copy or stream depending on the filesystem
+    dbbackup::checksum::Digest copied;
+    auto method = dbbackup::placeFile(source, (testDir / "copy.dump").string(), false, &copied);
+    EXPECT_NE(method, dbbackup::PlaceMethod::Renamed);
+    EXPECT_TRUE(fs::exists(source));
+    EXPECT_EQ(copied.sha256, expected.sha256);
+    EXPECT_EQ(dbbackup::checksum::digestFile((testDir / "copy.dump").string()).sha256, expected.sha256);
+
+    // Move within a filesystem is a rename
+    dbbackup::checksum::Digest moved;
+    method = dbbackup::placeFile(source, (testDir / "moved.dump").string(), true, &moved);
+    EXPECT_EQ(method, dbbackup::PlaceMethod::Renamed);
+    EXPECT_FALSE(fs::exists(source));
+    EXPECT_EQ(moved.xxh64, expected.xxh64);
+    EXPECT_EQ(moved.size, expected.size);
+
+    // A move that has to copy leaves the source for the caller to remove
+    // once the copy is durable
+    std::string other = writeBackup("other.dump", 5000);
+    if (fs::is_directory("/dev/shm") && !dbbackup::sameFilesystem(other, "/dev/shm")) {
+        std::string destination = "/dev/shm/placefile_test.dump";
+        method = dbbackup::placeFile(other, destination, true);
+        EXPECT_NE(method, dbbackup::PlaceMethod::Renamed);
+        EXPECT_TRUE(fs::exists(other));
+        EXPECT_EQ(fs::file_size(destination), 5000u);
+        fs::remove(destination);
+    }
+}
+
+TEST_F(StorageTest, StoreBackupCanMoveTheSource) {
+    std::string path = writeBackup("nightly.dump", 5000);
+    LocalStorage storage(config);
+    BackupMetadata stored = storage.storeBackup(path, true);
+    EXPECT_FALSE(fs::exists(path));
+    EXPECT_TRUE(fs::exists(testDir / stored.filename));
+    EXPECT_TRUE(storage.verifyBackup(stored.filename, true));
+}
+
+namespace {
+    // Fails every upload of the given part number
+    class FailingObjectStore : public dbbackup::FilesystemObjectStore {
+    public:
+        FailingObjectStore(const std::string& root, int failingPart)
+            : FilesystemObjectStore(root), failingPart(failingPart) {}
+
+        dbbackup::UploadedPart uploadPart(const std::string& key, const std::string& uploadId,
+                                          int partNumber, const char* data, size_t size) override {
+            if (partNumber == failingPart) {
+                throw dbbackup::error::StorageError("Injected part failure");
+            }
+            return FilesystemObjectStore::uploadPart(key, uploadId, partNumber, data, size);
+        }
+
+    private:
+        int failingPart;
+    };
+}
+
+TEST_F(StorageTest, MultipartUploadRoundTrips) {
+    std::string source = writeBackup("upload.dump", 1000000);
+    dbbackup::FilesystemObjectStore remote((testDir / "remote").string());
+
+    dbbackup::UploadOptions options;
+    options.partSize = 65536;
+    options.concurrency = 4;
+    dbbackup::MultipartUploader uploader(remote, "nightly/upload.dump", options);
+    dbbackup::FileSource in(source);
+    // Odd write sizes so writes straddle part boundaries
+    const char* data;
+    size_t n;
+    while ((n = in.readView(data, 10007)) > 0) {
+        uploader.write(data, n);
+    }
+    uploader.finish();
+    EXPECT_EQ(uploader.partsUploaded(), 16u);
+
+    EXPECT_TRUE(remote.exists("nightly/upload.dump"));
+    EXPECT_EQ(dbbackup::checksum::digestFile((testDir / "remote" / "nightly" / "upload.dump").string()).sha256,
+              dbbackup::checksum::digestFile(source).sha256);
+    EXPECT_TRUE(fs::is_empty(testDir / "remote" / ".uploads"));
+
+    dbbackup::StringSink copy;
+    remote.getObject("nightly/upload.dump", copy);
+    EXPECT_EQ(copy.str().size(), 1000000u);
+    EXPECT_TRUE(remote.remove("nightly/upload.dump"));
+    EXPECT_FALSE(remote.exists("nightly/upload.dump"));
+    EXPECT_THROW(remote.createMultipartUpload("../escape"), dbbackup::error::StorageError);
+}
+
+TEST_F(StorageTest, FailedPartAbortsUpload) {
+    std::string source = writeBackup("upload.dump", 300000);
+    FailingObjectStore remote((testDir / "remote").string(), 2);
+
+    dbbackup::UploadOptions options;
+    options.partSize = 65536;
+    EXPECT_THROW(dbbackup::uploadFile(remote, source, "upload.dump", options), dbbackup::error::StorageError);
+    EXPECT_FALSE(remote.exists("upload.dump"));
+    EXPECT_TRUE(fs::is_empty(testDir / "remote" / ".uploads"));
+
+    // As the secondary of a tee, the failure is recorded and the archive kept
+    dbbackup::FileSink file((testDir / "local.dump").string());
+    dbbackup::MultipartUploader uploader(remote, "tee.dump", options);
+    dbbackup::TeeSink tee(file, uploader);
+    dbbackup::FileSource in(source);
+    dbbackup::copyStream(in, tee);
+    tee.finish();
+    EXPECT_NE(tee.secondaryError().find("Injected part failure"), std::string::npos);
+    EXPECT_EQ(fs::file_size(testDir / "local.dump"), 300000u);
+    EXPECT_FALSE(remote.exists("tee.dump"));
+}
+
+TEST_F(StorageTest, TokenBucketLimitsRate) {
+    // 1.5MB at 1MB/s shared by 4 threads, starting with an empty bucket
+    dbbackup::TokenBucket bucket(1048576);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([&bucket]() {
+            for (int j = 0; j < 6; j++) {
+                bucket.acquire(65536);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    EXPECT_GE(elapsed, 1.3);
+    EXPECT_LT(elapsed, 5.0);
+}
+
+TEST_F(StorageTest, LocalStoragePutAndOpenStreams) {
+    LocalStorage storage(config);
+    dbbackup::StringSource source(std::string(100000, 'x'));
+    BackupMetadata backup;
+    backup.filename = "backup_20240101_000000_full.dump";
+    backup.timestamp = "20240101_000000";
+    backup.compression = "zstd";
+    BackupMetadata stored = storage.put(backup, source);
+    EXPECT_EQ(stored.size, 100000u);
+    EXPECT_EQ(stored.timestamp, "20240101_000000");
+    EXPECT_TRUE(storage.verifyBackup(backup.filename, true));
+    ASSERT_TRUE(storage.stat(backup.filename));
+    EXPECT_EQ(storage.stat(backup.filename)->compression, "zstd");
+
+    dbbackup::StringSink contents;
+    dbbackup::copyStream(*storage.open(backup.filename), contents);
+    EXPECT_EQ(contents.str(), std::string(100000, 'x'));
+    EXPECT_THROW(storage.open("missing.dump"), dbbackup::error::StorageError);
+}
+
+TEST_F(StorageTest, TieredStorageMovesOlderBackupsToColdTier) {
+    dbbackup::StorageConfig cold = config;
+    cold.localPath = (testDir / "archive").string();
+    config.tiering.hotBackups = 2;
+    config.tiering.archivePath = cold.localPath;
+    auto tiers = createTieredStorage(config);
+    ASSERT_TRUE(tiers);
+    tiers->putDictionary("zstd_0123456789abcdef", "dictionary contents");
+
+    for (int day = 1; day <= 5; day++) {
+        dbbackup::StringSource source("dump of day " + std::to_string(day));
+        BackupMetadata backup;
+        backup.filename = "backup_2024010" + std::to_string(day) + "_000000_full.dump";
+        backup.timestamp = "2024010" + std::to_string(day) + "_000000";
+        if (day == 1) {
+            backup.compression = "zstd";
+            backup.dictionary = "zstd_0123456789abcdef";
+        }
+        tiers->put(backup, source);
+    }
+    tiers->migrateAsync().get();
+
+    auto hot = tiers->hotTier().list();
+    ASSERT_EQ(hot.size(), 2u);
+    EXPECT_EQ(hot[0].timestamp, "20240104_000000");
+    EXPECT_EQ(tiers->coldTier().list().size(), 3u);
+    EXPECT_FALSE(fs::exists(testDir / "backup_20240101_000000_full.dump"));
+    EXPECT_TRUE(fs::exists(testDir / "archive" / "backup_20240101_000000_full.dump"));
+
+    // Reads and listings span both tiers
+    auto all = tiers->list();
+    ASSERT_EQ(all.size(), 5u);
+    EXPECT_EQ(all.front().timestamp, "20240101_000000");
+    dbbackup::StringSink contents;
+    dbbackup::copyStream(*tiers->open("backup_20240101_000000_full.dump"), contents);
+    EXPECT_EQ(contents.str(), "dump of day 1");
+    EXPECT_EQ(recordedCompression(config, "backup_20240101_000000_full.dump"), "zstd");
+    EXPECT_TRUE(tiers->stat("backup_20240102_000000_full.dump"));
+
+    // The dictionary moved with the backup, so it decodes without the hot
+    // tier's metadata
+    fs::remove_all(testDir / "metadata" / "dictionaries");
+    auto dictionary = recordedDictionary(config, "backup_20240101_000000_full.dump");
+    ASSERT_TRUE(dictionary);
+    EXPECT_EQ(*dictionary, "dictionary contents");
+
+    // Retention covers the archive tier too
+    dbbackup::RetentionConfig policy;
+    policy.days = 0;
+    policy.maxBackups = 3;
+    EXPECT_EQ(tiers->applyRetention(policy), 2u);
+    EXPECT_EQ(tiers->coldTier().list().size(), 1u);
+    EXPECT_EQ(tiers->hotTier().list().size(), 2u);
+    EXPECT_FALSE(fs::exists(testDir / "archive" / "backup_20240101_000000_full.dump"));
+    EXPECT_TRUE(fs::exists(testDir / "archive" / "backup_20240103_000000_full.dump"));
+    EXPECT_EQ(tiers->coldTier().removeBackups({"backup_20240104_000000_full.dump"}), 0u);
+    EXPECT_TRUE(fs::exists(testDir / "backup_20240104_000000_full.dump"));
+}
+
+TEST_F(StorageTest, DictionariesAreUploadedOnce) {
+    dbbackup::FilesystemObjectStore store((testDir / "remote").string());
+    std::string key = dbbackup::dictionaryKey("zstd_0123456789abcdef");
+    EXPECT_EQ(key, "dictionaries/zstd_0123456789abcdef.dict");
+    dbbackup::uploadDictionary(store, "zstd_0123456789abcdef", "dictionary contents");
+    dbbackup::uploadDictionary(store, "zstd_0123456789abcdef", "dictionary contents");
+    EXPECT_TRUE(store.exists(key));
+    std::ifstream uploaded(testDir / "remote" / key, std::ios::binary);
+    EXPECT_EQ(std::string(std::istreambuf_iterator<char>(uploaded), {}), "dictionary contents");
+}
+
+TEST_F(StorageTest, CommitsLeaveNoTemporariesAndStaleOnesAreRemoved) {
+    LocalStorage storage(config);
+    storage.storeBackup(writeBackup("nightly.dump", 5000));
+    dbbackup::StringSource source("streamed");
+    BackupMetadata backup;
+    backup.filename = "streamed.dump";
+    storage.put(backup, source);
+    for (const auto& entry : fs::directory_iterator(testDir)) {
+        EXPECT_NE(entry.path().filename().string().rfind(".tmp_", 0), 0u) << entry.path();
+    }
+
+    // Synced data renamed over an existing file replaces it whole
+    std::string tmp = writeBackup(".tmp_replacement", 300);
+    dbbackup::syncFile(tmp);
+    dbbackup::commitFile(tmp, (testDir / "streamed.dump").string());
+    EXPECT_EQ(fs::file_size(testDir / "streamed.dump"), 300u);
+    EXPECT_FALSE(fs::exists(tmp));
+
+    // Only temporaries nobody has written to for a while are crash leftovers
+    std::string stale = writeBackup(".tmp_backup_crashed.partial", 100);
+    std::string live = writeBackup(".tmp_backup_running.partial", 100);
+    fs::last_write_time(stale, fs::file_time_type::clock::now() - std::chrono::hours(48));
+    EXPECT_EQ(storage.removeStaleTemporaries(), 1u);
+    EXPECT_FALSE(fs::exists(stale));
+    EXPECT_TRUE(fs::exists(live));
+}
+
+TEST_F(StorageTest, ReservationPreallocatesAndWriterTrimsToSize) {
+    std::string path = (testDir / ".tmp_reserved.partial").string();
+    {
+        dbbackup::SpaceReservation reservation(path, 4 << 20);
+        EXPECT_EQ(reservation.size(), 4u << 20);
+        if (reservation.preallocated()) {
+            struct stat info;
+            ASSERT_EQ(::stat(path.c_str(), &info), 0);
+            EXPECT_EQ(info.st_size, 4 << 20);
+            EXPECT_GE(static_cast<uint64_t>(info.st_blocks) * 512, 4u << 20);
+        } else {
+            EXPECT_EQ(dbbackup::SpaceReservation::held(path), 4u << 20);
+        }
+
+        dbbackup::FileIOOptions io;
+        io.overwrite = true;
+        dbbackup::FileSink file(path, io);
+        file.write("archive", 7);
+        file.finish();
+    }
+    EXPECT_EQ(fs::file_size(path), 7u);
+    EXPECT_EQ(dbbackup::SpaceReservation::held(path), 0u);
+
+    // Copies into a reserved file keep its blocks and end at the source's size
+    std::string copied = (testDir / ".tmp_copied.partial").string();
+    {
+        dbbackup::SpaceReservation reservation(copied, 1 << 20);
+        std::string source = writeBackup("source.dump", 5000);
+        dbbackup::placeFile(source, copied, false);
+    }
+    EXPECT_EQ(fs::file_size(copied), 5000u);
+    EXPECT_EQ(dbbackup::checksum::digestFile(copied).sha256,
+              dbbackup::checksum::digestFile((testDir / "source.dump").string()).sha256);
+
+    // More than the volume holds fails up front and leaves nothing behind
+    std::string tooBig = (testDir / ".tmp_too_big.partial").string();
+    uint64_t capacity = fs::space(testDir).capacity;
+    EXPECT_THROW(dbbackup::SpaceReservation(tooBig, capacity * 2), dbbackup::error::StorageError);
+    EXPECT_FALSE(fs::exists(tooBig));
+}
+
+TEST_F(StorageTest, StoringACopyOnTheSameFilesystemReservesSpace) {
+    // Sparse, so it takes no room itself but cannot be copied in full
+    std::string source = writeBackup("huge.dump", 0);
+    fs::resize_file(source, fs::space(testDir).capacity * 2);
+
+    // Without a reflink this is a full copy, so it must not start
+    LocalStorage storage(config);
+    EXPECT_THROW(storage.storeBackup(source, false), dbbackup::error::StorageError);
+    EXPECT_TRUE(fs::exists(source));
+    EXPECT_TRUE(storage.listBackups().empty());
+    for (const auto& entry : fs::directory_iterator(testDir)) {
+        EXPECT_NE(entry.path().filename().string().rfind(".tmp_", 0), 0u) << entry.path();
+    }
+}
+
+TEST_F(StorageTest, SizeEstimatorLearnsFromHistory) {
+    std::string database = dbbackup::SizeEstimator::databaseKey("postgresql", "app");
+    std::vector<BackupMetadata> history;
+    for (int day = 1; day <= 5; day++) {
+        BackupMetadata m;
+        m.filename = "backup_2024010" + std::to_string(day) + "_020000_full.dump.zst";
+        m.timestamp = "2024010" + std::to_string(day) + "_020000";
+        m.database = database;
+        m.compression = "zstd";
+        m.compressionLevel = "medium";
+        m.originalSize = 1000000 + day * 100000;
+        m.size = m.originalSize / 5 + (day % 2) * 1000;
+        m.durationSeconds = 10;
+        history.push_back(m);
+    }
+    // Another database and another level teach nothing
+    BackupMetadata other = history.back();
+    other.database = dbbackup::SizeEstimator::databaseKey("postgresql", "other");
+    other.size = other.originalSize;
+    history.push_back(other);
+    other = history.front();
+    other.compressionLevel = "high";
+    other.size = 1;
+    history.push_back(other);
+
+    dbbackup::SizeEstimate estimate = dbbackup::SizeEstimator(history, database, "zstd", "medium").estimate();
+    EXPECT_EQ(estimate.samples, 5u);
+    EXPECT_GT(estimate.inputBytes, 1500000u);   // Grown from the latest dump
+    EXPECT_LT(estimate.inputBytes, 1700000u);
+    EXPECT_NEAR(static_cast<double>(estimate.outputBytes) / estimate.inputBytes, 0.2, 0.01);
+    EXPECT_GE(estimate.outputUpperBound, estimate.outputBytes);
+    EXPECT_LT(estimate.outputUpperBound, estimate.inputBytes / 4);
+    EXPECT_GT(estimate.seconds, 10.0);
+    EXPECT_GE(estimate.secondsUpperBound, estimate.seconds);
+
+    // Without matching history the fallback decides, from a known dump size
+    estimate = dbbackup::SizeEstimator(history, database, "xz", "medium")
+        .estimate(0, [](uint64_t dump) { return dump / 2; });
+    EXPECT_EQ(estimate.samples, 0u);
+    EXPECT_EQ(estimate.outputBytes, estimate.inputBytes / 2);
+    EXPECT_EQ(estimate.outputUpperBound, estimate.outputBytes);
+    EXPECT_EQ(dbbackup::SizeEstimator(history, database, "", "").estimate(1000).outputBytes, 1000u);
+    EXPECT_EQ(dbbackup::SizeEstimator({}, database, "zstd", "medium").estimate().outputBytes, 0u);
+
+    // What the estimate learns from survives the catalog
+    fs::path metadataDir = testDir / "metadata";
+    {
+        BackupCatalog catalog(metadataDir.string());
+        catalog.add(history.front());
+    }
+    BackupCatalog catalog(metadataDir.string());
+    auto found = catalog.find(history.front().filename);
+    ASSERT_TRUE(found.has_value());
+    EXPECT_EQ(found->database, database);
+    EXPECT_DOUBLE_EQ(found->durationSeconds, 10.0);
+}
+
+TEST_F(StorageTest, IdenticalBackupsAreStoredOnce) {
+    LocalStorage storage(config);
+    std::string contents(100000, 'c');
+    for (int day = 1; day <= 3; day++) {
+        dbbackup::StringSource source(day == 2 ? std::string(100000, 'd') : contents);
+        BackupMetadata backup;
+        backup.filename = "backup_2024010" + std::to_string(day) + "_020000_full.dump";
+        backup.timestamp = "2024010" + std::to_string(day) + "_020000";
+        storage.put(backup, source);
+    }
+    fs::path first = testDir / "backup_20240101_020000_full.dump";
+    fs::path changed = testDir / "backup_20240102_020000_full.dump";
+    fs::path third = testDir / "backup_20240103_020000_full.dump";
+    EXPECT_TRUE(fs::equivalent(first, third));
+    EXPECT_FALSE(fs::equivalent(first, changed));
+    EXPECT_EQ(fs::hard_link_count(first), 2u);
+    EXPECT_EQ(storage.getCatalog().listByChecksum(storage.stat(first.filename().string())->checksum).size(), 2u);
+
+    // Pruning the older name leaves the contents to the newer one
+    EXPECT_EQ(storage.cleanOldBackups(2), 1u);
+    EXPECT_FALSE(fs::exists(first));
+    EXPECT_EQ(fs::hard_link_count(third), 1u);
+    EXPECT_TRUE(storage.verifyBackup(third.filename().string(), true));
+
+    // A copy the scrubber found rotten is not shared
+    {
+        std::fstream file(third, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(100);
+        file.put('x');
+    }
+    storage.markVerified(third.filename().string(), false);
+    dbbackup::StringSource source(contents);
+    BackupMetadata backup;
+    backup.filename = "backup_20240104_020000_full.dump";
+    backup.timestamp = "20240104_020000";
+    storage.put(backup, source);
+    EXPECT_FALSE(fs::equivalent(third, testDir / backup.filename));
+    EXPECT_TRUE(storage.verifyBackup(backup.filename, true));
+    for (const auto& entry : fs::directory_iterator(testDir)) {
+        EXPECT_NE(entry.path().filename().string().rfind(".tmp_", 0), 0u) << entry.path();
+    }
+}
+
+TEST_F(StorageTest, ScrubberVerifiesNeverCheckedBackupsFirstAndFindsDamage) {
+    LocalStorage storage(config);
+    std::string dump;
+    for (int i = 0; i < 200000; i++) {
+        dump += static_cast<char>('a' + i % 7);
+    }
+    dbbackup::CompressionConfig gzip;
+    gzip.enabled = true;
+    gzip.format = "gzip";
+    dbbackup::StringSink compressed;
+    dbbackup::Compressor compressor(gzip);
+    auto encoder = compressor.createEncoder(compressed);
+    encoder->write(dump.data(), dump.size());
+    encoder->finish();
+
+    for (int day = 1; day <= 3; day++) {
+        BackupMetadata backup;
+        backup.filename = "backup_2024010" + std::to_string(day) + "_020000_full.dump";
+        backup.timestamp = "2024010" + std::to_string(day) + "_020000";
+        if (day == 2) {
+            backup.filename += ".gz";
+            backup.compression = "gzip";
+            backup.originalSize = dump.size();
+        }
+        dbbackup::StringSource source(day == 2 ? compressed.str() : std::string(50000 + day, 'x'));
+        storage.put(backup, source);
+    }
+
+    dbbackup::ScrubOptions options;
+    options.decompress = true;
+    options.chunkSize = 4096;
+    options.cpuShare = 0.5;
+    std::vector<std::string> damaged;
+    dbbackup::Scrubber scrubber(config, options, [&damaged](const BackupMetadata& backup) {
+        damaged.push_back(backup.filename);
+    });
+    auto due = scrubber.due();
+    ASSERT_EQ(due.size(), 3u);
+    EXPECT_EQ(due.front().filename, "backup_20240101_020000_full.dump");
+
+    // A pause holds the scrub until resumed
+    scrubber.pause();
+    scrubber.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(scrubber.due().size(), 3u);
+    scrubber.resume();
+    for (int i = 0; i < 500 && !scrubber.due().empty(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    scrubber.stop();
+    EXPECT_TRUE(scrubber.due().empty());
+    EXPECT_FALSE(storage.stat("backup_20240102_020000_full.dump.gz")->verifiedAt.empty());
+    EXPECT_TRUE(damaged.empty());
+
+    // With the interval in the past every backup is due again; the damaged
+    // one is reported and recorded
+    {
+        std::fstream file(testDir / "backup_20240103_020000_full.dump",
+                          std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(1000);
+        file.put('y');
+    }
+    options.interval = std::chrono::seconds(-1);
+    dbbackup::Scrubber again(config, options, [&damaged](const BackupMetadata& backup) {
+        damaged.push_back(backup.filename);
+    });
+    dbbackup::ScrubResult result = again.scrubDue();
+    EXPECT_EQ(result.verified, 2u);
+    EXPECT_EQ(result.damaged, 1u);
+    EXPECT_GT(result.bytes, 100000u);
+    ASSERT_EQ(damaged.size(), 1u);
+    EXPECT_EQ(damaged.front(), "backup_20240103_020000_full.dump");
+    EXPECT_TRUE(storage.stat("backup_20240103_020000_full.dump")->damaged);
+    EXPECT_FALSE(storage.stat("backup_20240101_020000_full.dump")->damaged);
+}
+
+TEST_F(StorageTest, ScrubberChecksTheChunksOfDeduplicatedBackups) {
+    dbbackup::ChunkStore store(config.localPath);
+    std::string manifestPath = (testDir / "backup_20240101_020000_full.dump.chunks").string();
+    std::string dump = dumpText(100000, 1);
+    storeDump(store, manifestPath, dump, nullptr, 1048576);
+    LocalStorage storage(config);
+    storage.registerBackup(manifestPath, "", "");
+
+    // The whole dump is read back, not just the manifest
+    dbbackup::ScrubOptions options;
+    options.chunkSize = 4096;
+    dbbackup::Scrubber scrubber(config, options);
+    dbbackup::ScrubResult first = scrubber.scrubDue();
+    EXPECT_EQ(first.verified, 1u);
+    EXPECT_GT(first.bytes, dump.size());
+
+    // The manifest is untouched, but one of the chunks it lists is damaged
+    fs::path chunk;
+    for (const auto& entry : fs::recursive_directory_iterator(testDir / "chunks")) {
+        if (entry.is_regular_file()) {
+            chunk = entry.path();
+            break;
+        }
+    }
+    ASSERT_FALSE(chunk.empty());
+    {
+        std::fstream file(chunk, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(100);
+        file.put('#');
+    }
+    options.interval = std::chrono::seconds(-1);
+    std::vector<std::string> damaged;
+    dbbackup::Scrubber again(config, options, [&damaged](const BackupMetadata& backup) {
+        damaged.push_back(backup.filename);
+    });
+    dbbackup::ScrubResult result = again.scrubDue();
+    EXPECT_EQ(result.damaged, 1u);
+    ASSERT_EQ(damaged.size(), 1u);
+    EXPECT_TRUE(storage.stat("backup_20240101_020000_full.dump.chunks")->damaged);
+}